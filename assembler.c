@@ -1,22 +1,47 @@
+#define _POSIX_C_SOURCE 200809L /* strtok_r(), fmemopen() and open_memstream() */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
 
 #include "src/utils.h"
 #include "src/tables.h"
 #include "src/translate_utils.h"
 #include "src/translate.h"
+#include "src/ir.h"
+#include "src/relax.h"
+#include "src/peephole.h"
+#include "src/dce.h"
+#include "src/object.h"
+#include "src/sim.h"
+#include "src/profile.h"
+#include "src/layout.h"
+#include "src/schedule.h"
+#include "src/disasm.h"
+#include "src/data.h"
+#include "src/iface.h"
+#include "src/memo.h"
+#include "src/spill.h"
+#include "src/preproc.h"
+#include "src/batchio.h"
+#include "src/pack.h"
 #include "assembler.h"
 
-const char* IGNORE_CHARS = " \f\n\r\t\v,()";
+const char* IGNORE_CHARS = LEX_SEPARATORS;
 
 /*******************************
  * Helper Functions
  *******************************/
 
 /* you should not be calling this function yourself. */
-static void raise_label_error(uint32_t input_line, const char* label) {
-	write_to_log("Error - invalid label at line %d: %s\n", input_line, label);
+static void raise_label_error(LogCapture* log, const char* file, uint32_t input_line,
+	const char* label) {
+	
+	write_diagnostic(log, file, input_line, "invalid label", label, NULL, 0);
 }
 
 /* call this function if more than MAX_ARGS arguments are found while parsing
@@ -24,11 +49,15 @@ static void raise_label_error(uint32_t input_line, const char* label) {
 
    INPUT_LINE is which line of the input file that the error occurred in. Note
    that the first line is line 1 and that empty lines are included in the count.
+   FILE is the included file it is a line of, or NULL for the input itself.
+   The error goes to LOG.
 
    EXTRA_ARG should contain the first extra argument encountered.
  */
-static void raise_extra_argument_error(uint32_t input_line, const char* extra_arg) {
-	write_to_log("Error - extra argument at line %d: %s\n", input_line, extra_arg);
+static void raise_extra_argument_error(LogCapture* log, const char* file, uint32_t input_line,
+	const char* extra_arg) {
+	
+	write_diagnostic(log, file, input_line, "extra argument", extra_arg, NULL, 0);
 }
 
 /* You should call this function if write_pass_one() or translate_inst() 
@@ -36,12 +65,23 @@ static void raise_extra_argument_error(uint32_t input_line, const char* extra_ar
  
    INPUT_LINE is which line of the input file that the error occurred in. Note
    that the first line is line 1 and that empty lines are included in the count.
+   FILE is the included file it is a line of, or NULL for the input itself.
+   The error goes to LOG.
+ */
+static void raise_instruction_error(LogCapture* log, const char* file, uint32_t input_line,
+	const char* name, char** args, int num_args) {
+	
+	write_diagnostic(log, file, input_line, "invalid instruction", name, args, num_args);
+}
+
+/* Call this function if a line does not fit in the buffers it is assembled
+   from, BUF_SIZE bytes, rather than assembling part of it. NAME is its
+   first token.
  */
-static void raise_instruction_error(uint32_t input_line, const char* name, char** args,
-	int num_args) {
+static void raise_line_length_error(LogCapture* log, const char* file, uint32_t input_line,
+	const char* name) {
 	
-	write_to_log("Error - invalid instruction at line %d: ", input_line);
-	log_inst(name, args, num_args);
+	write_diagnostic(log, file, input_line, "line too long", name, NULL, 0);
 }
 
 /* Truncates the string at the first occurrence of the '#' character. */
@@ -55,10 +95,14 @@ static void skip_comments(char* str) {
 /* Reads STR and determines whether it is a label (ends in ':'), and if so,
    whether it is a valid label, and then tries to add it to the symbol table.
 
-   INPUT_LINE is which line of the input file we are currently processing. Note
-   that the first line is line 1 and that empty lines are included in this count.
+   INPUT_LINE is which line of FILE (NULL for the input) we are currently
+   processing. Note that the first line is line 1 and that empty lines are
+   included in this count.
 
    BYTE_OFFSET is the offset of the NEXT instruction (should it exist). 
+   If IN_DATA is set, the label is a data label instead, added to
+   DATA_LABELS at offset BYTE_OFFSET into .data. Names are unique across
+   both tables. Errors go to the log of SYMTBL.
 
    Four scenarios can happen:
 	1. STR is not a label (does not end in ':'). Returns 0.
@@ -68,20 +112,31 @@ static void skip_comments(char* str) {
 	3b. STR ends in ':' and is a valid label. Addition to symbol table succeeds.
 		Returns 1.
  */
-static int add_if_label(uint32_t input_line, char* str, uint32_t byte_offset,
-	SymbolTable* symtbl) {
+static int add_if_label(const char* file, uint32_t input_line, char* str, uint32_t byte_offset,
+	SymbolTable* symtbl, SymbolTable* data_labels, int in_data) {
 	
 	size_t len = strlen(str);
 	if (str[len - 1] == ':') {
 		str[len - 1] = '\0';
 		if (is_valid_label(str)) {
-			if (add_to_table(symtbl, str, byte_offset) == 0) {
+			int added = -1;
+			if (get_addr_for_symbol(data_labels, str) != -1) name_already_exists(symtbl->log, str);
+			else if (!in_data) added = add_to_table(symtbl, str, byte_offset);
+			else if (get_addr_for_symbol(symtbl, str) != -1) name_already_exists(symtbl->log, str);
+			else {
+				append_sym(data_labels, str, byte_offset); /* May be unaligned */
+				added = 0;
+			}
+			if (added == 0) {
 				return 1;
 			} else {
+				if (is_log_structured(symtbl->log)) {
+					write_diagnostic(symtbl->log, file, input_line, "duplicate label", str, NULL, 0);
+				}
 				return -1;
 			}
 		} else {
-			raise_label_error(input_line, str);
+			raise_label_error(symtbl->log, file, input_line, str);
 			return -1;
 		}
 	} else {
@@ -89,6 +144,267 @@ static int add_if_label(uint32_t input_line, char* str, uint32_t byte_offset,
 	}
 }
 
+/* What pass one carries from one line to the next, whether the line comes
+   from the input, an included file or a macro.
+ */
+typedef struct PassOne {
+	FILE* output;
+	SymbolTable* symtbl;
+	DataSection* data;
+	IncludeCache* includes;
+	int own_includes;           /* INCLUDES was made for this pass */
+	LogCapture* log;            /* of SYMTBL */
+	int line_info;
+	const char* in_name;
+	const char* file;           /* of the current line, NULL for the input */
+	uint32_t loc;               /* line of the input, for .loc */
+	uint32_t byte_offset;
+	int in_data;
+	char pending[BUF_SIZE];     /* A data label on a line of its own */
+	Macro* macros;
+	Macro* defining;            /* between .macro and .endm */
+	int depth;                  /* of .include and macro calls */
+	int errors;
+} PassOne;
+
+static void process_line(PassOne* st, uint32_t input_line, char* const* tokens,
+	uint32_t num_tokens, const char* raw);
+
+/* Assembles one line of NUM_TOKENS TOKENS, whose text is RAW, as described
+   for pass_one(). The tokens are copied first, add_if_label() cuts them.
+ */
+static void assemble_line(PassOne* st, uint32_t input_line, char* const* tokens,
+	uint32_t num_tokens, const char* raw) {
+	
+	char buf[BUF_SIZE];
+	char* tok[BUF_SIZE / 2];
+	char *args[MAX_ARGS]; /* Arguments to pass to `write` */
+	char* name;
+	char* label = NULL;
+	const char* rest = raw;
+	int num_args;
+	int line_written;
+	uint32_t i, n = 0, used = 0, start;
+	for (i = 0; i < num_tokens && n < BUF_SIZE / 2; i++) {
+		size_t len = strlen(tokens[i]) + 1;
+		if (used + len > BUF_SIZE) break;
+		memcpy(buf + used, tokens[i], len);
+		tok[n++] = buf + used;
+		used += len;
+	}
+	if (i < num_tokens) {
+		raise_line_length_error(st->log, st->file, input_line, tokens[0]);
+		st->errors++;
+		return;
+	}
+	i = 0;
+  /* Deal with label */
+	switch (add_if_label(st->file, input_line, tok[0],
+		st->in_data ? st->data->len : st->byte_offset, st->symtbl, st->data->labels, st->in_data)) {
+		case 0: break; /* Not a label, then is name */
+		case 1: label = tok[i++]; /* Is valid label */
+				if (i == n && st->in_data) strcpy(st->pending, label);
+				if (i == n) return;
+				break;
+		case -1: st->errors++; /* Adding failed */
+				if (++i == n) return;
+	}
+	name = tok[i];
+  /* Switch sections, and take data directives from the raw line */
+	if (strcmp(name, ".text") == 0 || strcmp(name, ".data") == 0) {
+		st->in_data = name[1] == 'd';
+		st->pending[0] = '\0';
+		return;
+	}
+	if (is_data_directive(name)) {
+		uint32_t j;
+		for (j = 0; j <= i && rest; j++) {
+			rest = strstr(rest, tokens[j]);
+			if (rest) rest += strlen(tokens[j]);
+		}
+		if (!label && st->pending[0]) label = st->pending;
+		if (!rest) { /* RAW was cut short */
+			raise_line_length_error(st->log, st->file, input_line, name);
+			st->errors++;
+		} else if (!st->in_data || write_data(st->data, name, rest, &start) != 0) {
+			raise_instruction_error(st->log, st->file, input_line, name, NULL, 0);
+			st->errors++;
+		} else if (label && get_addr_for_symbol(st->data->labels, label) != start) {
+			remove_from_table(st->data->labels, label); /* Moved by alignment */
+			append_sym(st->data->labels, label, start);
+		}
+		st->pending[0] = '\0';
+		return;
+	}
+  /* Check arg numbers */
+	num_args = n - i - 1;
+	if (num_args > MAX_ARGS) {
+		raise_extra_argument_error(st->log, st->file, input_line, tok[i + 1 + MAX_ARGS]);
+		st->errors++;
+		return;
+	}
+	for (num_args = 0; ++i < n; ) args[num_args++] = tok[i];
+  /* Pass directives through, they take no space */
+	if (name[0] == '.') {
+		if (write_directive(st->output, name, args, num_args) != 0) {
+			raise_instruction_error(st->log, st->file, input_line, name, args, num_args);
+			st->errors++;
+		}
+		return;
+	}
+  /* Parse the instrution */
+	if (st->in_data) {
+		raise_instruction_error(st->log, st->file, input_line, name, args, num_args); /* Not in .text */
+		st->errors++;
+		return;
+	}
+	if (st->line_info) fprintf(st->output, ".loc %u\n", st->loc);
+	line_written = write_pass_one(st->output, name, args, num_args);
+	if (!line_written) {
+		raise_instruction_error(st->log, st->file, input_line, name, args, num_args); /* Write error */
+		st->errors++;
+	}
+	st->byte_offset += 4 * line_written; /* Offset increases according to lines written */
+}
+
+/* Feeds the lines of FILE, lexed by the include cache, to process_line().
+   If it is the input, each line is also where .loc points.
+ */
+static void process_lexed(PassOne* st, const LexFile* file, int is_input) {
+	char raw[MACRO_LINE_SIZE];
+	uint32_t i;
+	for (i = 0; i < file->num_lines; i++) {
+		const LexLine* line = file->lines + i;
+		if (is_input) st->loc = line->line;
+		if (line->raw_len >= MACRO_LINE_SIZE) {
+			raise_line_length_error(st->log, st->file, line->line,
+				file->tokens[line->first]);
+			st->errors++;
+			continue;
+		}
+		memcpy(raw, file->map + line->raw, line->raw_len);
+		raw[line->raw_len] = '\0';
+		process_line(st, line->line, file->tokens + line->first, line->num_tokens, raw);
+	}
+}
+
+/* Feeds the lines of the file named by the .include on INPUT_LINE to
+   process_line(), from the include cache so that a file included again is
+   not read and split into tokens again.
+ */
+static void include_file(PassOne* st, uint32_t input_line, char* const* tokens,
+	uint32_t num_tokens) {
+	
+	char path[MACRO_LINE_SIZE];
+	const char* saved = st->file;
+	LexFile* file = NULL;
+	if (num_tokens != 2 || st->depth >= MAX_INCLUDE_DEPTH
+		|| resolve_include(path, saved ? saved : st->in_name, tokens[1]) != 0
+		|| !(file = get_lexed_file(st->includes, path, st->log))) {
+		
+		raise_instruction_error(st->log, st->file, input_line, tokens[0], (char**)tokens + 1,
+			num_tokens - 1);
+		st->errors++;
+		return;
+	}
+	st->file = file->path;
+	st->depth++;
+	process_lexed(st, file, 0);
+	st->depth--;
+	st->file = saved;
+}
+
+/* Assembles the body of MACRO called with the NUM_ARGS ARGS on INPUT_LINE,
+   where errors in it are reported.
+ */
+static void expand_macro(PassOne* st, Macro* macro, uint32_t input_line, char* const* args,
+	uint32_t num_args) {
+	
+	char store[MACRO_LINE_SIZE], raw[MACRO_LINE_SIZE];
+	char* tokens[MACRO_LINE_SIZE / 2];
+	uint32_t i;
+	if (num_args != (uint32_t)macro->num_params || st->depth >= MAX_INCLUDE_DEPTH) {
+		raise_instruction_error(st->log, st->file, input_line, macro->name, (char**)args, num_args);
+		st->errors++;
+		return;
+	}
+	st->depth++;
+	for (i = 0; i < macro->len; i++) {
+		if (expand_macro_line(macro, macro->body + i, args, tokens, store, raw) != 0) {
+			raise_instruction_error(st->log, st->file, input_line, macro->name, (char**)args, num_args);
+			st->errors++;
+			continue;
+		}
+		process_line(st, input_line, tokens, macro->body[i].num_tokens, raw);
+	}
+	st->depth--;
+}
+
+/* Handles the lines that are not assembled as they are: the body of a
+   macro being defined, .macro and .endm, .include and macro calls,
+   optionally after a label.
+ */
+static void process_line(PassOne* st, uint32_t input_line, char* const* tokens,
+	uint32_t num_tokens, const char* raw) {
+	
+	Macro* macro;
+	uint32_t first = 0;
+	if (st->defining) {
+		if (strcmp(tokens[0], ".endm") == 0) {
+			st->defining = NULL;
+		} else if (strcmp(tokens[0], ".macro") == 0) {
+			raise_instruction_error(st->log, st->file, input_line, tokens[0], (char**)tokens + 1,
+				num_tokens - 1); /* Nested */
+			st->errors++;
+		} else {
+			add_macro_line(st->defining, tokens, num_tokens, raw, st->log);
+		}
+		return;
+	}
+	if (strcmp(tokens[0], ".macro") == 0) {
+		int num_params = num_tokens - 2;
+		if (num_tokens < 2 || num_params > MAX_MACRO_PARAMS || !is_valid_label(tokens[1])
+			|| find_macro(st->macros, tokens[1])) {
+			
+			raise_instruction_error(st->log, st->file, input_line, tokens[0], (char**)tokens + 1,
+				num_tokens - 1);
+			st->errors++;
+		}
+		st->defining = define_macro(&st->macros, num_tokens < 2 ? "" : tokens[1], tokens + 2,
+			num_params < 0 ? 0 : num_params > MAX_MACRO_PARAMS ? MAX_MACRO_PARAMS : num_params,
+			st->log);
+		return;
+	}
+	if (strcmp(tokens[0], ".endm") == 0) {
+		raise_instruction_error(st->log, st->file, input_line, tokens[0], (char**)tokens + 1,
+			num_tokens - 1); /* Outside a macro */
+		st->errors++;
+		return;
+	}
+	if (strcmp(tokens[0], ".include") == 0) {
+		include_file(st, input_line, tokens, num_tokens);
+		return;
+	}
+	if (num_tokens > 1 && tokens[0][strlen(tokens[0]) - 1] == ':'
+		&& find_macro(st->macros, tokens[1])) {
+		
+		assemble_line(st, input_line, tokens, 1, raw); /* The label */
+		first = 1;
+	}
+	if ((macro = find_macro(st->macros, tokens[first]))) {
+		expand_macro(st, macro, input_line, tokens + first + 1, num_tokens - first - 1);
+		return;
+	}
+	assemble_line(st, input_line, tokens, num_tokens, raw);
+}
+
+/* Frees what pass one allocated for ST: its macros and its include cache. */
+static void free_pass_one(void* st) {
+	PassOne* pass = st;
+	free_macros(pass->macros);
+	if (pass->own_includes) free_include_cache(pass->includes);
+}
+
 /*******************************
  * Implement the Following
  *******************************/
@@ -113,62 +429,84 @@ static int add_if_label(uint32_t input_line, char* str, uint32_t byte_offset,
 		be the byte offset of the next instruction, regardless of whether there
 		is a next instruction or not.
 
+   If LINE_INFO is set, each source instruction is preceded by a `.loc <line>`
+   directive so that its line can be tracked through to the output file.
+
+   After a `.data` directive (until the next `.text`), lines hold data
+   directives instead of instructions, see write_data(). Their bytes go to
+   DATA rather than OUTPUT, and their labels to DATA->labels at their offset
+   in DATA. DATA->text_size is set to the bytes of .text, and place_data()
+   adds the labels to SYMTBL once the passes before pass two are done.
+
+   `.include "<file>"` assembles the lines of FILE, relative to the file
+   including it (IN_NAME for the input), in its place. Included files are
+   lexed once into tokens and kept in INCLUDES, or in a cache of this pass
+   if it is NULL. `.macro <name> <params>` up to `.endm` defines a macro, and
+   a line `<name> <args>` then assembles its body with each `\<param>`
+   replaced by its argument. Errors in included files are reported at their
+   own lines, errors in a macro at the line calling it, and .loc always
+   gives the line of the input. If INPUT is NULL, the input IN_NAME is read
+   through INCLUDES too, so that it is only lexed again once it changes. Errors go to the log of SYMTBL.
+
    Just like in pass_two(), if the function encounters an error it should NOT
    exit, but process the entire file and return -1. If no errors were encountered, 
    it should return 0.
  */
-int pass_one(FILE* input, FILE* output, SymbolTable* symtbl) {
+int pass_one(FILE* input, FILE* output, SymbolTable* symtbl, int line_info,
+	DataSection* data, IncludeCache* includes, const char* in_name) {
   /* DECLARATIONS */
 	char buf[BUF_SIZE]; /* Buffer for a line */
-	char *args[MAX_ARGS]; /* Arguments to pass to `write` */
-	int num_args;
-	int line_written;
-	int err_exist = 0; /* Flag of errors */
-	uint32_t input_line = 0, byte_offset = 0; /* Initial line_number & offset */
-	if (!input || !output || !symtbl) return -1;
+	char raw[BUF_SIZE]; /* The line before tokenizing, for data directives */
+	char* tokens[BUF_SIZE / 2];
+	PassOne st;
+	uint32_t input_line = 0; /* Initial line_number */
+	LexFile* file;
+	if ((!input && !includes) || !output || !symtbl || !data) return -1;
+	memset(&st, 0, sizeof(st));
+	st.output = output;
+	st.symtbl = symtbl;
+	st.data = data;
+	st.line_info = line_info;
+	st.in_name = in_name;
+	st.log = symtbl->log;
+	st.own_includes = !includes;
+	st.includes = includes ? includes : create_include_cache(st.log);
+	push_cleanup(st.log, free_pass_one, &st); /* Macros are added as they come */
+	if (!input) { /* Lexed, like an included file */
+		if ((file = get_lexed_file(st.includes, in_name, st.log))) process_lexed(&st, file, 1);
+		else {
+			log_to(st.log, "Error: unable to open input file: %s\n", in_name);
+			st.errors++;
+		}
+	}
   /* First, read next line into buffer */
-	while (fgets(buf, BUF_SIZE, input)) {
+	while (input && fgets(buf, BUF_SIZE, input)) {
 		char* pch;
-		char* name;
-		int err_extra_arg = 0;
+		char* save;
+		uint32_t num_tokens = 0;
 		input_line++; /* Input line increases whenever a non-empty line caught */
+		strcpy(raw, buf);
 	  /* Skip all the comments */
 		skip_comments(buf);
-	  /* Use strtok() to read next token*/
-		pch = strtok(buf, IGNORE_CHARS);
-		if (!pch) continue; /* If empty, go to next line */
-	  /* Deal with label */
-		switch (add_if_label(input_line, pch, byte_offset, symtbl)) {
-			case 0: name = pch; /* Not a label, then is name */
-					break;
-			case -1: err_exist++; /* Adding failed */
-			case 1: pch = strtok(NULL, IGNORE_CHARS); /* Is valid label */
-					if (!pch) continue;
-					name = pch;
-		}
-	  /* Check arg numbers */
-		num_args = 0;
-		while ((pch = strtok(NULL, IGNORE_CHARS))) {
-			if (num_args >= MAX_ARGS) { /* Over MAX_ARG */
-				raise_extra_argument_error(input_line, pch);
-				err_extra_arg++;
-				err_exist++;
-				break;
-			}
-			args[num_args++] = pch; /* Add an arg */
-		}
-	  /* Parse the instrution */
-		if (!err_extra_arg) {
-			line_written = write_pass_one(output, name, args, num_args);
-			if (!line_written) {
-				raise_instruction_error(input_line, name, args, num_args); /* Write error */
-				err_exist++;
-			}
-			byte_offset += 4 * line_written; /* Offset increases according to lines written */
+	  /* Use strtok_r() to read next token, it keeps no state of its own */
+		for (pch = strtok_r(buf, IGNORE_CHARS, &save); pch && num_tokens < BUF_SIZE / 2;
+			pch = strtok_r(NULL, IGNORE_CHARS, &save)) {
+			
+			tokens[num_tokens++] = pch;
 		}
+		if (!num_tokens) continue; /* If empty, go to next line */
+		st.loc = input_line;
+		process_line(&st, input_line, tokens, num_tokens, raw);
 	}
+	if (st.defining) {
+		log_to(st.log, "Error - .macro %s is missing its .endm\n", st.defining->name);
+		st.errors++;
+	}
+	data->text_size = st.byte_offset;
+	pop_cleanup(st.log, &st);
+	free_pass_one(&st);
   /* Check whether error occurs */
-	if (err_exist) return -1;
+	if (st.errors) return -1;
 	else return 0;
 }
 
@@ -179,8 +517,12 @@ int pass_one(FILE* input, FILE* output, SymbolTable* symtbl) {
 	4. All instructions have at maximum MAX_ARGS arguments
 	5. The symbol table has been filled out already
    If an error is reached, DO NOT EXIT the function. Keep translating the rest of
-   the document, and at the end, return -1. Return 0 if no errors were encountered. */
-int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl) {
+   the document, and at the end, return -1. Return 0 if no errors were encountered.
+   If OUTPUT is NULL, the instructions are only checked. Errors are reported,
+   to the log of SYMTBL, at the source line of the last .loc, if any. Words of instructions seen before
+   come from MEMO instead of being encoded again, unless it is NULL. */
+int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl,
+	int64_t text_base, LineTable* lines, EncodingMemo* memo) {
   /* DECLARATIONS */
 	char buf[BUF_SIZE]; /* Buffer for a line */
 	char *args[MAX_ARGS]; /* Arguments to pass to `write` */
@@ -188,33 +530,469 @@ int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl
 	int err;
 	int err_exist = 0; /* Flag of errors */
 	uint32_t input_line = 0, byte_offset = 0; /* Initial line_number & offset */
-	if (!input || !output || !symtbl || !reltbl) return -1;
+	uint32_t source_line = 0; /* Set by .loc */
+	uint32_t word;
+	int memoized;
+	if (!input || !symtbl || !reltbl || !lines) return -1;
   /* First, read next line into buffer */
 	while (fgets(buf, BUF_SIZE, input)) {
 		char* pch;
 		char* name;
+		char* save;
 		input_line++; /* Input line increases whenever a non-empty line caught */
-	  /* Next, use strtok() to scan for next character. */
-		pch = strtok(buf, IGNORE_CHARS);
+	  /* Next, use strtok_r() to scan for next character. */
+		pch = strtok_r(buf, IGNORE_CHARS, &save);
 		if (!pch) continue; /* If there's nothing, go to the next line */
 	  /* Get instruction name */
   		name = pch;
+		if (name[0] == '.') { /* Directive, nothing to encode */
+			pch = strtok_r(NULL, IGNORE_CHARS, &save);
+			if (strcmp(name, ".loc") == 0 && pch) source_line = (uint32_t)strtol(pch, NULL, 10);
+			continue;
+		}
 	  /* Parse for instruction arguments. */
 	  	num_args = 0;
-		while ((pch = strtok(NULL, IGNORE_CHARS))) args[num_args++] = pch;
+		while ((pch = strtok_r(NULL, IGNORE_CHARS, &save))) args[num_args++] = pch;
 	  /* Use translate_inst() to translate the instruction and write. */
-		err = translate_inst(output, name, args, num_args, byte_offset, symtbl, reltbl);
+		memoized = memo ? lookup_encoding(memo, name, args, num_args, &word) : -1;
+		if (memoized == 1) {
+			write_inst_hex(output, word);
+			err = 0;
+		} else {
+			err = translate_inst(output, name, args, num_args, byte_offset, symtbl, reltbl, text_base,
+				&word);
+			if (err == 0 && memoized == 0) remember_encoding(memo, word);
+		}
 	  /* If an error occurs */
 		if (err == -1) {
-			raise_instruction_error(input_line, name, args, num_args);
+			raise_instruction_error(symtbl->log, NULL, source_line ? source_line : input_line, name,
+				args, num_args);
 			err_exist++;
-		} else byte_offset += 4; /* Offset increases according to lines written */
+		} else {
+			if (source_line) add_line(lines, byte_offset, source_line);
+			byte_offset += 4; /* Offset increases according to lines written */
+		}
 	}
   /* Check whether error occurs */
 	if (err_exist) return -1;
 	else return 0;
 }
 
+/* Reads an intermediate file into LIST, one entry per instruction tagged with
+   the line of the last .loc, and the labels of its .globl directives into
+   EXPORTS. Makes the same assumptions about INPUT as pass_two(). Returns 0
+   on success and -1 if a line has more than MAX_ARGS arguments.
+ */
+static int read_intermediate(FILE* input, InstList* list, SymbolTable* exports) {
+	char buf[BUF_SIZE];
+	char *args[MAX_ARGS];
+	int num_args;
+	uint32_t line = 0;
+	while (fgets(buf, BUF_SIZE, input)) {
+		char* pch;
+		char* save;
+		char* name = strtok_r(buf, IGNORE_CHARS, &save);
+		if (!name) continue;
+		num_args = 0;
+		while ((pch = strtok_r(NULL, IGNORE_CHARS, &save))) {
+			if (num_args >= MAX_ARGS) return -1;
+			args[num_args++] = pch;
+		}
+		if (strcmp(name, ".globl") == 0 && num_args == 1) add_to_table(exports, args[0], 0);
+		else if (strcmp(name, ".loc") == 0 && num_args == 1) line = (uint32_t)strtol(args[0], NULL, 10);
+		else append_inst(list, name, args, num_args, line);
+	}
+	return 0;
+}
+
+static void release_table(void* table) {
+	free_table(table);
+}
+
+/* Runs the optimizations selected in OPTS over LIST, moving the labels of
+   SYMTBL along. Labels stored in .word entries of DATA are kept alive by
+   dead code elimination, like EXPORTS. Returns the number of instructions
+   changed or removed, or -1 on error.
+ */
+static int64_t optimize_list(InstList* list, SymbolTable* symtbl, SymbolTable* exports,
+	DataSection* data, const AsmOptions* opts) {
+	
+	int64_t changed = 0, removed;
+	uint32_t before;
+	Symbol* cur;
+	if (has_relative_branches(list)) {
+		log_to(list->log, "Warning: numeric branch offsets present, optimizations skipped.\n");
+		return 0;
+	}
+	if (opts->dce) {
+		SymbolTable* roots = create_table(SYMBOLTBL_NON_UNIQUE, list->log); /* Exports and .word labels */
+		push_cleanup(list->log, release_table, roots);
+		cur = exports->head;
+		while ((cur = cur->next)) append_sym(roots, cur->name, 0);
+		cur = data->words->head;
+		while ((cur = cur->next)) append_sym(roots, cur->name, 0);
+		before = list->len;
+		removed = eliminate_dead_code(list, symtbl, roots, opts->entry);
+		pop_cleanup(list->log, roots);
+		free_table(roots);
+		if (removed == -1) return -1;
+		changed += removed;
+		if (!opts->quiet) printf("Running dead code elimination: %u -> %u instructions\n", before, list->len);
+	}
+	if (opts->optimize) {
+		before = list->len;
+		changed += peephole(list, symtbl);
+		if (!opts->quiet) printf("Running peephole optimizer: %u -> %u instructions\n", before, list->len);
+	}
+	if (opts->layout) {
+		FILE* file = fopen(opts->layout, "r");
+		Profile* prof;
+		uint64_t taken_before, taken_after;
+		if (!file) {
+			log_to(list->log, "Error: unable to open profile: %s\n", opts->layout);
+			return -1;
+		}
+		prof = read_profile(file, list, symtbl);
+		fclose(file);
+		if (!prof) return -1;
+		layout_blocks(list, symtbl, prof, &taken_before, &taken_after);
+		free_profile(prof);
+		changed++;
+		if (!opts->quiet) printf("Running block layout: %lu -> %lu taken branches and jumps (from profile)\n",
+			(unsigned long)taken_before, (unsigned long)taken_after);
+	}
+	if (opts->schedule) {
+		uint32_t stalls = count_load_stalls(list);
+		schedule_loads(list, symtbl);
+		changed++;
+		if (!opts->quiet) printf("Running load scheduler: %u -> %u load-use stalls\n", stalls,
+			count_load_stalls(list));
+	}
+	return changed;
+}
+
+/* Runs between the two passes: reads the intermediate code from INPUT into
+   LIST and EXPORTS, runs the optimizations selected in OPTS and rewrites
+   out-of-range branches, keeping SYMTBL updated to match. Returns the number
+   of changes, after which LIST must be written back, or -1 on error.
+ */
+static int64_t optimize_intermediate(FILE* input, InstList* list, SymbolTable* exports,
+	SymbolTable* symtbl, DataSection* data, const AsmOptions* opts, AsmStats* stats) {
+	
+	int64_t changed = 0;
+	if (read_intermediate(input, list, exports) != 0) return -1;
+	if (opts->optimize || opts->dce || opts->layout || opts->schedule) {
+		changed = optimize_list(list, symtbl, exports, data, opts);
+		if (changed == -1) return -1;
+	}
+	stats->relaxed = relax_branches(list, symtbl);
+	stats->num_insts = list->len;
+	data->text_size = 4 * list->len;
+	return changed + stats->relaxed;
+}
+
+static void write_intermediate(FILE* output, InstList* list, SymbolTable* exports) {
+	Symbol* cur = exports->head;
+	while ((cur = cur->next)) write_inst_string(output, ".globl", &cur->name, 1);
+	write_inst_list(list, output);
+}
+
+/* Runs optimize_intermediate() on the intermediate file TMP_NAME and, if
+   anything changed, writes the file back. Returns 0 on success and -1 on
+   error.
+ */
+static int layout_intermediate(const char* tmp_name, SymbolTable* symtbl,
+	DataSection* data, const AsmOptions* opts, AsmStats* stats) {
+	
+	FILE* file;
+	int err = 0;
+	int64_t changed;
+	InstList* list = create_inst_list(symtbl->log);
+	SymbolTable* exports = create_table(SYMBOLTBL_NON_UNIQUE, symtbl->log);
+
+	file = fopen(tmp_name, "r");
+	if (!file) {
+		write_to_log("Error: unable to open intermediate file: %s\n", tmp_name);
+		free_inst_list(list);
+		free_table(exports);
+		return -1;
+	}
+	changed = optimize_intermediate(file, list, exports, symtbl, data, opts, stats);
+	fclose(file);
+	if (changed == -1) err = -1;
+	else if (changed) {
+		file = fopen(tmp_name, "w");
+		if (!file) {
+			write_to_log("Error: unable to open intermediate file: %s\n", tmp_name);
+			err = -1;
+		} else {
+			write_intermediate(file, list, exports);
+			fclose(file);
+		}
+	}
+	free_inst_list(list);
+	free_table(exports);
+	return err;
+}
+
+/* Streams the intermediate file TMP_NAME for -mem, under which the program
+   is never in memory as a whole and so cannot be relaxed: reports every
+   branch relax_branches() would have rewritten, at its line like pass two
+   does. Returns 0 if there is none and -1 otherwise.
+ */
+static int find_far_branches(const char* tmp_name, SymbolTable* symtbl) {
+	char buf[BUF_SIZE];
+	Inst inst;
+	uint32_t input_line = 0, source_line = 0, byte_offset = 0;
+	int err = 0;
+	FILE* file = fopen(tmp_name, "r");
+	if (!file) {
+		write_to_log("Error: unable to open intermediate file: %s\n", tmp_name);
+		return -1;
+	}
+	while (fgets(buf, BUF_SIZE, file)) {
+		char* pch;
+		char* save;
+		input_line++;
+		inst.name = strtok_r(buf, IGNORE_CHARS, &save);
+		if (!inst.name) continue;
+		inst.num_args = 0;
+		while ((pch = strtok_r(NULL, IGNORE_CHARS, &save)) && inst.num_args < INST_MAX_ARGS) {
+			inst.args[inst.num_args++] = pch;
+		}
+		if (inst.name[0] == '.') { /* Directive, takes no space */
+			if (strcmp(inst.name, ".loc") == 0 && inst.num_args) {
+				source_line = (uint32_t)strtol(inst.args[0], NULL, 10);
+			}
+			continue;
+		}
+		if (branch_out_of_range(&inst, byte_offset, symtbl)) {
+			write_diagnostic(symtbl->log, NULL, source_line ? source_line : input_line,
+				"branch out of range, not relaxed with -mem", inst.name, inst.args, inst.num_args);
+			err = -1;
+		}
+		byte_offset += 4;
+	}
+	fclose(file);
+	return err;
+}
+
+static void release_memo(void* memo) {
+	free_memo(memo);
+}
+
+/* Places .data after .text, see place_data(), then runs pass two from the
+   intermediate code in SRC and writes the output file to DST: .text, then
+   .data (with its labels filled in), .symbol, .relocation (.relgroup with
+   -crel) and, if lines were recorded, .line. Encoding memo hits, from the
+   memo of OPTS if it has one, are counted in STATS. Returns 0 on success
+   and -1 on error.
+ */
+static int write_object(FILE* src, FILE* dst, SymbolTable* symtbl, SymbolTable* reltbl,
+	LineTable* lines, DataSection* data, const AsmOptions* opts, AsmStats* stats) {
+	
+	int err = 0;
+	EncodingMemo* memo = opts->memo;
+	uint64_t lookups = memo ? memo->lookups : 0, hits = memo ? memo->hits : 0;
+	if (place_data(data, symtbl) != 0) return -1;
+	if (!opts->memo) {
+		memo = create_memo(symtbl->log);
+		push_cleanup(symtbl->log, release_memo, memo); /* Pass two allocates as it goes */
+	}
+	fprintf(dst, ".text\n");
+	if (pass_two(src, dst, symtbl, reltbl, opts->text_base, lines, memo) != 0) {
+		err = -1;
+	}
+	stats->memo_lookups = memo->lookups - lookups;
+	stats->memo_hits = memo->hits - hits;
+	if (!opts->memo) {
+		pop_cleanup(symtbl->log, memo);
+		free_memo(memo);
+	}
+
+	if (data->len) {
+		if (resolve_data(data, symtbl, reltbl, opts->text_base) != 0) err = -1;
+		fprintf(dst, "\n.data\n");
+		write_data_section(data, dst);
+	}
+	
+	fprintf(dst, "\n.symbol\n");
+	write_table(symtbl, dst);
+
+	if (opts->compact_relocs) {
+		fprintf(dst, "\n.relgroup\n");
+		write_reloc_groups(reltbl, dst);
+	} else {
+		fprintf(dst, "\n.relocation\n");
+		write_table(reltbl, dst);
+	}
+
+	if (lines->len) {
+		fprintf(dst, "\n.line\n");
+		write_line_table(lines, dst);
+	}
+	return err;
+}
+
+/* Like write_object(), but writes the output file packed to DST, see
+   pack.c: the text output goes to a temporary file and is packed from there
+   block by block. Its size with and without -z and the time packing took go
+   to STATS. Returns 0 on success and -1 on error.
+ */
+static int write_packed_object(FILE* src, FILE* dst, SymbolTable* symtbl,
+	SymbolTable* reltbl, LineTable* lines, DataSection* data, const AsmOptions* opts,
+	AsmStats* stats) {
+
+	struct timespec start, end;
+	PackStats pack;
+	int err;
+	FILE* plain = tmpfile();
+	if (!plain) {
+		write_to_log("Error: unable to open a temporary file\n");
+		return -1;
+	}
+	err = write_object(src, plain, symtbl, reltbl, lines, data, opts, stats);
+	rewind(plain);
+	memset(&pack, 0, sizeof(pack));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (pack_object(plain, dst, &pack) != 0) {
+		write_to_log("Error: unable to pack the output file\n");
+		err = -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fclose(plain);
+	stats->plain_bytes = pack.plain_bytes;
+	stats->packed_bytes = pack.packed_bytes;
+	stats->pack_secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	return err;
+}
+
+/* Hashes what the intermediate file is made from: the source file IN_NAME,
+   the options that change pass one or the optimizations between the passes,
+   and the profile blocks are laid out by. Returns 0 on success and -1 if a
+   file cannot be read.
+ */
+static int hash_source(uint64_t* hash, const char* in_name, const AsmOptions* opts) {
+	int flags[4];
+	flags[0] = opts->line_info;
+	flags[1] = opts->optimize;
+	flags[2] = opts->dce;
+	flags[3] = opts->schedule;
+	*hash = IFACE_HASH_INIT;
+	if (hash_file(hash, in_name) != 0) return -1;
+	*hash = hash_bytes(*hash, flags, sizeof(flags));
+	if (opts->entry) *hash = hash_bytes(*hash, opts->entry, strlen(opts->entry) + 1);
+	if (opts->layout && hash_file(hash, opts->layout) != 0) return -1;
+	return 0;
+}
+
+/* Loads the symbol interface written by an earlier run into SYMTBL and DATA
+   if it is still current: IN_NAME and OPTS hash to its source hash and
+   TMP_NAME, the intermediate file, to its intermediate hash. Pass one can
+   then be skipped. Returns 1 if it was loaded and 0 otherwise.
+ */
+static int load_current_iface(const char* in_name, const char* tmp_name,
+	SymbolTable* symtbl, DataSection* data, const AsmOptions* opts, AsmStats* stats) {
+	
+	uint64_t source_hash, inter_hash = IFACE_HASH_INIT;
+	int loaded = 0;
+	Iface* iface = load_iface(opts->iface);
+	if (!iface) return 0;
+	if (hash_source(&source_hash, in_name, opts) == 0
+		&& hash_file(&inter_hash, tmp_name) == 0
+		&& iface->header->source_hash == source_hash
+		&& iface->header->inter_hash == inter_hash
+		&& read_iface_tables(iface, symtbl, data) == 0) {
+		stats->num_insts = data->text_size / 4;
+		loaded = 1;
+	}
+	free_iface(iface);
+	return loaded;
+}
+
+/* Writes the symbol interface of IN_NAME, assembled into the intermediate
+   file TMP_NAME, to the file OPTS->iface. Returns 0 on success and -1 on
+   error.
+ */
+static int save_iface(const char* in_name, const char* tmp_name, SymbolTable* symtbl,
+	DataSection* data, const AsmOptions* opts) {
+	
+	uint64_t source_hash, inter_hash = IFACE_HASH_INIT;
+	FILE* file;
+	int err;
+	if (hash_source(&source_hash, in_name, opts) != 0 || hash_file(&inter_hash, tmp_name) != 0) {
+		write_to_log("Error: unable to hash %s for its symbol interface\n", in_name);
+		return -1;
+	}
+	file = fopen(opts->iface, "wb");
+	if (!file) {
+		write_to_log("Error: unable to open symbol interface: %s\n", opts->iface);
+		return -1;
+	}
+	err = write_iface(file, symtbl, data, source_hash, inter_hash);
+	fclose(file);
+	return err;
+}
+
+/* Loads the symbol interface OPTS->iface for the intermediate file TMP_NAME
+   into SYMTBL and DATA, for pass two run on its own. Returns 0 on success and
+   -1, after logging why, if it cannot be read or was written for another
+   intermediate file.
+ */
+static int load_iface_for_pass_two(const char* tmp_name, SymbolTable* symtbl,
+	DataSection* data, const AsmOptions* opts) {
+	
+	uint64_t inter_hash = IFACE_HASH_INIT;
+	int err = 0;
+	Iface* iface = load_iface(opts->iface);
+	if (!iface) {
+		write_to_log("Error: unable to read symbol interface: %s\n", opts->iface);
+		return -1;
+	}
+	if (hash_file(&inter_hash, tmp_name) != 0 || iface->header->inter_hash != inter_hash) {
+		write_to_log("Error: symbol interface %s is stale for %s\n", opts->iface, tmp_name);
+		err = -1;
+	} else if (read_iface_tables(iface, symtbl, data) != 0) {
+		write_to_log("Error: corrupt symbol interface: %s\n", opts->iface);
+		err = -1;
+	}
+	free_iface(iface);
+	return err;
+}
+
+static void print_stats(const AsmStats* stats) {
+	printf("Stats: %u instructions in .text\n", stats->num_insts);
+	printf("Stats: %u out-of-range branches relaxed\n", stats->relaxed);
+	printf("Stats: %lu of %lu position-independent encodings from the memo (%.1f%%)\n",
+		(unsigned long)stats->memo_hits, (unsigned long)stats->memo_lookups,
+		stats->memo_lookups ? 100.0 * stats->memo_hits / stats->memo_lookups : 0.0);
+	if (stats->packed_bytes) {
+		printf("Stats: output packed from %lu to %lu bytes (%.1f%%) at %.1f MB/s\n",
+			(unsigned long)stats->plain_bytes, (unsigned long)stats->packed_bytes,
+			100.0 * stats->packed_bytes / stats->plain_bytes,
+			stats->pack_secs > 0 ? stats->plain_bytes / stats->pack_secs / 1e6 : 0.0);
+	}
+}
+
+/* Prints how many symbols and relocations went to disk under -mem, how
+   many lookups the spill cache answered and the peak resident set size.
+ */
+static void print_spill_stats(SymbolTable* symtbl, SymbolTable* reltbl) {
+	struct rusage usage;
+	uint64_t lookups = 0, hits = 0;
+	if (symtbl->spill) {
+		lookups = symtbl->spill->lookups;
+		hits = symtbl->spill->cache_hits;
+	}
+	printf("Stats: %lu symbols and %lu relocations spilled to disk\n",
+		(unsigned long)symtbl->spilled, (unsigned long)reltbl->spilled);
+	printf("Stats: %lu of %lu spilled symbol lookups from the cache\n",
+		(unsigned long)hits, (unsigned long)lookups);
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		printf("Stats: %ld KB peak resident set\n", usage.ru_maxrss);
+	}
+}
+
 /*******************************
  * Do Not Modify Code Below
  *******************************/
@@ -242,103 +1020,1070 @@ static void close_files(FILE* input, FILE* output) {
 }
 
 /* Runs the two-pass assembler. Most of the actual work is done in pass_one()
-   and pass_two().
+   and pass_two(). OPTS holds the settings given on the command line.
+   Returns 0 on success and 1 on error, also when a file cannot be opened.
  */
-int assemble(const char* in_name, const char* tmp_name, const char* out_name) {
+int assemble(const char* in_name, const char* tmp_name, const char* out_name,
+	const AsmOptions* opts) {
 	FILE *src, *dst;
-	int err = 0;
-	SymbolTable* symtbl = create_table(SYMBOLTBL_UNIQUE_NAME);
-	SymbolTable* reltbl = create_table(SYMBOLTBL_NON_UNIQUE);
+	int err = 0, far = 0;
+	SymbolTable* symtbl = create_table(SYMBOLTBL_UNIQUE_NAME, NULL);
+	SymbolTable* reltbl = create_table(SYMBOLTBL_NON_UNIQUE, NULL);
+	LineTable* lines = create_line_table(NULL);
+	DataSection* data = create_data_section(NULL);
+	IncludeCache* includes = opts->includes ? opts->includes : create_include_cache(NULL);
+	uint64_t lookups = includes->lookups + (opts->includes != NULL); /* With the input's */
+	AsmStats stats;
 
-	if (in_name) {
-		printf("Running pass one: %s -> %s\n", in_name, tmp_name);
+	memset(&stats, 0, sizeof(stats));
+	if (opts->mem_budget) { /* Half each, the tables only grow */
+		set_table_budget(symtbl, opts->mem_budget / 2);
+		set_table_budget(reltbl, opts->mem_budget / 2);
+	}
+	if (in_name && opts->iface
+		&& load_current_iface(in_name, tmp_name, symtbl, data, opts, &stats)) {
+		if (!opts->quiet) printf("Skipping pass one: %s is up to date with %s\n", tmp_name, opts->iface);
+	} else if (in_name) {
+		if (!opts->quiet) printf("Running pass one: %s -> %s\n", in_name, tmp_name);
 		if (open_files(&src, &dst, in_name, tmp_name) != 0) {
-			free_table(symtbl);
-			free_table(reltbl);
-			exit(1);
+			err = 1;
+			goto done;
 		}
 
-		if (pass_one(src, dst, symtbl) != 0) {
+		if (pass_one(opts->includes ? NULL : src /* Kept lexed, like its includes */, dst,
+			symtbl, opts->line_info, data, includes, in_name) != 0) {
 			err = 1;
 		}
 		close_files(src, dst);
+
+		if (opts->mem_budget && data->len > opts->mem_budget) {
+			write_to_log("Error: .data is larger than the memory budget\n");
+			err = 1;
+		}
+		if (!err && !opts->mem_budget /* The whole program would be in memory */
+			&& layout_intermediate(tmp_name, symtbl, data, opts, &stats) != 0) {
+			err = 1;
+		}
+		if (!err && opts->mem_budget) { /* Nothing moved after pass one */
+			stats.num_insts = data->text_size / 4;
+			if (find_far_branches(tmp_name, symtbl) != 0) err = far = 1;
+		}
+		if (!err && opts->iface && includes->lookups != lookups) {
+			/* Its hash covers the input alone, never skip pass one */
+			if (!opts->quiet) printf("Not writing symbol interface: %s includes other files\n", in_name);
+			unlink(opts->iface);
+		} else if (!err && opts->iface) {
+			if (!opts->quiet) printf("Writing symbol interface: %s\n", opts->iface);
+			if (save_iface(in_name, tmp_name, symtbl, data, opts) != 0) err = 1;
+		}
+	} else if (opts->iface && load_iface_for_pass_two(tmp_name, symtbl, data, opts) != 0) {
+		err = 1;
 	}
 
-	if (out_name) {
-		printf("Running pass two: %s -> %s\n", tmp_name, out_name);
+	if (out_name && !far) { /* Pass two would only fail the far branches again */
+		if (!opts->quiet) printf("Running pass two: %s -> %s\n", tmp_name, out_name);
 		if (open_files(&src, &dst, tmp_name, out_name) != 0) {
-			free_table(symtbl);
-			free_table(reltbl);
-			exit(1);
+			err = 1;
+			goto done;
 		}
 
-		fprintf(dst, ".text\n");
-		if (pass_two(src, dst, symtbl, reltbl) != 0) {
+		if (opts->packed) {
+			if (write_packed_object(src, dst, symtbl, reltbl, lines, data, opts, &stats) != 0) {
+				err = 1;
+			}
+		} else if (write_object(src, dst, symtbl, reltbl, lines, data, opts, &stats) != 0) {
 			err = 1;
 		}
-		
-		fprintf(dst, "\n.symbol\n");
-		write_table(symtbl, dst);
-
-		fprintf(dst, "\n.relocation\n");
-		write_table(reltbl, dst);
 
 		close_files(src, dst);
 	}
 	
+	if (opts->stats) {
+		print_stats(&stats);
+		print_spill_stats(symtbl, reltbl);
+	}
+done:
 	free_table(symtbl);
 	free_table(reltbl);
+	free_line_table(lines);
+	free_data_section(data);
+	if (!opts->includes) free_include_cache(includes);
+	return err;
+}
+
+/*******************************
+ * Library API
+ *******************************/
+
+struct AsmCtx {
+	AsmOptions opts;
+};
+
+/* Fills OPTS with the defaults of the command line: no options given. */
+void asm_init_options(AsmOptions* opts) {
+	opts->text_base = -1;
+	opts->stats = 0;
+	opts->optimize = 0;
+	opts->dce = 0;
+	opts->entry = NULL;
+	opts->max_insts = 0;
+	opts->line_info = 0;
+	opts->counts = NULL;
+	opts->layout = NULL;
+	opts->schedule = 0;
+	opts->verify = 0;
+	opts->quiet = 0;
+	opts->iface = NULL;
+	opts->mem_budget = 0;
+	opts->compact_relocs = 0;
+	opts->packed = 0;
+	opts->includes = NULL;
+	opts->memo = NULL;
+}
+
+/* Returns a context that assembles with a copy of OPTS (or the defaults if
+   OPTS is NULL), or NULL if out of memory. The options that name files
+   (layout, counts, iface) and print (stats) are cleared, and progress lines are
+   not printed. ENTRY is not copied and must outlive the context.
+
+   Besides the options, a context keeps the files its assemblies .include,
+   lexed, and the assembler keeps no state between calls: each thread may
+   assemble with its own context at the same time.
+ */
+AsmCtx* asm_ctx_create(const AsmOptions* opts) {
+	AsmCtx* ctx = malloc(sizeof(AsmCtx));
+	if (!ctx) return NULL;
+	if (opts) ctx->opts = *opts;
+	else asm_init_options(&ctx->opts);
+	ctx->opts.layout = NULL;
+	ctx->opts.counts = NULL;
+	ctx->opts.iface = NULL;
+	ctx->opts.stats = 0;
+	ctx->opts.quiet = 1;
+	ctx->opts.includes = NULL; /* Created by the first assembly */
+	ctx->opts.memo = NULL;
+	return ctx;
+}
+
+void asm_ctx_free(AsmCtx* ctx) {
+	if (ctx->opts.includes) free_include_cache(ctx->opts.includes);
+	free(ctx);
+}
+
+/* What one assemble_in_memory() or check() run allocates. It is kept by the
+   caller, so that if an allocation fails part way and allocation_failed()
+   jumps back, free_asm_run() can still release what was built.
+ */
+typedef struct AsmRun {
+	SymbolTable* symtbl;
+	SymbolTable* reltbl;
+	SymbolTable* exports;
+	LineTable* lines;
+	DataSection* data;
+	InstList* list;
+	EncodingMemo* memo; /* of check(), write_object() keeps its own */
+	FILE* input;        /* the memory streams open at the moment */
+	FILE* output;
+	char* inter;        /* buffers OUTPUT may be writing to */
+	size_t inter_len;
+	char* out;
+	size_t out_len;
+} AsmRun;
+
+/* Closes the streams of RUN and frees everything it still owns. */
+static void free_asm_run(AsmRun* run) {
+	if (run->input) fclose(run->input);
+	if (run->output) fclose(run->output); /* Updates INTER or OUT */
+	if (run->symtbl) free_table(run->symtbl);
+	if (run->reltbl) free_table(run->reltbl);
+	if (run->exports) free_table(run->exports);
+	if (run->lines) free_line_table(run->lines);
+	if (run->data) free_data_section(run->data);
+	if (run->list) free_inst_list(run->list);
+	if (run->memo) free_memo(run->memo);
+	free(run->inter);
+	free(run->out);
+	free(run);
+}
+
+/* Closes the stream at STREAM, if any, and clears it. */
+static void close_stream(FILE** stream) {
+	if (*stream) fclose(*stream);
+	*stream = NULL;
+}
+
+/* Does the work of assemble() on the LEN bytes of SRC, read from IN_NAME
+   (NULL if it was not read from a file), passing the intermediate code and
+   the output file through memory streams, and stores both and the object
+   in RES. Everything else it allocates is kept in RUN, which starts zeroed,
+   for the caller to free. Diagnostics and allocation failures go to LOG.
+   Returns 0 on success and -1 on error.
+ */
+static int assemble_in_memory(const AsmOptions* opts, const char* in_name, const char* src,
+	size_t len, AsmResult* res, AsmRun* run, LogCapture* log) {
+	
+	Object* obj = NULL;
+	Symbol* cur;
+	AsmStats stats;
+	int64_t changed;
+	int err = 0;
+	uint32_t i;
+
+	memset(&stats, 0, sizeof(stats));
+	run->symtbl = create_table(SYMBOLTBL_UNIQUE_NAME, log);
+	run->reltbl = create_table(SYMBOLTBL_NON_UNIQUE, log);
+	run->exports = create_table(SYMBOLTBL_NON_UNIQUE, log);
+	run->lines = create_line_table(log);
+	run->data = create_data_section(log);
+	run->list = create_inst_list(log);
+	run->input = fmemopen((void*)src, len, "r");
+	run->output = open_memstream(&run->inter, &run->inter_len);
+	if (!run->input || !run->output) allocation_failed(log);
+	if (pass_one(run->input, run->output, run->symtbl, opts->line_info, run->data,
+		opts->includes, in_name) != 0) {
+		
+		err = -1;
+	}
+	close_stream(&run->input);
+	close_stream(&run->output);
+
+	if (!err) {
+		run->input = fmemopen(run->inter, run->inter_len, "r");
+		if (!run->input) allocation_failed(log);
+		changed = optimize_intermediate(run->input, run->list, run->exports, run->symtbl,
+			run->data, opts, &stats);
+		close_stream(&run->input);
+		if (changed == -1) err = -1;
+		else if (changed) {
+			free(run->inter);
+			run->inter = NULL;
+			run->output = open_memstream(&run->inter, &run->inter_len);
+			if (!run->output) allocation_failed(log);
+			write_intermediate(run->output, run->list, run->exports);
+			close_stream(&run->output);
+		}
+	}
+
+	if (!err) {
+		run->input = fmemopen(run->inter, run->inter_len, "r");
+		run->output = open_memstream(&run->out, &run->out_len);
+		if (!run->input || !run->output) allocation_failed(log);
+		if (write_object(run->input, run->output, run->symtbl, run->reltbl, run->lines,
+			run->data, opts, &stats) != 0) err = -1;
+		close_stream(&run->input);
+		close_stream(&run->output);
+	}
+
+	if (!err) { /* Parse it back, as any reader of output files would */
+		run->input = fmemopen(run->out, run->out_len, "r");
+		if (!run->input) allocation_failed(log);
+		obj = read_object(run->input, log);
+		close_stream(&run->input);
+		if (!obj) err = -1;
+	}
+
+	res->intermediate = run->inter; /* Owned by RES from here on */
+	res->intermediate_len = run->inter_len;
+	res->output = run->out;
+	res->output_len = run->out_len;
+	run->inter = run->out = NULL;
+	if (obj) {
+		res->obj = obj;
+		res->symbols = malloc((obj->symtbl->len + 1) * sizeof(AsmSymbol));
+		res->relocs = malloc((obj->reltbl->len + 1) * sizeof(AsmSymbol));
+		if (!res->symbols || !res->relocs) allocation_failed(log);
+		for (i = 0, cur = obj->symtbl->head; (cur = cur->next); i++) {
+			res->symbols[i].name = cur->name;
+			res->symbols[i].addr = cur->addr;
+		}
+		for (i = 0, cur = obj->reltbl->head; (cur = cur->next); i++) {
+			res->relocs[i].name = cur->name;
+			res->relocs[i].addr = cur->addr;
+		}
+		res->num_symbols = obj->symtbl->len;
+		res->num_relocs = obj->reltbl->len;
+		res->words = obj->text;
+		res->num_words = obj->text_len;
+		res->data = obj->data;
+		res->data_len = obj->data_len;
+	}
+	return err;
+}
+
+/* Assembles SRC like asm_assemble_buffer(), as read from the file IN_NAME:
+   .include paths are relative to its directory rather than the working
+   directory, unless it is NULL.
+ */
+AsmResult* asm_assemble_named(AsmCtx* ctx, const char* in_name, const char* src, size_t len) {
+	
+	LogCapture capture;
+	size_t diag_len = 0;
+	AsmRun* run = calloc(1, sizeof(AsmRun));
+	AsmResult* res = calloc(1, sizeof(AsmResult));
+	if (!run || !res) {
+		free(run);
+		free(res);
+		return NULL;
+	}
+	capture.stream = open_memstream(&res->diagnostics, &diag_len);
+	if (!capture.stream) {
+		free(run);
+		free(res);
+		return NULL;
+	}
+	capture.file_name = NULL; /* Same format as the log */
+	capture.num_cleanups = 0;
+	if (setjmp(capture.on_failure) == 0) {
+		if (!ctx->opts.includes) ctx->opts.includes = create_include_cache(&capture);
+		res->status = assemble_in_memory(&ctx->opts, in_name, src, len, res, run, &capture);
+	} else {
+		res->status = -1; /* Out of memory, RUN and RES hold what was allocated */
+	}
+	free_asm_run(run);
+	fclose(capture.stream);
+	res->diagnostics_len = diag_len;
+	return res;
+}
+
+/* Assembles the LEN bytes of SRC, the text of a .s file, with the options of
+   CTX, all in memory: nothing is written to the filesystem, nothing is
+   printed, and only the files named by .include, relative to the working
+   directory, are read. Returns NULL if out of memory before anything was
+   assembled, and otherwise a result to be freed with asm_result_free(). Its
+   STATUS is 0 on success and -1 on error. DIAGNOSTICS holds what the command
+   line would have logged, including why it failed, and INTERMEDIATE and
+   OUTPUT the files it would have written. Running out of memory
+   later fails the result rather than exiting the process.
+ */
+AsmResult* asm_assemble_buffer(AsmCtx* ctx, const char* src, size_t len) {
+	return asm_assemble_named(ctx, NULL, src, len);
+}
+
+void asm_result_free(AsmResult* res) {
+	if (!res) return;
+	if (res->obj) free_object(res->obj);
+	free(res->symbols);
+	free(res->relocs);
+	free(res->diagnostics);
+	free(res->intermediate);
+	free(res->output);
+	free(res);
+}
+
+/* Copies the rest of INPUT, which cannot seek, to a temporary file and
+   returns it rewound. INPUT is closed. Returns NULL on error.
+ */
+static FILE* copy_to_tmpfile(FILE* input) {
+	char buf[BUF_SIZE];
+	size_t len;
+	FILE* copy = tmpfile();
+	while (copy && (len = fread(buf, 1, sizeof(buf), input)) > 0) {
+		if (fwrite(buf, 1, len, copy) != len) {
+			fclose(copy);
+			copy = NULL;
+		}
+	}
+	fclose(input);
+	if (copy) rewind(copy);
+	return copy;
+}
+
+/* Opens the output file OBJ_NAME for reading. If it was written with -z,
+   it is unpacked to a temporary file first and that is returned instead.
+   A pipe is copied to a temporary file, as telling whether it is packed
+   reads its start. Returns NULL, after logging why, if it cannot be read.
+ */
+static FILE* open_object(const char* obj_name) {
+	FILE* plain;
+	FILE* file = fopen(obj_name, "rb");
+	if (file && fseek(file, 0, SEEK_CUR) != 0) file = copy_to_tmpfile(file);
+	if (!file) {
+		write_to_log("Error: unable to open input file: %s\n", obj_name);
+		return NULL;
+	}
+	if (!is_packed(file)) return file;
+	plain = tmpfile();
+	if (!plain || unpack_object(file, plain, NULL) != 0) {
+		write_to_log("Error: unable to unpack input file: %s\n", obj_name);
+		if (plain) fclose(plain);
+		plain = NULL;
+	} else {
+		rewind(plain);
+	}
+	fclose(file);
+	return plain;
+}
+
+/* Loads the output file OBJ_NAME and links it against its own symbols at
+   TEXT_BASE. Returns NULL on error.
+ */
+static Object* load_object(const char* obj_name, uint32_t text_base) {
+	FILE* file;
+	Object* obj;
+
+	file = open_object(obj_name);
+	if (!file) return NULL;
+	obj = read_object(file, NULL);
+	fclose(file);
+	if (obj && link_object(obj, text_base) != 0) {
+		free_object(obj);
+		return NULL;
+	}
+	return obj;
+}
+
+static void print_sim_stats(const SimStats* stats, Sim* sim, double secs) {
+	if (stats->status == SIM_FAULT) {
+		write_to_log("Error: simulation fault at 0x%08x\n", stats->pc);
+	} else if (stats->status == SIM_LIMIT) {
+		write_to_log("Error: instruction limit reached at 0x%08x\n", stats->pc);
+	}
+	printf("Instructions: %lu\n", (unsigned long)stats->insts);
+	printf("Cycles:       %lu (%lu load-use stalls, %lu taken branches and jumps)\n",
+		(unsigned long)stats->cycles, (unsigned long)stats->load_stalls,
+		(unsigned long)stats->taken);
+	printf("$v0:          0x%08x\n", sim->regs[2]);
+	if (secs > 0) {
+		printf("Speed:        %.1f million instructions per second\n", stats->insts / secs / 1e6);
+	}
+}
+
+/* Loads the output file OBJ_NAME, links it against its own symbols at the
+   text base of OPTS (or DEFAULT_TEXT_BASE) and runs it on the simulator from
+   its first instruction. Prints what happened and the instruction and cycle
+   counts. Returns 0 if the program exited normally and 1 otherwise.
+ */
+int simulate(const char* obj_name, const AsmOptions* opts) {
+	Object* obj;
+	Sim* sim;
+	SimStats stats;
+	clock_t start;
+	uint32_t text_base = opts->text_base == -1 ? DEFAULT_TEXT_BASE : (uint32_t)opts->text_base;
+
+	obj = load_object(obj_name, text_base);
+	if (!obj) return 1;
+	printf("Running simulator: %s (%u instructions at 0x%08x)\n", obj_name,
+		obj->text_len, text_base);
+	sim = create_sim(obj, text_base, SIM_MEM_SIZE);
+	if (!sim) {
+		free_object(obj);
+		return 1;
+	}
+	start = clock();
+	run_sim(sim, opts->max_insts, &stats);
+	print_sim_stats(&stats, sim, (double)(clock() - start) / CLOCKS_PER_SEC);
+	free_sim(sim);
+	free_object(obj);
+	return stats.status != SIM_EXIT;
+}
+
+/* Disassembles OBJ_NAME, an output file or raw machine code, to stdout; see
+   disassemble(). With -verify every word is also re-encoded and compared.
+   Returns 0 on success and 1 on error or if a word did not round-trip.
+ */
+int disassemble_file(const char* obj_name, const AsmOptions* opts) {
+	FILE* input;
+	DisasmStats stats;
+	int err;
+
+	input = open_object(obj_name);
+	if (!input) return 1;
+	err = disassemble(input, stdout, opts->text_base, opts->verify, &stats);
+	fclose(input);
+	if (err) return 1;
+	if (opts->verify) {
+		printf("Verified: %u of %u words re-encoded, %u differ, %u unknown\n",
+			stats.checked, stats.words, stats.mismatches, stats.unknown);
+	}
+	return stats.mismatches != 0;
+}
+
+/* Unpacks PACKED_NAME, an output file written with -z, to OUT_NAME. If
+   COUNT is not 0, only the COUNT words of .text from word FIRST on are
+   written, one per line, read through the index of the packed file. Prints
+   the sizes and how fast it went with -stats. Returns 0 on success and 1 on
+   error.
+ */
+int unpack(const char* packed_name, const char* out_name, int64_t first, uint32_t count,
+	const AsmOptions* opts) {
+
+	FILE *input, *output;
+	struct timespec start, end;
+	PackStats stats;
+	PackIndex* index;
+	uint32_t* words;
+	int64_t num, i;
+	int err = 0;
+	if (open_files(&input, &output, packed_name, out_name) != 0) return 1;
+	memset(&stats, 0, sizeof(stats));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (count) {
+		words = malloc(sizeof(uint32_t) * count);
+		if (!words) allocation_failed(NULL);
+		index = read_pack_index(input);
+		num = index ? read_packed_words(input, index, (uint64_t)first, count, words) : -1;
+		for (i = 0; i < num; i++) write_inst_hex(output, words[i]);
+		if (num < 0) err = 1;
+		free_pack_index(index);
+		free(words);
+	} else if (unpack_object(input, output, &stats) != 0) {
+		err = 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	close_files(input, output);
+	if (err) {
+		write_to_log("Error: corrupt packed file: %s\n", packed_name);
+	} else if (opts->stats && !count) {
+		double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+		printf("Stats: unpacked %lu bytes from %lu (%.1f%%) in %u blocks at %.1f MB/s\n",
+			(unsigned long)stats.plain_bytes, (unsigned long)stats.packed_bytes,
+			stats.plain_bytes ? 100.0 * stats.packed_bytes / stats.plain_bytes : 0.0,
+			stats.blocks, secs > 0 ? stats.plain_bytes / secs / 1e6 : 0.0);
+	}
+	return err;
+}
+
+/* Like simulate(), but counts how often each instruction runs and then
+   prints SRC_NAME, the source OBJ_NAME was assembled from with -g, annotated
+   with execution counts and branch-taken ratios per line. Returns 0 if the
+   program exited normally and 1 otherwise.
+ */
+int profile(const char* obj_name, const char* src_name, const AsmOptions* opts) {
+	FILE* source;
+	Object* obj;
+	Sim* sim;
+	SimStats stats;
+	uint32_t text_base = opts->text_base == -1 ? DEFAULT_TEXT_BASE : (uint32_t)opts->text_base;
+
+	obj = load_object(obj_name, text_base);
+	if (!obj) return 1;
+	if (!obj->lines->len) {
+		write_to_log("Error: no .line section in %s, assemble it with -g\n", obj_name);
+		free_object(obj);
+		return 1;
+	}
+	source = fopen(src_name, "r");
+	if (!source) {
+		write_to_log("Error: unable to open input file: %s\n", src_name);
+		free_object(obj);
+		return 1;
+	}
+	printf("Running profiler: %s (%u instructions at 0x%08x)\n", obj_name,
+		obj->text_len, text_base);
+	sim = create_sim(obj, text_base, SIM_MEM_SIZE);
+	if (!sim) {
+		fclose(source);
+		free_object(obj);
+		return 1;
+	}
+	enable_profile(sim);
+	run_sim(sim, opts->max_insts, &stats);
+	print_sim_stats(&stats, sim, 0);
+	printf("\n");
+	write_profile(stdout, source, obj, sim);
+	fclose(source);
+	if (opts->counts) {
+		FILE* counts = fopen(opts->counts, "w");
+		if (!counts) {
+			write_to_log("Error: unable to open output file: %s\n", opts->counts);
+			stats.status = SIM_FAULT;
+		} else {
+			write_counts(counts, obj, sim);
+			fclose(counts);
+		}
+	}
+	free_sim(sim);
+	free_object(obj);
+	return stats.status != SIM_EXIT;
+}
+
+/* Checks IN_NAME for errors without writing any file: pass one runs into
+   memory and pass two only validates the operands, formatting no machine
+   code. Diagnostics are printed to stdout, one "<file>:<line>: error: ..."
+   line each. Branches too far to encode are reported, even though a full
+   assembly would relax them. Returns 0 if there were no errors and 1
+   otherwise.
+ */
+int check(const char* in_name, const AsmOptions* opts) {
+	LogCapture capture;
+	AsmRun* run = calloc(1, sizeof(AsmRun));
+	int err = 0;
+
+	if (!run) allocation_failed(NULL);
+	capture.stream = stdout;
+	capture.file_name = in_name;
+	capture.num_cleanups = 0;
+	if (setjmp(capture.on_failure) != 0) {
+		free_asm_run(run); /* Out of memory, RUN holds what was allocated */
+		return 1;
+	}
+	run->input = fopen(in_name, "r");
+	if (!run->input) {
+		log_to(&capture, "Error: unable to open input file: %s\n", in_name);
+		free_asm_run(run);
+		return 1;
+	}
+	run->symtbl = create_table(SYMBOLTBL_UNIQUE_NAME, &capture);
+	run->reltbl = create_table(SYMBOLTBL_NON_UNIQUE, &capture);
+	run->lines = create_line_table(&capture);
+	run->data = create_data_section(&capture);
+	run->memo = create_memo(&capture);
+	run->output = open_memstream(&run->inter, &run->inter_len);
+	if (!run->output) allocation_failed(&capture);
+	if (pass_one(run->input, run->output, run->symtbl, 1, run->data, opts->includes,
+		in_name) != 0) err = 1;
+	close_stream(&run->input);
+	close_stream(&run->output);
+
+	run->input = fmemopen(run->inter, run->inter_len, "r");
+	if (!run->input) allocation_failed(&capture);
+	if (place_data(run->data, run->symtbl) != 0) err = 1;
+	if (pass_two(run->input, NULL, run->symtbl, run->reltbl, opts->text_base, run->lines,
+		run->memo) != 0) err = 1;
+	close_stream(&run->input);
+	if (run->data->len && resolve_data(run->data, run->symtbl, run->reltbl,
+		opts->text_base) != 0) err = 1;
+
+	free_asm_run(run);
+	return err;
+}
+
+/* Returns the file NAME in DIR as lexed by an earlier assembly with
+   INCLUDES, the input or a file it included, or NULL if it was not.
+ */
+static LexFile* find_lexed(IncludeCache* includes, const char* dir, const char* name) {
+	size_t len = strcmp(dir, ".") == 0 ? 0 : strlen(dir);
+	LexFile* file;
+	for (file = includes ? includes->files : NULL; file; file = file->next) {
+		if ((!len || (strncmp(file->path, dir, len) == 0 && file->path[len] == '/'))
+			&& strcmp(file->path + (len ? len + 1 : 0), name) == 0) return file;
+	}
+	return NULL;
+}
+
+/* Assembles IN_NAME like assemble(), then watches its directory with
+   inotify and assembles it again each time the file, or a file it includes
+   from that directory, is written or renamed into place, as editors save.
+   Prints how long each rebuild took from the change to the written output.
+   Runs until interrupted or the directory goes away, and returns the result
+   of the last rebuild.
+
+   Between rebuilds, the input and the files it includes stay lexed in the
+   include cache of OPTS, and only the files named by inotify are lexed
+   again. The words of position-independent instructions stay in an
+   encoding memo, so that the lines that did not change are not encoded
+   again. The symbol tables depend on every line and are built anew.
+ */
+int watch(const char* in_name, const char* tmp_name, const char* out_name,
+	const AsmOptions* opts) {
+	
+	union { /* Aligned for struct inotify_event */
+		struct inotify_event event;
+		char bytes[WATCH_BUF_SIZE];
+	} buf;
+	char dir[BUF_SIZE];
+	const char* base = strrchr(in_name, '/');
+	struct timespec start, end;
+	AsmOptions warm = *opts;
+	int fd, err;
+
+	if (base == in_name) { /* In the root directory */
+		strcpy(dir, "/");
+		base++;
+	} else if (base && (size_t)(base - in_name) < BUF_SIZE) {
+		memcpy(dir, in_name, base - in_name);
+		dir[base - in_name] = '\0';
+		base++;
+	} else {
+		strcpy(dir, ".");
+		base = in_name;
+	}
+	fd = inotify_init1(0);
+	if (fd == -1 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+		write_to_log("Error: unable to watch directory: %s\n", dir);
+		return 1;
+	}
+
+	warm.memo = create_memo(NULL);
+	err = assemble(in_name, tmp_name, out_name, &warm);
+	printf("Watching %s for changes\n", in_name);
+	fflush(stdout);
+	for (;;) {
+		char* p;
+		int changed = 0, gone = 0;
+		ssize_t len = read(fd, buf.bytes, sizeof(buf.bytes));
+		if (len <= 0) break;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (p = buf.bytes; p < buf.bytes + len; ) { /* Several saves may arrive at once */
+			const struct inotify_event* event = (const struct inotify_event*)p;
+			LexFile* file;
+			if (event->mask & IN_IGNORED) gone = 1;
+			else if (event->len) {
+				if (strcmp(event->name, base) == 0) changed = 1;
+				while ((file = find_lexed(warm.includes, dir, event->name))) {
+					forget_lexed_file(warm.includes, file); /* Lexed again on the rebuild */
+					changed = 1;
+				}
+			}
+			p += sizeof(struct inotify_event) + event->len;
+		}
+		if (changed) {
+			err = assemble(in_name, tmp_name, out_name, &warm);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			printf("Rebuilt %s in %.3f ms%s\n", out_name,
+				(end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6,
+				err ? " (with errors)" : "");
+			fflush(stdout);
+		}
+		if (gone) break;
+	}
+	close(fd);
+	free_memo(warm.memo);
+	return err;
+}
+
+/* Writes to PATH (BUF_SIZE bytes) the file in OUT_DIR named like IN_NAME
+   without its directory and .s, with EXT. Returns 0 on success and -1 if it
+   does not fit.
+ */
+static int batch_path(char* path, const char* out_dir, const char* in_name, const char* ext) {
+	const char* base = strrchr(in_name, '/');
+	size_t len;
+	base = base ? base + 1 : in_name;
+	len = strlen(base);
+	if (len > 2 && strcmp(base + len - 2, ".s") == 0) len -= 2;
+	if (strlen(out_dir) + len + strlen(ext) + 2 > BUF_SIZE) return -1;
+	sprintf(path, "%s/%.*s%s", out_dir, (int)len, base, ext);
+	return 0;
+}
+
+/* Reads the names of the files to assemble from LIST_NAME, one per line,
+   into a new array of BatchFiles. Returns their number, or -1 on error.
+ */
+static int64_t read_batch_list(const char* list_name, BatchFile** files) {
+	char buf[BUF_SIZE];
+	uint32_t num = 0, cap = 64;
+	FILE* list = fopen(list_name, "r");
+	if (!list) return -1;
+	*files = malloc(cap * sizeof(BatchFile));
+	if (!*files) allocation_failed(NULL);
+	while (fgets(buf, BUF_SIZE, list)) {
+		char* name = buf;
+		name[strcspn(name, "\r\n")] = '\0';
+		if (!name[0]) continue;
+		if (num == cap) {
+			cap *= 2;
+			*files = realloc(*files, cap * sizeof(BatchFile));
+			if (!*files) allocation_failed(NULL);
+		}
+		(*files)[num].name = malloc(strlen(name) + 1);
+		if (!(*files)[num].name) allocation_failed(NULL);
+		strcpy((char*)(*files)[num].name, name);
+		num++;
+	}
+	fclose(list);
+	return num;
+}
+
+/* Assembles FILE, already read, through the library path and queues its
+   .int and .out files in OUT_DIR to IO. Returns 0 on success and -1 on
+   error.
+ */
+static int batch_assemble(AsmCtx* ctx, BatchIO* io, BatchFile* file, const char* out_dir,
+	uint64_t* written) {
+	
+	char int_name[BUF_SIZE], out_name[BUF_SIZE];
+	AsmResult* res;
+	int err = 0;
+	if (file->err) {
+		write_to_log("Error: unable to read input file: %s\n", file->name);
+		return -1;
+	}
+	res = asm_assemble_named(ctx, file->name, file->buf, file->len);
+	if (!res) allocation_failed(NULL);
+	if (res->status != 0) {
+		write_to_log("Errors in %s:\n%s", file->name, res->diagnostics);
+		err = -1;
+	} else if (batch_path(int_name, out_dir, file->name, ".int") != 0
+		|| batch_path(out_name, out_dir, file->name, ".out") != 0) {
+		write_to_log("Error: output file name too long for %s\n", file->name);
+		err = -1;
+	} else { /* The buffers go to IO, which frees them once written */
+		batch_write(io, int_name, res->intermediate, res->intermediate_len);
+		batch_write(io, out_name, res->output, res->output_len);
+		*written += res->intermediate_len + res->output_len;
+		res->intermediate = res->output = NULL;
+		batch_submit(io);
+	}
+	asm_result_free(res);
 	return err;
 }
 
+/* Assembles every file listed in LIST_NAME into <name>.int and <name>.out
+   in OUT_DIR, and prints how long it took. With BACKEND "stdio", each file
+   goes through assemble() and stdio. Otherwise they are assembled in memory
+   and all the reads and writes go through a BatchIO, with io_uring unless
+   BACKEND is "rw": while one group of BATCH_QUEUE / 2 files is assembled,
+   the next is read and the outputs already produced are written. Returns 0
+   if every file assembled and 1 otherwise.
+ */
+int batch(const char* list_name, const char* out_dir, const char* backend,
+	const AsmOptions* opts) {
+	
+	struct timespec start, end;
+	BatchFile* files;
+	uint64_t bytes_read = 0, written = 0;
+	uint32_t i, failed = 0, unwritten = 0, group = BATCH_QUEUE / 2;
+	int64_t num;
+	const char* used = backend;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	num = read_batch_list(list_name, &files);
+	if (num == -1) {
+		write_to_log("Error: unable to open input file: %s\n", list_name);
+		return 1;
+	}
+	if (strcmp(backend, "stdio") == 0) {
+		for (i = 0; i < num; i++) {
+			char int_name[BUF_SIZE], out_name[BUF_SIZE];
+			if (batch_path(int_name, out_dir, files[i].name, ".int") != 0
+				|| batch_path(out_name, out_dir, files[i].name, ".out") != 0
+				|| assemble(files[i].name, int_name, out_name, opts) != 0) {
+				
+				write_to_log("Errors in %s\n", files[i].name);
+				failed++;
+			}
+		}
+	} else {
+		AsmCtx* ctx = asm_ctx_create(opts);
+		BatchIO* io = create_batch_io(strcmp(backend, "rw") != 0);
+		uint32_t next;
+		if (!ctx) allocation_failed(NULL);
+		used = batch_io_backend(io);
+		for (next = 0; next < num && next < group; next++) batch_read(io, files + next);
+		batch_submit(io);
+		for (i = 0; i < num; ) {
+			uint32_t end_group = next;
+			unwritten += batch_wait(io); /* This group read, the last one written */
+			for (; next < num && next < end_group + group; next++) batch_read(io, files + next);
+			batch_submit(io);
+			for (; i < end_group; i++) {
+				bytes_read += files[i].len;
+				if (batch_assemble(ctx, io, files + i, out_dir, &written) != 0) failed++;
+				free(files[i].buf);
+			}
+		}
+		unwritten += batch_wait(io);
+		free_batch_io(io);
+		if (unwritten) write_to_log("Error: %u output files could not be written\n", unwritten);
+		asm_ctx_free(ctx);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("Assembled %lu files (%lu failed) in %.3f ms with %s", (unsigned long)num,
+		(unsigned long)failed,
+		(end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6, used);
+	if (strcmp(backend, "stdio") != 0) {
+		printf(": %lu bytes read, %lu written", (unsigned long)bytes_read, (unsigned long)written);
+	}
+	printf("\n");
+	for (i = 0; i < num; i++) free((char*)files[i].name);
+	free(files);
+	return failed || unwritten ? 1 : 0;
+}
+
+#ifndef ASM_LIBRARY
+
 static void print_usage_and_exit() {
 	printf("Usage:\n");
 	printf("  Runs both passes: assembler <input file> <intermediate file> <output file>\n");
 	printf("  Run pass #1:      assembler -p1 <input file> <intermediate file>\n");
 	printf("  Run pass #2:      assembler -p2 <intermediate file> <output file>\n");
+	printf("  Run output file:  assembler -sim <output file> [-max <instructions>]\n");
+	printf("  Profile it:       assembler -prof <output file> <input file> [-max <instructions>]\n");
+	printf("                      [-counts <profile file>]\n");
+	printf("  Disassemble:      assembler -d <output or binary file> [-verify]\n");
+	printf("  Check for errors: assembler -check <input file>\n");
+	printf("  Assemble many:    assembler -batch <file listing inputs> <output directory>\n");
+	printf("                      [-io uring|rw|stdio]\n");
+	printf("  Unpack -z output: assembler -unpack <packed file> <output file>\n");
+	printf("                      [-words <first word> <count>]\n");
 	printf("Append -log <file name> after any option to save log files to a text file.\n");
+	printf("Append -base [address] to encode jumps to local labels directly, with .text\n");
+	printf("  loaded at the given address (default 0x%08x).\n", DEFAULT_TEXT_BASE);
+	printf("Append -stats to print assembly statistics.\n");
+	printf("Append -g to record source lines in a .line section, for -prof.\n");
+	printf("Append -O to run the peephole optimizer between the passes.\n");
+	printf("Append -dce to remove code unreachable from the entry (-entry <label>, default\n");
+	printf("  the first instruction), from .globl labels and from labels used by la.\n");
+	printf("Append -layout <profile file> to reorder basic blocks so that the branches\n");
+	printf("  and jumps taken most often in a -prof -counts run fall through instead.\n");
+	printf("Append -mem <bytes> to keep memory use about that large whatever the input\n");
+	printf("  size, moving symbols and relocations to disk. It cannot be combined with\n");
+	printf("  -O, -dce, -layout, -sched, -g, -sym or -crel, and branches out of range are\n");
+	printf("  reported instead of relaxed.\n");
+	printf("Append -crel to write a .relgroup section instead of .relocation: the sites\n");
+	printf("  of each symbol listed once under its name, delta-encoded.\n");
+	printf("Append -z to write the output file compressed, for -sim, -prof, -d and -unpack.\n");
+	printf("Append -watch to assemble again whenever the input file is saved.\n");
+	printf("Append -sym <interface file> to save the labels and .data pass one finds,\n");
+	printf("  to give them to -p2 and to skip pass one while the source, the options and\n");
+	printf("  the intermediate file are unchanged.\n");
+	printf("Append -sched to move independent instructions between loads and their users.\n");
 	exit(0);
 }
 
 int main(int argc, char **argv) {
 	int mode;
 	char *input, *inter, *output;
-	int err;
+	char *log_name = NULL;
+	char *pos[3]; /* Positional arguments */
+	int num_pos = 0;
+	int i, err;
+	int watching = 0;
+	const char* io = "uring"; /* For -batch */
+	long int first = 0, count = 0; /* For -unpack -words */
+	long int base;
+	AsmOptions opts;
 
-	if (argc != 4 && argc != 6) {
+	asm_init_options(&opts);
+	mode = 0;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-p1") == 0 && i == 1) {
+			mode = 1;
+		} else if (strcmp(argv[i], "-p2") == 0 && i == 1) {
+			mode = 2;
+		} else if (strcmp(argv[i], "-sim") == 0 && i == 1) {
+			mode = 3;
+		} else if (strcmp(argv[i], "-prof") == 0 && i == 1) {
+			mode = 4;
+		} else if (strcmp(argv[i], "-d") == 0 && i == 1) {
+			mode = 5;
+		} else if (strcmp(argv[i], "-check") == 0 && i == 1) {
+			mode = 6;
+		} else if (strcmp(argv[i], "-batch") == 0 && i == 1) {
+			mode = 7;
+		} else if (strcmp(argv[i], "-unpack") == 0 && i == 1) {
+			mode = 8;
+		} else if (strcmp(argv[i], "-words") == 0 && mode == 8) {
+			if (i + 2 >= argc || translate_num(&first, argv[i + 1], 0x7fffffffffffffff, 0) != 0
+				|| translate_num(&count, argv[i + 2], 0xffffffff, 1) != 0) {
+				print_usage_and_exit();
+			}
+			i += 2;
+		} else if (strcmp(argv[i], "-io") == 0 && mode == 7) {
+			if (++i >= argc || (strcmp(argv[i], "uring") != 0 && strcmp(argv[i], "rw") != 0
+				&& strcmp(argv[i], "stdio") != 0)) print_usage_and_exit();
+			io = argv[i];
+		} else if (strcmp(argv[i], "-verify") == 0) {
+			opts.verify = 1;
+		} else if (strcmp(argv[i], "-g") == 0) {
+			opts.line_info = 1;
+		} else if (strcmp(argv[i], "-max") == 0) {
+			if (++i >= argc || translate_num(&base, argv[i], 0x7fffffffffffffff, 1) != 0) {
+				print_usage_and_exit();
+			}
+			opts.max_insts = (uint64_t)base;
+		} else if (strcmp(argv[i], "-log") == 0) {
+			if (++i >= argc) print_usage_and_exit();
+			log_name = argv[i];
+		} else if (strcmp(argv[i], "-base") == 0) {
+			opts.text_base = DEFAULT_TEXT_BASE;
+			if (i + 1 < argc && translate_num(&base, argv[i + 1], 0xffffffff, 0) == 0) {
+				if (base % 4) print_usage_and_exit();
+				opts.text_base = base;
+				i++;
+			}
+		} else if (strcmp(argv[i], "-stats") == 0) {
+			opts.stats = 1;
+		} else if (strcmp(argv[i], "-O") == 0) {
+			opts.optimize = 1;
+		} else if (strcmp(argv[i], "-sched") == 0) {
+			opts.schedule = 1;
+		} else if (strcmp(argv[i], "-dce") == 0) {
+			opts.dce = 1;
+		} else if (strcmp(argv[i], "-entry") == 0) {
+			if (++i >= argc) print_usage_and_exit();
+			opts.entry = argv[i];
+		} else if (strcmp(argv[i], "-counts") == 0) {
+			if (++i >= argc) print_usage_and_exit();
+			opts.counts = argv[i];
+		} else if (strcmp(argv[i], "-mem") == 0) {
+			if (++i >= argc || translate_num(&base, argv[i], 0x7fffffffffffffff, 1) != 0) {
+				print_usage_and_exit();
+			}
+			opts.mem_budget = (size_t)base;
+		} else if (strcmp(argv[i], "-crel") == 0) {
+			opts.compact_relocs = 1;
+		} else if (strcmp(argv[i], "-z") == 0) {
+			opts.packed = 1;
+		} else if (strcmp(argv[i], "-watch") == 0) {
+			watching = 1;
+		} else if (strcmp(argv[i], "-sym") == 0) {
+			if (++i >= argc) print_usage_and_exit();
+			opts.iface = argv[i];
+		} else if (strcmp(argv[i], "-layout") == 0) {
+			if (++i >= argc) print_usage_and_exit();
+			opts.layout = argv[i];
+		} else if (argv[i][0] == '-' || num_pos == 3) {
+			print_usage_and_exit();
+		} else {
+			pos[num_pos++] = argv[i];
+		}
+	}
+
+	if (num_pos != (mode == 0 ? 3 : mode == 3 || mode == 5 || mode == 6 ? 1 : 2)) {
 		print_usage_and_exit();
 	}
 
-	mode = 0;
-	if (strcmp(argv[1], "-p1") == 0) {
-		mode = 1;
-	} else if (strcmp(argv[1], "-p2") == 0) {
-		mode = 2;
+	if (watching && mode != 0) {
+		print_usage_and_exit();
+	}
+	if (opts.mem_budget && (opts.optimize || opts.dce || opts.layout || opts.schedule
+		|| opts.line_info || opts.iface || opts.compact_relocs)) { /* These need the whole program */
+		print_usage_and_exit();
+	}
+
+	if (mode >= 3) {
+		if (log_name) {
+			set_log_file(log_name);
+		}
+		if (mode == 5) return disassemble_file(pos[0], &opts);
+		if (mode == 6) return check(pos[0], &opts);
+		if (mode == 8) return unpack(pos[0], pos[1], first, (uint32_t)count, &opts);
+		if (mode == 7) {
+			if (opts.layout || opts.counts || opts.iface || opts.mem_budget || opts.packed) {
+				print_usage_and_exit();
+			}
+			opts.quiet = 1;
+			return batch(pos[0], pos[1], io, &opts);
+		}
+		return mode == 3 ? simulate(pos[0], &opts) : profile(pos[0], pos[1], &opts);
 	}
 
 	if (mode == 1) {
-		input = argv[2];
-		inter = argv[3];
+		input = pos[0];
+		inter = pos[1];
 		output = NULL;
 	} else if (mode == 2) {
 		input = NULL;
-		inter = argv[2];
-		output = argv[3];
+		inter = pos[0];
+		output = pos[1];
 	} else {
-		input = argv[1];
-		inter = argv[2];
-		output = argv[3];
+		input = pos[0];
+		inter = pos[1];
+		output = pos[2];
 	}
 
-	if (argc == 6) {
-		if (strcmp(argv[4], "-log") == 0) {
-			set_log_file(argv[5]);
-		} else {
-			print_usage_and_exit();
-		}
+	if (log_name) {
+		set_log_file(log_name);
 	}
 
-	err = assemble(input, inter, output);
+	if (watching) {
+		opts.includes = create_include_cache(NULL); /* Kept between rebuilds */
+		return watch(input, inter, output, &opts);
+	}
+
+	err = assemble(input, inter, output, &opts);
 	if (err) {
 		write_to_log("One or more errors encountered during assembly operation.\n");
 	} else {
@@ -346,8 +2091,10 @@ int main(int argc, char **argv) {
 	}
 
 	if (is_log_file_set()) {
-		printf("Results saved to %s\n", argv[5]);
+		printf("Results saved to %s\n", log_name);
 	}
 
 	return err;
 }
+
+#endif /* ASM_LIBRARY */
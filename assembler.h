@@ -1,17 +1,114 @@
-#ifndef ASSEMBLER_H
-#define ASSEMBLER_H
-
-#define MAX_ARGS 3
-#define BUF_SIZE 1024
-
-/*******************************
- * Do Not Modify Code Below
- *******************************/
-
-int assemble(const char* in_name, const char* tmp_name, const char* out_name);
-
-int pass_one(FILE *input, FILE* output, SymbolTable* symtbl);
-
-int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl);
-
-#endif
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#define MAX_ARGS 3
+#define BUF_SIZE 1024
+#define WATCH_BUF_SIZE 4096    /* bytes of inotify events read at once */
+
+#define DEFAULT_TEXT_BASE 0x00400000
+
+/* Settings for one assembly run, filled in from the command line. */
+typedef struct AsmOptions {
+	int64_t text_base; /* Load address of .text, or -1 to relocate every jump */
+	int stats;         /* Print an AsmStats summary after assembly */
+	int optimize;      /* Run the peephole optimizer between the passes */
+	int dce;           /* Remove code unreachable from the entry and exports */
+	const char* entry; /* Entry label for dce, NULL for the first instruction */
+	uint64_t max_insts; /* Instruction limit for -sim, 0 for none */
+	int line_info;     /* Record source lines and write a .line section */
+	const char* counts; /* File -prof writes the branch profile to, or NULL */
+	const char* layout; /* Branch profile to lay out basic blocks by, or NULL */
+	int schedule;      /* Fill load-use stalls by scheduling within blocks */
+	int verify;        /* Re-encode every word -d decodes and compare */
+	int quiet;         /* Do not print progress lines */
+	const char* iface; /* Symbol interface file to write or load, or NULL */
+	size_t mem_budget; /* Bytes of symbols and relocations kept in memory, 0 for all */
+	int compact_relocs; /* Write relocations grouped by symbol, as .relgroup */
+	int packed;        /* Write the output file compressed, see pack.c */
+	IncludeCache* includes; /* Lexed .include files to reuse, or NULL */
+	EncodingMemo* memo; /* Encodings to reuse between assemblies, or NULL */
+} AsmOptions;
+
+/* Counters collected while assembling, printed with -stats. */
+typedef struct AsmStats {
+	uint32_t num_insts; /* Instructions in .text after layout */
+	uint32_t relaxed;   /* Out-of-range branches rewritten by relax_branches() */
+	uint64_t memo_lookups; /* Position-independent instructions encoded */
+	uint64_t memo_hits; /* ...of which came from the encoding memo */
+	uint64_t plain_bytes; /* Output file size without -z... */
+	uint64_t packed_bytes; /* ...and with it */
+	double pack_secs;  /* Time pack_object() took */
+} AsmStats;
+
+/* A symbol or relocation of an AsmResult. */
+typedef struct AsmSymbol {
+	const char* name;
+	uint32_t addr;     /* byte offset from the start of .text */
+} AsmSymbol;
+
+/* What asm_assemble_buffer() produced, see assembler.c. */
+typedef struct AsmResult {
+	int status;        /* 0 on success, -1 on error */
+	uint32_t* words;   /* .text */
+	uint32_t num_words;
+	uint8_t* data;     /* .data, loaded at the next 64 KB after .text */
+	uint32_t data_len;
+	AsmSymbol* symbols;
+	uint32_t num_symbols;
+	AsmSymbol* relocs;
+	uint32_t num_relocs;
+	char* diagnostics; /* NUL-terminated log messages */
+	size_t diagnostics_len;
+	char* intermediate; /* The .int and .out files, as far as they got */
+	size_t intermediate_len;
+	char* output;
+	size_t output_len;
+	struct Object* obj; /* owns WORDS, DATA and the names */
+} AsmResult;
+
+typedef struct AsmCtx AsmCtx;
+
+void asm_init_options(AsmOptions* opts);
+
+AsmCtx* asm_ctx_create(const AsmOptions* opts);
+
+void asm_ctx_free(AsmCtx* ctx);
+
+AsmResult* asm_assemble_buffer(AsmCtx* ctx, const char* src, size_t len);
+
+AsmResult* asm_assemble_named(AsmCtx* ctx, const char* in_name, const char* src, size_t len);
+
+void asm_result_free(AsmResult* res);
+
+/*******************************
+ * Do Not Modify Code Below
+ *******************************/
+
+int assemble(const char* in_name, const char* tmp_name, const char* out_name,
+	const AsmOptions* opts);
+
+int simulate(const char* obj_name, const AsmOptions* opts);
+
+int disassemble_file(const char* obj_name, const AsmOptions* opts);
+
+int profile(const char* obj_name, const char* src_name, const AsmOptions* opts);
+
+int check(const char* in_name, const AsmOptions* opts);
+
+int batch(const char* list_name, const char* out_dir, const char* backend,
+	const AsmOptions* opts);
+
+int unpack(const char* packed_name, const char* out_name, int64_t first, uint32_t count,
+	const AsmOptions* opts);
+
+int watch(const char* in_name, const char* tmp_name, const char* out_name,
+	const AsmOptions* opts);
+
+int pass_one(FILE *input, FILE* output, SymbolTable* symtbl, int line_info,
+	DataSection* data, IncludeCache* includes, const char* in_name);
+
+int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl,
+	int64_t text_base, LineTable* lines,
+	EncodingMemo* memo);
+
+#endif
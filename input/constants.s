@@ -0,0 +1,9 @@
+# Shortest constant loads and la
+table:	li $t0, -5				# addiu
+		li $t1, 0x8000			# ori
+		li $t2, 0xFFFF			# ori
+		li $t3, 0x12340000		# lui
+		li $t4, -65536			# lui
+		li $t5, 0x12345678		# lui + ori
+		la $a0, table			# Local label
+		la $a1, buffer			# External label
@@ -0,0 +1,34 @@
+# Sums a table from .data and dispatches through a jump table, for .data
+		.data
+squares:	.word 0, 1, 4, 9, 16, 25, 36, 49
+bytes:	.byte 1, 2, 3, -1
+message:	.asciiz "a, \"quoted\" # string\n"
+		.half 7
+zeros:	.word 0:4
+		.align 3
+table:
+		.word case_a, case_b
+		.space 5
+end:	.byte 0xff
+
+		.text
+main:	la $t0, squares
+		addiu $t1, $0, 8
+		addiu $v0, $0, 0
+loop:	lw $t2, 0($t0)
+		addu $v0, $v0, $t2
+		addiu $t0, $t0, 4
+		addiu $t1, $t1, -1
+		bne $t1, $0, loop
+		la $t0, bytes
+		lb $t2, 3($t0)
+		addu $v0, $v0, $t2
+		la $t0, table
+		lw $t3, 4($t0)
+		jr $t3
+case_a:	addiu $v0, $v0, 1000
+		jr $ra
+case_b:	la $t0, message
+		lbu $t2, 3($t0)
+		addu $v0, $v0, $t2
+		jr $ra
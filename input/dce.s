@@ -0,0 +1,14 @@
+# Unreachable helpers for dead code elimination
+		.globl api			# Exported, kept
+main:	jal used
+		la $a0, callback	# Address taken, kept
+		jr $ra
+unused:	addiu $v0, $0, 1	# Never called
+		jal unused2
+		jr $ra
+used:	beq $a0, $0, skip
+		addiu $v0, $0, 2
+skip:	jr $ra
+unused2:	jr $ra
+api:	j used
+callback:	jr $ra
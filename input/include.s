@@ -0,0 +1,10 @@
+# Sums two tables through macros and data from included files, for the simulator
+		.include "include/macros.s"
+		.include "include/data.s"
+
+main:	addiu $v0, $0, 0
+		add_words first, 2, $v0, first_loop
+		add_words second, 2, $v0, second_loop
+		.include "include/pad.s"
+		.include "include/pad.s"	# Lexed once
+		jr $ra
@@ -0,0 +1,5 @@
+# Data for include.s, which includes the macros it uses first
+		.data
+		table first, 1, 2
+		.include "more.s"	# Next to this file
+		.text
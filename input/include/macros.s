@@ -0,0 +1,14 @@
+# Macros for include.s
+		.macro add_words base, count, sum, loop	# Adds COUNT words at BASE to SUM
+		la $t0, \base
+		addiu $t1, $0, \count
+\loop:	lw $t2, 0($t0)
+		addu \sum, \sum, $t2
+		addiu $t0, $t0, 4
+		addiu $t1, $t1, -1
+		bne $t1, $0, \loop
+		.endm
+
+		.macro table name, first, second
+\name:	.word \first, \second
+		.endm
@@ -0,0 +1 @@
+		table second, 30, 40
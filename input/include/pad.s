@@ -0,0 +1 @@
+		addiu $v0, $v0, 1
@@ -0,0 +1,12 @@
+# Errors in included files and macros
+		.include "include/errors.s"
+		.include "include/missing.s"
+		.macro twice reg
+		addu \reg, \reg, \reg
+		addu \reg, \reg, \reg, \reg
+		.endm
+		twice $t0
+		twice $t0, $t1
+		.endm
+		.macro 3bad
+		addu $t0, $t0, $t0
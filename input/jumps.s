@@ -0,0 +1,7 @@
+# Jumps resolved against a text base
+main:	jal helper			# Local, encoded directly
+		j done				# Local, forward
+		jal printf			# External, relocated
+helper:	addiu $v0, $0, 1
+		jr $ra
+done:	j main
@@ -0,0 +1,12 @@
+# A loop with a rarely taken path in the middle, for -layout
+main:	addiu $t0, $0, 1000
+		addiu $t2, $0, 0
+loop:	sll $t1, $t0, 28
+		bne $t1, $0, common
+		addiu $t2, $t2, 100
+		j next
+common:	addiu $t2, $t2, 1
+next:	addiu $t0, $t0, -1
+		bne $t0, $0, loop
+		addu $v0, $t2, $0
+		jr $ra
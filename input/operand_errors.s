@@ -0,0 +1,4 @@
+# Branch targets only the assembler may write
+
+		bne $t0, $t1, %rel:1				# Offset marked by relax_branches()
+		beq $t0, $t1, 5					# Offset instead of a label
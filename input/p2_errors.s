@@ -3,5 +3,7 @@ label:	jal								# no label
 		ori $t2, $99, 0xAB				# invalid register
 		bne $t0, $t1, not_found			# nonexistant label
 		addiu $t3 $t2 0x80808080		# number too large
+		lui $t1, label					# label outside la
+		ori $t1, $t1, label				# label outside la
 
 # Can you think of any others?
\ No newline at end of file
@@ -0,0 +1,10 @@
+# Redundant code for the peephole optimizer
+main:	move $t0, $t0			# No-op
+		addiu $t1, $t1, 0		# No-op
+		li $t2, 0x12345678		# Overwritten by the next li
+		li $t2, 7
+		bge $a0, $a1, done		# Computes slt $at
+		bge $a0, $a1, main		# Same slt $at, reused
+again:	bge $a0, $a1, done		# Label, recomputed
+		addu $0, $t0, $t1		# Writes $0
+done:	jr $ra
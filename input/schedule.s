@@ -0,0 +1,17 @@
+# Loads whose results are used right away, for -sched
+main:	li $t0, 0x10000
+		li $t1, 0x12345678
+		addiu $t2, $0, 0
+		addiu $t3, $0, 0
+		addiu $t6, $0, 50
+loop:	sw $t1, 0($t0)
+		lw $t4, 0($t0)
+		addu $t3, $t3, $t4
+		lbu $t5, 1($t0)
+		addu $t3, $t3, $t5
+		addiu $t0, $t0, 4
+		addiu $t2, $t2, 1
+		bge $t2, $t6, done
+		j loop
+done:	addu $v0, $t3, $0
+		jr $ra
@@ -0,0 +1,33 @@
+# Fills an array with squares and sums it, for the simulator
+main:	move $s7, $ra
+		li $s0, 0x10000			# Array base
+		li $s1, 100				# Length
+		jal fill
+		jal sum
+		jr $s7
+
+fill:	addiu $t0, $0, 0		# i
+		move $t1, $s0
+fill_loop:	beq $t0, $s1, fill_done
+		addiu $t2, $0, 0		# i * i by repeated addition
+		addiu $t3, $0, 0
+square:	beq $t3, $t0, store
+		addu $t2, $t2, $t0
+		addiu $t3, $t3, 1
+		j square
+store:	sw $t2, 0($t1)
+		addiu $t1, $t1, 4
+		addiu $t0, $t0, 1
+		j fill_loop
+fill_done:	jr $ra
+
+sum:	addiu $v0, $0, 0
+		move $t1, $s0
+		addiu $t0, $0, 0
+sum_loop:	bge $t0, $s1, sum_done
+		lw $t2, 0($t1)
+		addu $v0, $v0, $t2
+		addiu $t1, $t1, 4
+		addiu $t0, $t0, 1
+		j sum_loop
+sum_done:	jr $ra
@@ -0,0 +1,510 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime() and open_memstream() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "src/tables.h"
+#include "src/data.h"
+#include "src/memo.h"
+#include "src/preproc.h"
+#include "assembler.h"
+
+#define MAX_CASES 256
+#define MAX_MISMATCHES 5    /* lines reported per file */
+#define PERF_RUNS 5         /* best of, per synthetic input... */
+#define PERF_MIN_MS 500.0   /* ...running for at least this long */
+#define PERF_ATTEMPTS 3     /* measurements before a slow input fails */
+#define DEFAULT_THRESHOLD 10.0 /* percent slower than the baseline that fails */
+#define DEFAULT_BASELINE "perf-baseline"
+
+/* A golden test: INPUT assembled with the options of FLAGS, compared with
+   out/ref/<name>.int and .out, or if LOG is set, its log with
+   log/ref/<name>.txt. A case without FLAGS needs options the library does
+   not take and is skipped.
+ */
+typedef struct Case {
+	const char* name;
+	const char* input;
+	const char* flags;
+	int log;
+} Case;
+
+/* The cases whose options or references differ from the default: assembled
+   without options and compared with out/ref. test.sh runs the same.
+ */
+static const Case SPECIAL_CASES[] = {
+	{"jumps", "input/jumps.s", "-base", 0},
+	{"peephole", "input/peephole.s", "-O", 0},
+	{"dce", "input/dce.s", "-dce -entry main", 0},
+	{"schedule", "input/schedule.s", "-sched", 0},
+	{"data", "input/data.s", "-dce", 0},
+	{"sim_g", "input/sim.s", "-g", 0},
+	{"layout_g", "input/layout.s", "-g", 0},
+	{"combined_crel", "input/combined.s", "-crel", 0},
+	{"p1_errors", "input/p1_errors.s", "", 1},
+	{"p2_errors", "input/p2_errors.s", "", 1},
+	{"layout", "input/layout.s", NULL, 0},   /* -layout, which needs a profile file */
+	{NULL, NULL, NULL, 0}
+};
+
+/* What running a case found, printed once all have run. */
+typedef struct Outcome {
+	Case test;
+	char name_buf[64];
+	char input_buf[256];
+	int failed;
+	int skipped;
+	char* report;
+	size_t report_len;
+} Outcome;
+
+typedef struct Runner {
+	Outcome* outcomes;
+	uint32_t num;
+	uint32_t next;
+	pthread_mutex_t lock;
+} Runner;
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+static double now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Returns the contents of NAME, NUL-terminated, with its length in LEN, or
+   NULL if it cannot be read.
+ */
+static char* read_file(const char* name, size_t* len) {
+	FILE* f = fopen(name, "rb");
+	char* buf;
+	long size;
+	if (!f) return NULL;
+	if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0) {
+		fclose(f);
+		return NULL;
+	}
+	buf = malloc(size + 1);
+	if (!buf || fread(buf, 1, size, f) != (size_t)size) {
+		free(buf);
+		fclose(f);
+		return NULL;
+	}
+	buf[size] = '\0';
+	*len = size;
+	fclose(f);
+	return buf;
+}
+
+/* Sets the options of OPTS from FLAGS, as the command line would. */
+static void set_flags(AsmOptions* opts, const char* flags) {
+	asm_init_options(opts);
+	if (strstr(flags, "-base")) opts->text_base = DEFAULT_TEXT_BASE;
+	if (strstr(flags, "-O")) opts->optimize = 1;
+	if (strstr(flags, "-dce")) opts->dce = 1;
+	if (strstr(flags, "-entry main")) opts->entry = "main";
+	if (strstr(flags, "-sched")) opts->schedule = 1;
+	if (strstr(flags, "-g")) opts->line_info = 1;
+	if (strstr(flags, "-crel")) opts->compact_relocs = 1;
+}
+
+static const char* next_line(const char* p, const char* end, size_t* len) {
+	const char* nl = memchr(p, '\n', end - p);
+	*len = nl ? (size_t)(nl - p) : (size_t)(end - p);
+	return nl ? nl + 1 : end;
+}
+
+/* Compares ACTUAL with EXPECTED, the contents of REF_NAME, line by line and
+   reports the first MAX_MISMATCHES differing lines to REPORT. Returns the
+   number of differing lines.
+ */
+static uint32_t compare_lines(FILE* report, const char* ref_name, const char* expected,
+	size_t expected_len, const char* actual, size_t actual_len) {
+	
+	const char *e = expected, *a = actual;
+	const char *e_end = expected + expected_len, *a_end = actual + actual_len;
+	uint32_t line = 0, mismatches = 0;
+	while (e < e_end || a < a_end) {
+		const char *e_line = e, *a_line = a;
+		size_t e_len = 0, a_len = 0;
+		line++;
+		if (e < e_end) e = next_line(e, e_end, &e_len);
+		if (a < a_end) a = next_line(a, a_end, &a_len);
+		if (e_line != e_end && a_line != a_end && e_len == a_len
+			&& memcmp(e_line, a_line, e_len) == 0) continue;
+		if (++mismatches > MAX_MISMATCHES) continue;
+		fprintf(report, "    %s:%u: expected ", ref_name, line);
+		if (e_line == e_end) fprintf(report, "end of file");
+		else fprintf(report, "\"%.*s\"", (int)e_len, e_line);
+		if (a_line == a_end) fprintf(report, ", got end of file\n");
+		else fprintf(report, ", got \"%.*s\"\n", (int)a_len, a_line);
+	}
+	if (mismatches > MAX_MISMATCHES) {
+		fprintf(report, "    %s: %u more lines differ\n", ref_name, mismatches - MAX_MISMATCHES);
+	}
+	return mismatches;
+}
+
+/* Compares ACTUAL with the reference file REF_NAME. Returns 0 if they
+   match.
+ */
+static int compare_with(FILE* report, const char* ref_name, const char* actual,
+	size_t actual_len) {
+	
+	size_t len;
+	char* expected = read_file(ref_name, &len);
+	uint32_t mismatches;
+	if (!expected) {
+		fprintf(report, "    %s: cannot be read\n", ref_name);
+		return -1;
+	}
+	mismatches = compare_lines(report, ref_name, expected, len, actual ? actual : "",
+		actual ? actual_len : 0);
+	free(expected);
+	return mismatches ? -1 : 0;
+}
+
+/* Assembles the input of OUT through the library and compares the results
+   with the references.
+ */
+static void run_case(Outcome* out) {
+	char ref_name[512];
+	FILE* report = open_memstream(&out->report, &out->report_len);
+	AsmOptions opts;
+	AsmCtx* ctx;
+	AsmResult* res;
+	char* src;
+	size_t len;
+	if (!report) allocation_failed(NULL);
+	set_flags(&opts, out->test.flags);
+	src = read_file(out->test.input, &len);
+	ctx = asm_ctx_create(&opts);
+	if (!src || !ctx || !(res = asm_assemble_named(ctx, out->test.input, src, len))) {
+		fprintf(report, "    %s: cannot be read or assembled\n", out->test.input);
+		out->failed = 1;
+	} else {
+		if (out->test.log) { /* As the command line logs it */
+			char* text = NULL;
+			size_t text_len = 0;
+			FILE* log = open_memstream(&text, &text_len);
+			if (!log) allocation_failed(NULL);
+			fprintf(log, "%s%s", res->diagnostics, res->status
+				? "One or more errors encountered during assembly operation.\n"
+				: "Assembly operation completed successfully!\n");
+			fclose(log);
+			sprintf(ref_name, "log/ref/%s.txt", out->test.name);
+			out->failed = compare_with(report, ref_name, text, text_len) != 0;
+			free(text);
+		} else if (res->status != 0) {
+			const char* end = res->diagnostics + res->diagnostics_len;
+			const char* line = res->diagnostics;
+			while (line < end) {
+				size_t line_len;
+				const char* next = next_line(line, end, &line_len);
+				fprintf(report, "    %.*s\n", (int)line_len, line);
+				line = next;
+			}
+			out->failed = 1;
+		} else {
+			sprintf(ref_name, "out/ref/%s.int", out->test.name);
+			out->failed |= compare_with(report, ref_name, res->intermediate,
+				res->intermediate_len) != 0;
+			sprintf(ref_name, "out/ref/%s.out", out->test.name);
+			out->failed |= compare_with(report, ref_name, res->output, res->output_len) != 0;
+		}
+		asm_result_free(res);
+	}
+	free(src);
+	if (ctx) asm_ctx_free(ctx);
+	fclose(report);
+}
+
+static void* run_cases(void* arg) {
+	Runner* runner = arg;
+	for (;;) {
+		uint32_t i;
+		pthread_mutex_lock(&runner->lock);
+		i = runner->next++;
+		pthread_mutex_unlock(&runner->lock);
+		if (i >= runner->num) return NULL;
+		if (!runner->outcomes[i].skipped) run_case(runner->outcomes + i);
+	}
+}
+
+/* The name of OUT, which may be in its own NAME_BUF while it is sorted. */
+static const char* case_name(const Outcome* out) {
+	return out->name_buf[0] ? out->name_buf : out->test.name;
+}
+
+static int compare_names(const void* a, const void* b) {
+	return strcmp(case_name(a), case_name(b));
+}
+
+/* Fills OUTCOMES with the special cases and a default case for every other
+   input/<name>.s with an out/ref/<name>.int. An input without either is
+   skipped. Returns their number.
+ */
+static uint32_t find_cases(Outcome* outcomes) {
+	uint32_t num = 0, i;
+	const Case* c;
+	struct dirent* entry;
+	DIR* dir = opendir("input");
+	for (c = SPECIAL_CASES; c->name; c++) {
+		memset(outcomes + num, 0, sizeof(Outcome));
+		outcomes[num].skipped = !c->flags;
+		outcomes[num++].test = *c;
+	}
+	while (dir && (entry = readdir(dir)) && num < MAX_CASES) {
+		Outcome* out = outcomes + num;
+		size_t len = strlen(entry->d_name);
+		char ref_name[512];
+		int special = 0;
+		if (len < 3 || len >= sizeof(out->name_buf) + 2 || strcmp(entry->d_name + len - 2, ".s") != 0) {
+			continue;
+		}
+		memset(out, 0, sizeof(Outcome));
+		memcpy(out->name_buf, entry->d_name, len - 2);
+		memcpy(out->input_buf, "input/", 6);
+		memcpy(out->input_buf + 6, entry->d_name, len + 1);
+		for (i = 0; i < num; i++) {
+			if (strcmp(outcomes[i].test.name, out->name_buf) == 0) special = 1;
+		}
+		if (special) continue;
+		sprintf(ref_name, "out/ref/%s.int", out->name_buf);
+		out->test.name = out->name_buf;
+		out->test.input = out->input_buf;
+		out->test.flags = "";
+		out->skipped = access(ref_name, R_OK) != 0;
+		for (i = 0; out->skipped && SPECIAL_CASES[i].name; i++) { /* Covered under another name */
+			if (strcmp(SPECIAL_CASES[i].input, out->input_buf) == 0) special = 1;
+		}
+		if (!special) num++;
+	}
+	if (dir) closedir(dir);
+	qsort(outcomes, num, sizeof(Outcome), compare_names);
+	for (i = 0; i < num; i++) {
+		if (!outcomes[i].name_buf[0]) continue;
+		outcomes[i].test.name = outcomes[i].name_buf;
+		outcomes[i].test.input = outcomes[i].input_buf;
+	}
+	return num;
+}
+
+/*******************************
+ * Performance Gate
+ *******************************/
+
+/* The synthetic inputs, generated by make_synthetic(). */
+static const char* SYNTHETIC[] = {"calls", "straight", NULL};
+
+/* Returns a new buffer with about N instructions of the synthetic input
+   NAME: "calls" is functions that branch and call each other, with a label
+   and relocations every few instructions, and "straight" arithmetic and
+   loads without labels, mostly from the encoding memo.
+ */
+static char* make_synthetic(const char* name, uint32_t n, size_t* len) {
+	char* buf = NULL;
+	FILE* f = open_memstream(&buf, len);
+	uint32_t i, funcs = n / 6;
+	if (!f) allocation_failed(NULL);
+	for (i = 0; strcmp(name, "calls") == 0 && i < funcs; i++) {
+		fprintf(f, "f%u: addiu $sp, $sp, -8\nsw $ra, 4($sp)\n", i);
+		fprintf(f, "beq $t0, $0, f%u\njal f%u\n", i + 1 < funcs ? i + 1 : i, (i * 7919) % funcs);
+		fprintf(f, "lw $ra, 4($sp)\njr $ra\n");
+	}
+	for (i = 0; strcmp(name, "straight") == 0 && i < n; i++) {
+		switch (i % 4) {
+			case 0: fprintf(f, "addu $t%u, $t%u, $s%u\n", i % 8, (i / 4) % 8, i % 7); break;
+			case 1: fprintf(f, "addiu $t%u, $t%u, %u\n", i % 8, (i / 8) % 8, i % 512); break;
+			case 2: fprintf(f, "lw $s%u, %u($sp)\n", i % 7, 4 * (i % 64)); break;
+			default: fprintf(f, "sll $t%u, $s%u, %u\n", i % 8, i % 7, i % 32);
+		}
+	}
+	fclose(f);
+	return buf;
+}
+
+/* Returns the best instructions per second of assemblies of the synthetic
+   input NAME, at least PERF_RUNS of them and PERF_MIN_MS long, or 0 if it
+   fails to assemble.
+ */
+static double measure(const char* name, uint32_t n) {
+	size_t len;
+	char* src = make_synthetic(name, n, &len);
+	AsmCtx* ctx = asm_ctx_create(NULL);
+	double best = 0, total = now_ms();
+	int i;
+	for (i = 0; ctx && (i < PERF_RUNS || now_ms() - total < PERF_MIN_MS); i++) {
+		double start = now_ms(), secs;
+		AsmResult* res = asm_assemble_buffer(ctx, src, len);
+		secs = (now_ms() - start) / 1e3;
+		if (!res || res->status != 0) {
+			asm_result_free(res);
+			best = 0;
+			break;
+		}
+		if (res->num_words / secs > best) best = res->num_words / secs;
+		asm_result_free(res);
+	}
+	if (ctx) asm_ctx_free(ctx);
+	free(src);
+	return best;
+}
+
+/* Returns the instructions per second recorded for NAME in the baseline
+   file BASELINE, or 0 if there is none.
+ */
+static double read_baseline(const char* baseline, const char* name) {
+	char line[256], key[64];
+	double value, found = 0;
+	FILE* f = fopen(baseline, "r");
+	if (!f) return 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] != '#' && sscanf(line, "%63s %lf", key, &value) == 2
+			&& strcmp(key, name) == 0) found = value;
+	}
+	fclose(f);
+	return found;
+}
+
+/* Assembles each synthetic input of N instructions and compares its
+   throughput with BASELINE, counting it in PASSED or FAILED. One more than
+   THRESHOLD percent slower is measured again, as the load of the machine
+   varies, and fails with how much slower it is if it stays that slow for
+   PERF_ATTEMPTS measurements. Writes the
+   measurements to BASELINE instead if UPDATE is set or it has none, unless
+   one failed.
+ */
+static void check_performance(const char* baseline, double threshold, int update, uint32_t n,
+	uint32_t* passed, uint32_t* failed) {
+	
+	double measured[sizeof(SYNTHETIC) / sizeof(SYNTHETIC[0])];
+	int i, j, err = 0, missing = 0;
+	for (i = 0; SYNTHETIC[i]; i++) {
+		double base = read_baseline(baseline, SYNTHETIC[i]);
+		measured[i] = measure(SYNTHETIC[i], n);
+		for (j = 1; j < PERF_ATTEMPTS && base && !update && measured[i]
+			&& measured[i] < base * (1 - threshold / 100); j++) {
+			
+			double again = measure(SYNTHETIC[i], n);
+			if (again > measured[i]) measured[i] = again;
+		}
+		if (measured[i] == 0) {
+			printf("FAIL perf %s: does not assemble\n", SYNTHETIC[i]);
+			(*failed)++;
+			err = -1;
+		} else if (base == 0 || update) {
+			printf("     perf %s: %.0f instructions/s\n", SYNTHETIC[i], measured[i]);
+			missing = 1;
+		} else {
+			double change = 100.0 * (measured[i] - base) / base;
+			int slow = change < -threshold;
+			printf("%s perf %s: %.0f instructions/s, %+.1f%% from the baseline of %.0f%s\n",
+				slow ? "FAIL" : "PASS", SYNTHETIC[i], measured[i], change, base,
+				slow ? ", more than -threshold allows" : "");
+			if (slow) err = -1;
+			if (slow) (*failed)++;
+			else (*passed)++;
+		}
+	}
+	if (!err && (missing || update)) {
+		FILE* f = fopen(baseline, "w");
+		if (!f) {
+			printf("FAIL perf: unable to write %s\n", baseline);
+			(*failed)++;
+			return;
+		}
+		fprintf(f, "# Instructions per second assembling the synthetic inputs of runner.c\n");
+		for (i = 0; SYNTHETIC[i]; i++) fprintf(f, "%s %.0f\n", SYNTHETIC[i], measured[i]);
+		fclose(f);
+		printf("     Baseline written to %s\n", baseline);
+	}
+}
+
+/*******************************
+ * Main
+ *******************************/
+
+static void print_usage_and_exit() {
+	printf("Usage: runner [-j <threads>] [-noperf] [-threshold <percent>]\n");
+	printf("              [-baseline <file>] [-update] [-insts <instructions>]\n");
+	printf("Assembles the cases under input/ in parallel through the library and compares\n");
+	printf("them with out/ref and log/ref, then checks that assembling synthetic inputs of\n");
+	printf("the given size (default 24000) is at most -threshold percent (default %.0f)\n",
+		DEFAULT_THRESHOLD);
+	printf("slower than in the baseline file (default %s). -update rewrites it.\n",
+		DEFAULT_BASELINE);
+	exit(1);
+}
+
+int main(int argc, char** argv) {
+	static Outcome outcomes[MAX_CASES];
+	Runner runner;
+	pthread_t* threads;
+	const char* baseline = DEFAULT_BASELINE;
+	double threshold = DEFAULT_THRESHOLD, start, elapsed;
+	long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t i, passed = 0, failed = 0, skipped = 0, insts = 24000;
+	int perf = 1, update = 0;
+
+	for (i = 1; i < (uint32_t)argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < (uint32_t)argc) {
+			num_threads = atol(argv[++i]);
+		} else if (strcmp(argv[i], "-threshold") == 0 && i + 1 < (uint32_t)argc) {
+			threshold = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-baseline") == 0 && i + 1 < (uint32_t)argc) {
+			baseline = argv[++i];
+		} else if (strcmp(argv[i], "-insts") == 0 && i + 1 < (uint32_t)argc) {
+			insts = (uint32_t)atol(argv[++i]);
+		} else if (strcmp(argv[i], "-noperf") == 0) {
+			perf = 0;
+		} else if (strcmp(argv[i], "-update") == 0) {
+			update = 1;
+		} else {
+			print_usage_and_exit();
+		}
+	}
+	if (num_threads < 1 || threshold < 0 || insts < 6) print_usage_and_exit();
+
+	runner.outcomes = outcomes;
+	runner.num = find_cases(outcomes);
+	runner.next = 0;
+	if (num_threads > runner.num) num_threads = runner.num ? runner.num : 1;
+	pthread_mutex_init(&runner.lock, NULL);
+	threads = malloc(num_threads * sizeof(pthread_t));
+	if (!threads) allocation_failed(NULL);
+	start = now_ms();
+	for (i = 0; i < num_threads; i++) pthread_create(threads + i, NULL, run_cases, &runner);
+	for (i = 0; i < num_threads; i++) pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&runner.lock);
+	free(threads);
+
+	for (i = 0; i < runner.num; i++) {
+		Outcome* out = outcomes + i;
+		if (out->skipped) {
+			printf("SKIP %s: %s\n", out->test.name, out->test.flags ? "no reference output"
+				: "needs options the library does not take");
+			skipped++;
+			continue;
+		}
+		printf("%s %s%s%s\n", out->failed ? "FAIL" : "PASS", out->test.name,
+			out->test.flags[0] ? " " : "", out->test.flags);
+		if (out->failed) fwrite(out->report, 1, out->report_len, stdout);
+		free(out->report);
+		if (out->failed) failed++;
+		else passed++;
+	}
+	elapsed = now_ms() - start;
+	if (perf) check_performance(baseline, threshold, update, insts, &passed, &failed);
+	printf("%u passed, %u failed, %u skipped in %.1f ms on %ld threads\n", passed, failed,
+		skipped, elapsed, num_threads); /* Last, so that it counts the perf checks too */
+	return failed ? 1 : 0;
+}
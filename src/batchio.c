@@ -0,0 +1,377 @@
+#define _DEFAULT_SOURCE /* syscall() */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "batchio.h"
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#define HAVE_IO_URING
+#endif
+
+/* A read or write in flight: the file NAME is being opened while FD is -1,
+   and then DONE of the LEN bytes of BUF are through.
+ */
+typedef struct BatchOp {
+	BatchFile* file;            /* NULL for a write */
+	char* name;                 /* FILE->name, or a copy for a write */
+	char* buf;
+	size_t len;
+	size_t done;
+	int fd;
+	struct iovec iov;           /* read by the kernel until completion */
+	struct BatchOp* next_free;
+} BatchOp;
+
+/* The submission and completion rings shared with the kernel, see
+   io_uring_setup(2).
+ */
+typedef struct Ring {
+	int fd;
+	void* sq_map;
+	size_t sq_size;
+	void* cq_map;
+	size_t cq_size;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	void* sqes;
+	size_t sqes_size;
+	void* cqes;
+	unsigned to_submit;
+} Ring;
+
+struct BatchIO {
+	int async;                  /* Through RING, otherwise read()/write() */
+	Ring ring;
+	BatchOp ops[BATCH_QUEUE];
+	BatchOp* free_ops;
+	unsigned in_flight;
+	int write_errors;
+};
+
+/*******************************
+ * io_uring Functions
+ *******************************/
+
+#ifdef HAVE_IO_URING
+
+/* Submits the entries queued in RING and waits for MIN_COMPLETE
+   completions.
+ */
+static void ring_enter(Ring* ring, unsigned min_complete) {
+	long ret;
+	do {
+		ret = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, min_complete,
+			min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret == -1 && errno == EINTR);
+	if (ret > 0) ring->to_submit -= (unsigned)ret;
+}
+
+/* Maps the rings of a new io_uring of BATCH_QUEUE entries into RING.
+   Returns 0 on success and -1 if the kernel does not provide io_uring.
+ */
+static int ring_setup(Ring* ring) {
+	struct io_uring_params p;
+	char *sq, *cq;
+	memset(&p, 0, sizeof(p));
+	memset(ring, 0, sizeof(Ring));
+	ring->fd = (int)syscall(__NR_io_uring_setup, BATCH_QUEUE, &p);
+	if (ring->fd == -1) return -1;
+	ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) { /* Both rings in one mapping */
+		if (ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+		ring->cq_size = 0;
+	}
+	ring->sq_map = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_map = ring->cq_size == 0 || ring->sq_map == MAP_FAILED ? ring->sq_map
+		: mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = ring->cq_map == MAP_FAILED ? MAP_FAILED
+		: mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		if (ring->cq_map != MAP_FAILED && ring->cq_size) munmap(ring->cq_map, ring->cq_size);
+		if (ring->sq_map != MAP_FAILED) munmap(ring->sq_map, ring->sq_size);
+		close(ring->fd);
+		return -1;
+	}
+	sq = ring->sq_map;
+	cq = ring->cq_map;
+	ring->sq_head = (unsigned*)(sq + p.sq_off.head);
+	ring->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned*)(sq + p.sq_off.array);
+	ring->cq_head = (unsigned*)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+	ring->cqes = cq + p.cq_off.cqes;
+	return 0;
+}
+
+static void ring_free(Ring* ring) {
+	munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_size) munmap(ring->cq_map, ring->cq_size);
+	munmap(ring->sq_map, ring->sq_size);
+	close(ring->fd);
+}
+
+/* Queues the next step of OP, the INDEX-th op, to be submitted by
+   ring_enter(): opening its file, or the rest of its read or write. There
+   is room: no more ops than entries are in flight.
+ */
+static void ring_queue(Ring* ring, BatchOp* op, unsigned index) {
+	unsigned tail = *ring->sq_tail, slot = tail & *ring->sq_mask;
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*)ring->sqes + slot;
+	memset(sqe, 0, sizeof(*sqe));
+	if (op->fd == -1) {
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uint64_t)(uintptr_t)op->name;
+		sqe->open_flags = op->file ? O_RDONLY : O_WRONLY | O_CREAT | O_TRUNC;
+		sqe->len = 0666;
+	} else {
+		op->iov.iov_base = op->buf + op->done;
+		op->iov.iov_len = op->len - op->done;
+		sqe->opcode = op->file ? IORING_OP_READV : IORING_OP_WRITEV;
+		sqe->fd = op->fd;
+		sqe->addr = (uint64_t)(uintptr_t)&op->iov;
+		sqe->len = 1;
+		sqe->off = op->done;
+	}
+	sqe->user_data = index;
+	ring->sq_array[slot] = slot;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE); /* After the entry it publishes */
+	ring->to_submit++;
+}
+
+#endif
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+static void finish_op(BatchIO* io, BatchOp* op, int err);
+
+static void start_op(BatchIO* io, BatchOp* op);
+
+static int open_op(BatchOp* op) {
+	return op->file ? open(op->name, O_RDONLY) : open(op->name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+}
+
+/* Goes on with OP once its file is open as FD, or finishes it if FD is -1.
+   A file to read is sized for its buffer first.
+ */
+static void opened(BatchIO* io, BatchOp* op, int fd) {
+	struct stat st;
+	op->fd = fd;
+	if (fd == -1) {
+		finish_op(io, op, 1);
+		return;
+	}
+	if (op->file) {
+		if (fstat(fd, &st) != 0) {
+			finish_op(io, op, 1);
+			return;
+		}
+		op->len = st.st_size;
+		op->buf = op->file->buf = malloc(op->len + 1);
+		if (!op->buf) allocation_failed(NULL);
+	}
+	start_op(io, op);
+}
+
+/* Waits for at least one op to complete and finishes the completed ones,
+   queueing again the rest of those that were cut short.
+ */
+static void reap(BatchIO* io) {
+#ifdef HAVE_IO_URING
+	Ring* ring = &io->ring;
+	unsigned head, tail;
+	ring_enter(ring, 1);
+	head = *ring->cq_head; /* Only written here */
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE); /* Before the entries it publishes */
+	while (head != tail) {
+		struct io_uring_cqe* cqe = (struct io_uring_cqe*)ring->cqes + (head & *ring->cq_mask);
+		BatchOp* op = io->ops + cqe->user_data;
+		head++;
+		if (op->fd == -1) {
+			if (cqe->res == -EINVAL) opened(io, op, open_op(op)); /* No IORING_OP_OPENAT */
+			else opened(io, op, cqe->res < 0 ? -1 : cqe->res);
+			continue;
+		}
+		if (cqe->res > 0) op->done += cqe->res;
+		if (cqe->res > 0 && op->done < op->len) {
+			ring_queue(ring, op, (unsigned)(op - io->ops)); /* Short */
+		} else {
+			finish_op(io, op, cqe->res < 0 || op->done < op->len);
+		}
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE); /* Done with the entries it frees */
+#else
+	(void)io;
+#endif
+}
+
+static BatchOp* get_op(BatchIO* io) {
+	BatchOp* op;
+	while (!io->free_ops) reap(io);
+	op = io->free_ops;
+	io->free_ops = op->next_free;
+	io->in_flight++;
+	return op;
+}
+
+static void finish_op(BatchIO* io, BatchOp* op, int err) {
+	if (op->fd != -1) close(op->fd);
+	if (op->file) {
+		op->file->len = op->done;
+		if (op->buf) op->buf[op->done] = '\0';
+		op->file->err = err;
+	} else {
+		free(op->buf);
+		free(op->name);
+		if (err) io->write_errors++;
+	}
+	op->next_free = io->free_ops;
+	io->free_ops = op;
+	io->in_flight--;
+}
+
+/* Reads or writes all of OP with read() or write(), without a ring. */
+static void run_op(BatchIO* io, BatchOp* op) {
+	int err = 0;
+	if (op->fd == -1) {
+		opened(io, op, open_op(op));
+		return;
+	}
+	while (op->done < op->len) {
+		ssize_t n = op->file ? pread(op->fd, op->buf + op->done, op->len - op->done, op->done)
+			: pwrite(op->fd, op->buf + op->done, op->len - op->done, op->done);
+		if (n == -1 && errno == EINTR) continue;
+		if (n <= 0) {
+			err = 1;
+			break;
+		}
+		op->done += n;
+	}
+	finish_op(io, op, err);
+}
+
+static void start_op(BatchIO* io, BatchOp* op) {
+#ifdef HAVE_IO_URING
+	if (io->async && (op->fd == -1 || op->done < op->len)) {
+		ring_queue(&io->ring, op, (unsigned)(op - io->ops));
+		return;
+	}
+#endif
+	run_op(io, op);
+}
+
+/*******************************
+ * Batch I/O Functions
+ *******************************/
+
+/* Returns a batch of reads and writes, through io_uring if ASYNC is set and
+   the kernel provides it, and otherwise with read() and write() as each is
+   queued.
+ */
+BatchIO* create_batch_io(int async) {
+	BatchIO* io = malloc(sizeof(BatchIO));
+	int i;
+	if (!io) allocation_failed(NULL);
+	io->async = 0;
+#ifdef HAVE_IO_URING
+	io->async = async && ring_setup(&io->ring) == 0;
+#else
+	(void)async;
+#endif
+	io->free_ops = NULL;
+	for (i = BATCH_QUEUE - 1; i >= 0; i--) {
+		io->ops[i].next_free = io->free_ops;
+		io->free_ops = io->ops + i;
+	}
+	io->in_flight = 0;
+	io->write_errors = 0;
+	return io;
+}
+
+void free_batch_io(BatchIO* io) {
+	batch_wait(io);
+#ifdef HAVE_IO_URING
+	if (io->async) ring_free(&io->ring);
+#endif
+	free(io);
+}
+
+const char* batch_io_backend(BatchIO* io) {
+	return io->async ? "io_uring" : "read/write";
+}
+
+/* Queues reading FILE->name into a new FILE->buf, to be freed by the
+   caller.
+ */
+void batch_read(BatchIO* io, BatchFile* file) {
+	BatchOp* op = get_op(io);
+	file->buf = NULL;
+	file->len = 0;
+	file->err = 0;
+	op->file = file;
+	op->name = (char*)file->name;
+	op->fd = -1;
+	op->buf = NULL;
+	op->len = 0;
+	op->done = 0;
+	start_op(io, op);
+}
+
+/* Queues writing the LEN bytes of BUF to the file NAME, created or
+   truncated. BUF is freed once written. A failure is counted for
+   batch_wait().
+ */
+void batch_write(BatchIO* io, const char* name, char* buf, size_t len) {
+	BatchOp* op = get_op(io);
+	op->file = NULL;
+	op->name = malloc(strlen(name) + 1);
+	if (!op->name) allocation_failed(NULL);
+	strcpy(op->name, name);
+	op->fd = -1;
+	op->buf = buf;
+	op->len = len;
+	op->done = 0;
+	start_op(io, op);
+}
+
+/* Starts the reads and writes queued so far, without waiting for them. */
+void batch_submit(BatchIO* io) {
+#ifdef HAVE_IO_URING
+	if (io->async && io->ring.to_submit) ring_enter(&io->ring, 0);
+#else
+	(void)io;
+#endif
+}
+
+/* Waits for all the reads and writes queued so far. Returns the number of
+   writes that failed since the last call.
+ */
+int batch_wait(BatchIO* io) {
+	int errors;
+	while (io->in_flight) reap(io);
+	errors = io->write_errors;
+	io->write_errors = 0;
+	return errors;
+}
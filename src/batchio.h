@@ -0,0 +1,38 @@
+#ifndef BATCHIO_H
+#define BATCHIO_H
+
+#include <stddef.h>
+
+#define BATCH_QUEUE 64      /* reads and writes in flight at once */
+
+/* A file read by batch_read(): once batch_wait() returns, BUF holds its LEN
+   bytes and a NUL, or ERR is set.
+ */
+typedef struct BatchFile {
+    const char* name;
+    char* buf;
+    size_t len;
+    int err;
+} BatchFile;
+
+typedef struct BatchIO BatchIO;
+
+/* Returns a batch of reads and writes, on io_uring if ASYNC and available. */
+BatchIO* create_batch_io(int async);
+
+void free_batch_io(BatchIO* io);
+
+const char* batch_io_backend(BatchIO* io);
+
+/* Queues reading the whole of FILE->NAME into FILE. */
+void batch_read(BatchIO* io, BatchFile* file);
+
+/* Queues writing LEN bytes of BUF to NAME, which then owns BUF. */
+void batch_write(BatchIO* io, const char* name, char* buf, size_t len);
+
+void batch_submit(BatchIO* io);
+
+/* Waits for the queued reads and writes. Returns how many writes failed. */
+int batch_wait(BatchIO* io);
+
+#endif
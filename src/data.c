@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "translate_utils.h"
+#include "data.h"
+
+#define MAX_STRING 1024
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+/* Makes room for LEN more bytes and returns where they go. */
+static uint8_t* reserve(DataSection* data, uint32_t len) {
+	uint8_t* p;
+	uint32_t cap = data->cap;
+	if (data->len + len > cap) {
+		while (data->len + len > cap) cap *= 2;
+		p = realloc(data->bytes, cap);
+		if (!p) allocation_failed(data->log); /* DATA is left as it was */
+		data->bytes = p;
+		data->cap = cap;
+	}
+	p = data->bytes + data->len;
+	data->len += len;
+	return p;
+}
+
+static void append_value(DataSection* data, uint32_t value, int size) {
+	uint8_t* p = reserve(data, size);
+	int i;
+	for (i = 0; i < size; i++) p[i] = (value >> (8 * i)) & 0xff; /* Little-endian */
+}
+
+/* Appends COUNT copies of the SIZE bytes just before the end of DATA by
+   doubling memcpy()s, so large fills cost a few bulk copies.
+ */
+static void repeat_last(DataSection* data, uint32_t size, uint32_t count) {
+	uint32_t done = 1, n;
+	uint8_t* first = reserve(data, size * (count - 1)) - size;
+	while (done < count) {
+		n = done < count - done ? done : count - done;
+		memcpy(first + size * done, first, size * n);
+		done += n;
+	}
+}
+
+static void align(DataSection* data, uint32_t alignment) {
+	uint32_t pad = (alignment - data->len % alignment) % alignment;
+	if (pad) memset(reserve(data, pad), 0, pad);
+}
+
+/* Parses a quoted string at *STR into OUT, handling \n, \t, \0, \\ and \".
+   Returns its length, or -1 if it is malformed. Advances *STR past it.
+ */
+static int parse_string(const char** str, char* out) {
+	const char* p = *str;
+	int len = 0;
+	if (*p++ != '"') return -1;
+	while (*p && *p != '"') {
+		char c = *p++;
+		if (c == '\\') {
+			switch (*p++) {
+				case 'n': c = '\n'; break;
+				case 't': c = '\t'; break;
+				case '0': c = '\0'; break;
+				case '\\': c = '\\'; break;
+				case '"': c = '"'; break;
+				default: return -1;
+			}
+		}
+		if (len == MAX_STRING) return -1;
+		out[len++] = c;
+	}
+	if (*p != '"') return -1;
+	*str = p + 1;
+	return len;
+}
+
+/* Copies the next token of *STR, ended by whitespace, a comma or a comment,
+   into TOKEN. Returns 0 if there is none. Advances *STR past it.
+ */
+static int next_token(const char** str, char* token) {
+	const char* p = *str;
+	size_t len;
+	while (*p && (isspace((int)*p) || *p == ',')) p++;
+	if (!*p || *p == '#') return 0;
+	len = strcspn(p, " \f\n\r\t\v,#");
+	if (len >= MAX_STRING) len = MAX_STRING - 1;
+	memcpy(token, p, len);
+	token[len] = '\0';
+	*str = p + len;
+	return 1;
+}
+
+/* Appends the values of a .word, .half or .byte of SIZE bytes. A value is a
+   number, `<value>:<count>` for COUNT copies or, for .word, a label whose
+   address is filled in by resolve_data(). Returns 0 on success and -1 on
+   error.
+ */
+static int write_values(DataSection* data, const char* rest, int size) {
+	char token[MAX_STRING];
+	long int lower = size == 4 ? -2147483648L : -(1L << (8 * size - 1));
+	long int upper = size == 4 ? 4294967295L : (1L << (8 * size)) - 1;
+	int num = 0;
+	while (next_token(&rest, token)) {
+		char* colon = strchr(token, ':');
+		long int value, count = 1;
+		if (colon) {
+			*colon = '\0';
+			if (translate_num(&count, colon + 1, 0x7fffffff, 1) != 0) return -1;
+		}
+		if (translate_num(&value, token, upper, lower) != 0) {
+			if (size != 4 || !is_valid_label(token)) return -1;
+			append_sym(data->words, token, data->len);
+			value = 0;
+		}
+		append_value(data, (uint32_t)value, size);
+		if (count > 1) {
+			if (data->words->len && data->words->tail->addr == data->len - 4) return -1; /* Label */
+			repeat_last(data, size, (uint32_t)count);
+		}
+		num++;
+	}
+	return num ? 0 : -1;
+}
+
+/*******************************
+ * Data Section Functions
+ *******************************/
+
+static void release_data_section(void* data) {
+	free_data_section(data);
+}
+
+DataSection* create_data_section(LogCapture* log) {
+	DataSection* data = calloc(1, sizeof(DataSection));
+	if (!data) allocation_failed(log);
+	data->log = log;
+	push_cleanup(log, release_data_section, data); /* Until its tables are made */
+	data->bytes = malloc(256);
+	if (!data->bytes) allocation_failed(log);
+	data->cap = 256;
+	data->labels = create_table(SYMBOLTBL_NON_UNIQUE, log);
+	data->words = create_table(SYMBOLTBL_NON_UNIQUE, log);
+	pop_cleanup(log, data);
+	return data;
+}
+
+/* Frees DATA, even if create_data_section() did not finish it. */
+void free_data_section(DataSection* data) {
+	free(data->bytes);
+	if (data->labels) free_table(data->labels);
+	if (data->words) free_table(data->words);
+	free(data);
+}
+
+int is_data_directive(const char* name) {
+	return strcmp(name, ".word") == 0 || strcmp(name, ".half") == 0
+		|| strcmp(name, ".byte") == 0 || strcmp(name, ".space") == 0
+		|| strcmp(name, ".ascii") == 0 || strcmp(name, ".asciiz") == 0
+		|| strcmp(name, ".align") == 0;
+}
+
+/* Appends the data of directive NAME to DATA during pass one. REST is the
+   source line after NAME, still with its quotes and comments, since strings
+   may contain spaces, commas and '#'. The directives are
+
+	.word/.half/.byte <value>, ...   values of 4, 2 and 1 bytes, aligned
+	                                 to their size (see write_values())
+	.space <n>                       N zero bytes
+	.ascii/.asciiz "<string>" ...    the characters, .asciiz adding a NUL
+	.align <n>                       pads to a multiple of 2^N bytes
+
+   START receives the offset the data starts at after alignment, which is
+   where a label on the same line points. Returns 0 on success and -1 on
+   error.
+ */
+int write_data(DataSection* data, const char* name, const char* rest, uint32_t* start) {
+	char token[MAX_STRING], extra[MAX_STRING];
+	long int n;
+	if (strcmp(name, ".word") == 0) align(data, 4);
+	else if (strcmp(name, ".half") == 0) align(data, 2);
+	*start = data->len;
+	if (strcmp(name, ".word") == 0) return write_values(data, rest, 4);
+	if (strcmp(name, ".half") == 0) return write_values(data, rest, 2);
+	if (strcmp(name, ".byte") == 0) return write_values(data, rest, 1);
+	if (strcmp(name, ".space") == 0 || strcmp(name, ".align") == 0) {
+		if (!next_token(&rest, token) || next_token(&rest, extra)) return -1;
+		if (strcmp(name, ".space") == 0) {
+			if (translate_num(&n, token, MAX_SPACE, 0) != 0) return -1;
+			memset(reserve(data, (uint32_t)n), 0, n);
+		} else {
+			if (translate_num(&n, token, 16, 0) != 0) return -1;
+			align(data, (uint32_t)1 << n);
+			*start = data->len;
+		}
+		return 0;
+	}
+	if (strcmp(name, ".ascii") == 0 || strcmp(name, ".asciiz") == 0) {
+		int len, num = 0;
+		while (*rest && isspace((int)*rest)) rest++;
+		while (*rest == '"') {
+			if ((len = parse_string(&rest, token)) == -1) return -1;
+			memcpy(reserve(data, len), token, len);
+			if (strcmp(name, ".asciiz") == 0) append_value(data, 0, 1);
+			while (*rest && (isspace((int)*rest) || *rest == ',')) rest++;
+			num++;
+		}
+		return num && (!*rest || *rest == '#') ? 0 : -1;
+	}
+	return -1;
+}
+
+/* Adds the labels of DATA to SYMTBL, once DATA->text_size is final: .data
+   starts at DATA_BASE() of it, and each label at its offset from there. The
+   names were checked against SYMTBL when pass one added them. Returns 0 on
+   success and -1 if .data would end past 4 GB.
+ */
+int place_data(DataSection* data, SymbolTable* symtbl) {
+	uint64_t base = DATA_BASE(data->text_size);
+	Symbol* cur = data->labels->head;
+	if (data->len && base + data->len > 0xFFFFFFFFUL) {
+		log_to(data->log, "Error: .data does not fit after %u bytes of .text\n", data->text_size);
+		return -1;
+	}
+	while ((cur = cur->next)) append_sym(symtbl, cur->name, (uint32_t)(base + cur->addr));
+	return 0;
+}
+
+/* Fills in the .word entries of DATA that name a label, after pass two. A
+   label defined in SYMTBL is stored as TEXT_BASE plus its offset if
+   TEXT_BASE is known; otherwise it is added to RELTBL at the address of the
+   entry, DATA_BASE() plus its offset, which the linker patches with the full
+   address. Returns 0 on success and -1 if a label cannot be relocated.
+ */
+int resolve_data(DataSection* data, SymbolTable* symtbl, SymbolTable* reltbl,
+	int64_t text_base) {
+	
+	uint32_t base = (uint32_t)DATA_BASE(data->text_size);
+	Symbol* cur = data->words->head;
+	while ((cur = cur->next)) {
+		int64_t addr = text_base == -1 ? -1 : get_addr_for_symbol(symtbl, cur->name);
+		uint32_t value, i;
+		if (addr == -1) {
+			if (add_to_table(reltbl, cur->name, base + cur->addr) != 0) return -1;
+			continue;
+		}
+		value = (uint32_t)(text_base + addr);
+		for (i = 0; i < 4; i++) data->bytes[cur->addr + i] = (value >> (8 * i)) & 0xff;
+	}
+	return 0;
+}
+
+/* Writes the bytes of DATA to OUTPUT as hex, DATA_LINE_BYTES per line. Each
+   byte is looked up in a table of digit pairs and whole lines are copied
+   into a block buffer, so even multi-megabyte sections are written with a
+   few large fwrite()s.
+ */
+void write_data_section(DataSection* data, FILE* output) {
+	static const char digits[] = "0123456789abcdef";
+	char pairs[256][2];
+	char block[(2 * DATA_LINE_BYTES + 1) * 512];
+	size_t len = 0;
+	uint32_t i;
+	for (i = 0; i < 256; i++) {
+		pairs[i][0] = digits[i >> 4];
+		pairs[i][1] = digits[i & 0xf];
+	}
+	for (i = 0; i < data->len; i++) {
+		memcpy(block + len, pairs[data->bytes[i]], 2);
+		len += 2;
+		if (i % DATA_LINE_BYTES == DATA_LINE_BYTES - 1 || i == data->len - 1) {
+			block[len++] = '\n';
+			if (len + 2 * DATA_LINE_BYTES + 1 > sizeof(block)) {
+				fwrite(block, 1, len, output);
+				len = 0;
+			}
+		}
+	}
+	fwrite(block, 1, len, output);
+}
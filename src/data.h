@@ -0,0 +1,45 @@
+#ifndef DATA_H
+#define DATA_H
+
+#include <stdint.h>
+
+#define DATA_LINE_BYTES 32      /* bytes per line of the .data section */
+#define MAX_SPACE 0x00800000    /* bytes a single .space may reserve */
+
+/* The .data section built during pass one: its bytes in memory order
+   (little-endian, as the simulator loads them), its labels and the .word
+   entries that name a label, both keyed by byte offset. Where .data goes
+   depends on TEXT_SIZE, the bytes of .text once the passes between pass one
+   and pass two are done with it, see DATA_BASE(). LOG is where its errors
+   go, see utils.h.
+ */
+typedef struct DataSection {
+    uint8_t* bytes;
+    uint32_t len;
+    uint32_t cap;
+    uint32_t text_size;
+    SymbolTable* labels;
+    SymbolTable* words;
+    struct LogCapture* log;
+} DataSection;
+
+DataSection* create_data_section(struct LogCapture* log);
+
+void free_data_section(DataSection* data);
+
+int is_data_directive(const char* name);
+
+/* Appends the data of directive NAME to DATA. START receives its offset. */
+int write_data(DataSection* data, const char* name, const char* rest, uint32_t* start);
+
+/* Adds the labels of DATA to SYMTBL at their address after .text. */
+int place_data(DataSection* data, SymbolTable* symtbl);
+
+/* Fills in the .word entries of DATA that name a label. */
+int resolve_data(DataSection* data, SymbolTable* symtbl, SymbolTable* reltbl,
+    int64_t text_base);
+
+/* Writes the bytes of DATA to OUTPUT as hex. */
+void write_data_section(DataSection* data, FILE* output);
+
+#endif
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "translate_utils.h"
+#include "ir.h"
+#include "dce.h"
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+/* Pushes the instruction at the byte offset of LABEL onto STACK if LABEL is
+   defined in SYMTBL and the instruction has not been reached yet. Undefined
+   labels are external and lead nowhere in this file.
+ */
+static void push_label(const char* label, SymbolTable* symtbl, char* reached,
+	uint32_t* stack, uint32_t* top, uint32_t len) {
+	
+	int64_t addr = get_addr_for_symbol(symtbl, label);
+	if (addr == -1 || addr / 4 >= len || reached[addr / 4]) return;
+	reached[addr / 4] = 1;
+	stack[(*top)++] = (uint32_t)(addr / 4);
+}
+
+static void push_index(uint32_t i, char* reached, uint32_t* stack, uint32_t* top,
+	uint32_t len) {
+	
+	if (i >= len || reached[i]) return;
+	reached[i] = 1;
+	stack[(*top)++] = i;
+}
+
+/*******************************
+ * Dead Code Elimination
+ *******************************/
+
+/* Removes every instruction of LIST that cannot be reached from ENTRY (or the
+   first instruction if ENTRY is NULL), from a label listed in EXPORTS, or
+   from a label whose address is taken by la. The successors of an
+   instruction are:
+
+	beq, bne         - the next instruction and the target
+	j                - the target
+	jal              - the target and the next instruction, where it returns
+	jr               - none, indirect targets must be one of the roots
+	anything else    - the next instruction
+
+   Labels that pointed into removed code are dropped from SYMTBL, the others
+   move with their instructions. Data labels are left alone.
+
+   Returns the number of instructions removed, or -1 if ENTRY is not defined.
+ */
+int64_t eliminate_dead_code(InstList* list, SymbolTable* symtbl, SymbolTable* exports,
+	const char* entry) {
+	
+	uint32_t i, top = 0, removed = 0;
+	InstInfo info;
+	Symbol* cur;
+	char* reached = calloc(list->len + 1, 1);
+	uint32_t* stack = malloc((list->len + 1) * sizeof(uint32_t));
+	if (!reached || !stack) {
+		free(reached);
+		free(stack);
+		allocation_failed(list->log);
+	}
+	push_cleanup(list->log, free, reached); /* delete_insts() allocates too */
+	push_cleanup(list->log, free, stack);
+  /* Collect the roots */
+	if (entry) {
+		if (get_addr_for_symbol(symtbl, entry) == -1) {
+			log_to(list->log, "Error: entry label not found: %s\n", entry);
+			pop_cleanup(list->log, stack);
+			pop_cleanup(list->log, reached);
+			free(reached);
+			free(stack);
+			return -1;
+		}
+		push_label(entry, symtbl, reached, stack, &top, list->len);
+	} else push_index(0, reached, stack, &top, list->len);
+	cur = exports->head;
+	while ((cur = cur->next)) push_label(cur->name, symtbl, reached, stack, &top, list->len);
+	for (i = 0; i < list->len; i++) {
+		Inst* inst = &list->insts[i];
+		const char* label = NULL;
+		if (strcmp(inst->name, "lui") == 0 && inst->num_args > 0) {
+			label = strip_operand(inst->args[inst->num_args - 1], "%hi"); /* Address taken by la */
+		} else if (strcmp(inst->name, "ori") == 0 && inst->num_args > 0) {
+			label = strip_operand(inst->args[inst->num_args - 1], "%lo");
+		}
+		if (label) push_label(label, symtbl, reached, stack, &top, list->len);
+	}
+  /* Walk the control flow and call graph */
+	while (top) {
+		Inst* inst = &list->insts[i = stack[--top]];
+		decode_inst(inst, &info);
+		switch (info.kind) {
+			case INST_BRANCH:
+				push_label(inst->args[2], symtbl, reached, stack, &top, list->len);
+				push_index(i + 1, reached, stack, &top, list->len);
+				break;
+			case INST_JUMP:
+				push_label(inst->args[0], symtbl, reached, stack, &top, list->len);
+				break;
+			case INST_CALL:
+				push_label(inst->args[0], symtbl, reached, stack, &top, list->len);
+				push_index(i + 1, reached, stack, &top, list->len);
+				break;
+			case INST_JR:
+				break;
+			default:
+				push_index(i + 1, reached, stack, &top, list->len);
+		}
+	}
+  /* Drop labels of dead code, then the code itself */
+	for (i = 0; i < list->len; i++) {
+		if (!reached[i]) removed++;
+	}
+	reached[list->len] = 1; /* A trailing label stays */
+	cur = symtbl->head;
+	while (cur->next) {
+		uint32_t index = cur->next->addr / 4;
+		if (index <= list->len && !reached[index]) remove_from_table(symtbl, cur->next->name);
+		else cur = cur->next;
+	}
+	for (i = 0; i < list->len; i++) reached[i] = !reached[i]; /* Now the dead flags */
+	delete_insts(list, reached, symtbl);
+	pop_cleanup(list->log, stack);
+	pop_cleanup(list->log, reached);
+	free(reached);
+	free(stack);
+	return removed;
+}
@@ -0,0 +1,10 @@
+#ifndef DCE_H
+#define DCE_H
+
+#include <stdint.h>
+
+/* Removes instructions unreachable from the entry, exports and la targets. */
+int64_t eliminate_dead_code(InstList* list, SymbolTable* symtbl, SymbolTable* exports,
+    const char* entry);
+
+#endif
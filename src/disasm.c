@@ -0,0 +1,424 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate_utils.h"
+#include "translate.h"
+#include "object.h"
+#include "disasm.h"
+
+static const char* const REG_NAMES[32] = {
+	"$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+	"$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+	"$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+	"$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra"
+};
+
+/* Output collected in blocks of DISASM_BLOCK bytes. */
+typedef struct OutBuf {
+	FILE* file;
+	size_t len;
+	char data[DISASM_BLOCK];
+} OutBuf;
+
+/* Decoding tables: the entry of INST_ENCODINGS for each opcode, and for each
+   funct of opcode 0.
+ */
+typedef struct Decoder {
+	const InstEncoding* by_opcode[64];
+	const InstEncoding* by_funct[64];
+} Decoder;
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+static void build_decoder(Decoder* dec) {
+	const InstEncoding* enc;
+	memset(dec, 0, sizeof(Decoder));
+	for (enc = INST_ENCODINGS; enc->name; enc++) {
+		if (enc->format == FMT_RTYPE || enc->format == FMT_SHIFT || enc->format == FMT_JR) {
+			dec->by_funct[enc->code] = enc;
+		} else {
+			dec->by_opcode[enc->code] = enc;
+		}
+	}
+}
+
+static void out_flush(OutBuf* out) {
+	fwrite(out->data, 1, out->len, out->file);
+	out->len = 0;
+}
+
+/* Appends STR, flushing first if a line might not fit anymore. */
+static void out_str(OutBuf* out, const char* str) {
+	size_t len = strlen(str);
+	if (out->len + len > DISASM_BLOCK) out_flush(out);
+	memcpy(out->data + out->len, str, len);
+	out->len += len;
+}
+
+static void out_hex(OutBuf* out, uint32_t word) {
+	static const char digits[] = "0123456789abcdef";
+	int i;
+	if (out->len + 8 > DISASM_BLOCK) out_flush(out);
+	for (i = 7; i >= 0; i--) out->data[out->len++] = digits[(word >> (4 * i)) & 0xf];
+}
+
+/* Reads all of INPUT, DISASM_BLOCK bytes at a time, into a NUL-terminated
+   buffer the caller frees. Stores its length in LEN.
+ */
+static char* read_blocks(FILE* input, size_t* len) {
+	size_t cap = DISASM_BLOCK, got;
+	char* buf = malloc(cap + 1);
+	if (!buf) allocation_failed(NULL);
+	*len = 0;
+	while ((got = fread(buf + *len, 1, cap - *len, input)) > 0) {
+		*len += got;
+		if (*len == cap) {
+			cap *= 2;
+			buf = realloc(buf, cap + 1);
+			if (!buf) allocation_failed(NULL);
+		}
+	}
+	buf[*len] = '\0';
+	return buf;
+}
+
+static int hex_digit(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+/* Parses an object file as written by assemble() from BUF. The words of
+   .text are parsed by hand, as they make up most of the file. Words before
+   any section header are .text too, so a bare hex dump is read as code.
+   Returns 0 on success and -1 (after logging the offending line) on error.
+ */
+static int parse_object(char* buf, uint32_t** text, uint32_t* text_len,
+	SymbolTable* symtbl, SymbolTable* reltbl) {
+	
+	uint32_t cap = 256, line = 0;
+	int section = 1; /* 1: .text, 2: .symbol, 3: .relocation, 4: .line, 5: .data, 6: .relgroup */
+	char* cur = buf;
+	*text = malloc(cap * sizeof(uint32_t));
+	if (!*text) allocation_failed(NULL);
+	*text_len = 0;
+	while (*cur) {
+		char* end = cur + strcspn(cur, "\n");
+		char* p = cur;
+		int err = 0;
+		line++;
+		if (*end) *end++ = '\0';
+		if (p[strcspn(p, "\r")]) p[strcspn(p, "\r")] = '\0';
+		if (!*p) {
+			cur = end;
+			continue;
+		}
+		if (strcmp(p, ".text") == 0) section = 1;
+		else if (strcmp(p, ".symbol") == 0) section = 2;
+		else if (strcmp(p, ".relocation") == 0) section = 3;
+		else if (strcmp(p, ".line") == 0) section = 4;
+		else if (strcmp(p, ".data") == 0) section = 5;
+		else if (strcmp(p, ".relgroup") == 0) section = 6;
+		else if (section == 1) {
+			uint32_t word = 0;
+			int d, n = 0;
+			while ((d = hex_digit(*p)) != -1 && n < 8) {
+				word = (word << 4) | (uint32_t)d;
+				p++;
+				n++;
+			}
+			if (!n || *p) err = -1;
+			else {
+				if (*text_len == cap) {
+					cap *= 2;
+					*text = realloc(*text, cap * sizeof(uint32_t));
+					if (!*text) allocation_failed(NULL);
+				}
+				(*text)[(*text_len)++] = word;
+			}
+		} else if (section == 2 || section == 3) {
+			char* name;
+			unsigned long addr = strtoul(p, &name, 10);
+			if (name == p || *name != '\t') err = -1;
+			else err = add_to_table(section == 2 ? symtbl : reltbl, name + 1, (uint32_t)addr);
+		} else if (section == 6) err = read_reloc_group(p, reltbl);
+		else if (section != 4 && section != 5) err = -1;
+		if (err) {
+			write_to_log("Error - invalid object file at line %u: %s\n", line, cur);
+			return -1;
+		}
+		cur = end;
+	}
+	return 0;
+}
+
+/* Returns 1 if BUF does not look like text, i.e. is raw machine code. */
+static int is_binary(const char* buf, size_t len) {
+	size_t i;
+	for (i = 0; i < len && i < DISASM_BLOCK; i++) {
+		unsigned char c = (unsigned char)buf[i];
+		if (c < 0x20 && c != '\n' && c != '\r' && c != '\t') return 1;
+		if (c >= 0x7f) return 1;
+	}
+	return 0;
+}
+
+/* Decodes WORD at byte offset ADDR into NAME and ARGS in the form pass two
+   reads (so lw $t0, 4($t1) is "lw", "$t0", "4", "$t1") and its format into
+   FORMAT, with the strings in STORE. LABELS and RELOCS give the label at
+   and the symbol relocated at each offset, if any. Returns the number of
+   arguments, or -1 if WORD is not an instruction translate_inst() knows.
+ */
+static int decode_word(const Decoder* dec, uint32_t word, uint32_t addr, const char** name,
+	int* format, char** args, char store[3][32], const char** labels, const char** relocs,
+	uint32_t text_len, int64_t text_base) {
+	
+	uint32_t opcode = word >> 26, rs = (word >> 21) & 0x1f, rt = (word >> 16) & 0x1f;
+	uint32_t rd = (word >> 11) & 0x1f, shamt = (word >> 6) & 0x1f;
+	int32_t simm = (int16_t)(word & 0xffff);
+	uint32_t uimm = word & 0xffff;
+	const char* reloc = relocs[addr / 4];
+	const InstEncoding* enc = opcode ? dec->by_opcode[opcode] : dec->by_funct[word & 0x3f];
+	int i;
+	if (!enc) return -1;
+	*name = enc->name;
+	*format = enc->format;
+	for (i = 0; i < 3; i++) args[i] = store[i];
+	switch (enc->format) {
+		case FMT_RTYPE:
+			if (shamt) return -1;
+			args[0] = (char*)REG_NAMES[rd];
+			args[1] = (char*)REG_NAMES[rs];
+			args[2] = (char*)REG_NAMES[rt];
+			return 3;
+		case FMT_SHIFT:
+			if (rs) return -1;
+			args[0] = (char*)REG_NAMES[rd];
+			args[1] = (char*)REG_NAMES[rt];
+			sprintf(store[2], "%u", shamt);
+			return 3;
+		case FMT_JR:
+			if (rt || rd || shamt) return -1;
+			args[0] = (char*)REG_NAMES[rs];
+			return 1;
+		case FMT_ADDIU:
+			args[0] = (char*)REG_NAMES[rt];
+			args[1] = (char*)REG_NAMES[rs];
+			sprintf(store[2], "%d", simm);
+			return 3;
+		case FMT_ORI:
+			args[0] = (char*)REG_NAMES[rt];
+			args[1] = (char*)REG_NAMES[rs];
+			if (reloc && !uimm) args[2] = (char*)reloc;
+			else sprintf(store[2], "%u", uimm);
+			return 3;
+		case FMT_LUI:
+			if (rs) return -1;
+			args[0] = (char*)REG_NAMES[rt];
+			if (reloc && !uimm) args[1] = (char*)reloc;
+			else sprintf(store[1], "%u", uimm);
+			return 2;
+		case FMT_MEM:
+			args[0] = (char*)REG_NAMES[rt];
+			sprintf(store[1], "%d", simm);
+			args[2] = (char*)REG_NAMES[rs];
+			return 3;
+		case FMT_BRANCH: {
+			int64_t target = (int64_t)addr + 4 + 4 * (int64_t)simm;
+			args[0] = (char*)REG_NAMES[rs];
+			args[1] = (char*)REG_NAMES[rt];
+			if (target >= 0 && target <= 4 * (int64_t)text_len && labels[target / 4]) {
+				args[2] = (char*)labels[target / 4];
+			} else {
+				sprintf(store[2], "%d", simm);
+			}
+			return 3;
+		}
+		case FMT_JUMP: {
+			uint32_t target = (word & 0x3ffffff) << 2;
+			if (reloc && !(word & 0x3ffffff)) {
+				args[0] = (char*)reloc;
+			} else if (text_base != -1) {
+				int64_t off;
+				target |= (uint32_t)(text_base + addr + 4) & 0xf0000000;
+				off = (int64_t)target - text_base;
+				if (off >= 0 && off <= 4 * (int64_t)text_len && !(off % 4) && labels[off / 4]) {
+					args[0] = (char*)labels[off / 4];
+				} else {
+					sprintf(store[0], "0x%08x", target);
+				}
+			} else {
+				sprintf(store[0], "0x%08x", target);
+			}
+			return 1;
+		}
+		default:
+			return -1;
+	}
+}
+
+/* Re-encodes the decoded instruction with translate_inst() and returns 1 if
+   it gives WORD back, 0 if not and -1 if it could not be encoded at all. A
+   branch without a label is given its offset as %rel:I, as relax_branches()
+   writes it, and a relocated lui or ori its symbol as %hi:label or
+   %lo:label, as la expands to.
+ */
+static int round_trip(uint32_t word, uint32_t addr, const char* name,
+	int format, char** args, int num_args, SymbolTable* symtbl, int reloc, int64_t text_base) {
+	
+	SymbolTable* reltbl = create_table(SYMBOLTBL_NON_UNIQUE, NULL);
+	uint32_t again;
+	char* marked[3];
+	char operand[40];
+	int err, i;
+	for (i = 0; i < num_args; i++) marked[i] = args[i];
+	if (format == FMT_BRANCH && !is_valid_label(args[2])) {
+		sprintf(operand, "%%rel:%s", args[2]);
+		marked[2] = operand;
+	} else if ((format == FMT_LUI || format == FMT_ORI) && reloc) {
+		operand[0] = '\0';
+		strncat(operand, format == FMT_LUI ? "%hi:" : "%lo:", 4);
+		strncat(operand, args[num_args - 1], sizeof(operand) - 5);
+		marked[num_args - 1] = operand;
+	}
+	err = translate_inst(NULL, name, marked, num_args, addr, symtbl, reltbl,
+		reloc ? -1 : text_base, &again);
+	free_table(reltbl);
+	if (err) return -1;
+	return again == word;
+}
+
+/*******************************
+ * Disassembler
+ *******************************/
+
+/* Disassembles INPUT to OUTPUT, one instruction per line with its address
+   (TEXT_BASE plus its offset, or the offset if TEXT_BASE is -1) and word.
+
+   INPUT is either an output file of the assembler or, if it does not look
+   like text, raw big-endian machine words. Words are decoded with a table
+   indexed by opcode and funct built from INST_ENCODINGS, the same data
+   translate_inst() encodes with. Labels of the .symbol section are printed
+   before the instructions they point at and name the targets of branches,
+   and, given TEXT_BASE, of jumps. Relocated jumps and lui/ori name the
+   symbol of the .relocation section.
+
+   Input is read and output written in blocks of DISASM_BLOCK bytes. With
+   VERIFY set, every decoded word is encoded again with translate_inst()
+   and compared, as a self-check of both directions.
+
+   Returns 0 on success and -1 if INPUT is malformed.
+ */
+int disassemble(FILE* input, FILE* output, int64_t text_base, int verify,
+	DisasmStats* stats) {
+	
+	Decoder dec;
+	OutBuf* out;
+	size_t len;
+	char* buf = read_blocks(input, &len);
+	uint32_t *text = NULL, text_len = 0, i;
+	SymbolTable* symtbl = create_table(SYMBOLTBL_NON_UNIQUE, NULL); /* Checked when assembled */
+	SymbolTable* reltbl = create_table(SYMBOLTBL_NON_UNIQUE, NULL);
+	const char **labels, **relocs;
+	Symbol** view;
+	Symbol* cur;
+	uint32_t next = 0;
+	int err = 0;
+	memset(stats, 0, sizeof(DisasmStats));
+	build_decoder(&dec);
+	if (is_binary(buf, len)) {
+		text_len = (uint32_t)(len / 4);
+		text = malloc((text_len + 1) * sizeof(uint32_t));
+		if (!text) allocation_failed(NULL);
+		for (i = 0; i < text_len; i++) {
+			const unsigned char* p = (const unsigned char*)buf + 4 * i;
+			text[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+		}
+	} else if (parse_object(buf, &text, &text_len, symtbl, reltbl) != 0) {
+		err = -1;
+	}
+	free(buf);
+	labels = calloc(text_len + 1, sizeof(char*));
+	relocs = calloc(text_len + 1, sizeof(char*));
+	out = malloc(sizeof(OutBuf));
+	if (!labels || !relocs || !out) allocation_failed(NULL);
+	out->file = output;
+	out->len = 0;
+	view = sort_by_addr(symtbl);
+	cur = symtbl->head;
+	while ((cur = cur->next)) {
+		if (cur->addr / 4 <= text_len && !labels[cur->addr / 4]) labels[cur->addr / 4] = cur->name;
+	}
+	cur = reltbl->head;
+	while ((cur = cur->next)) {
+		if (cur->addr / 4 < text_len) relocs[cur->addr / 4] = cur->name;
+	}
+	for (i = 0; !err && i <= text_len; i++) {
+		uint32_t addr = 4 * i;
+		const char* name;
+		char* args[3];
+		char store[3][32];
+		int num_args, format, k;
+		while (next < symtbl->len && view[next]->addr < addr) next++; /* Not on a word */
+		for (; next < symtbl->len && view[next]->addr == addr; next++) {
+			out_str(out, view[next]->name); /* Every label here, in table order */
+			out_str(out, ":\n");
+		}
+		if (i == text_len) break;
+		stats->words++;
+		out_str(out, "  ");
+		out_hex(out, (uint32_t)(text_base == -1 ? addr : text_base + addr));
+		out_str(out, "  ");
+		out_hex(out, text[i]);
+		out_str(out, "  ");
+		num_args = decode_word(&dec, text[i], addr, &name, &format, args, store, labels, relocs,
+			text_len, text_base);
+		if (num_args == -1) {
+			stats->unknown++;
+			out_str(out, ".word 0x");
+			out_hex(out, text[i]);
+			out_str(out, "\n");
+			continue;
+		}
+		out_str(out, name);
+		out_str(out, " ");
+		if (format == FMT_MEM) {
+			out_str(out, args[0]);
+			out_str(out, ", ");
+			out_str(out, args[1]);
+			out_str(out, "(");
+			out_str(out, args[2]);
+			out_str(out, ")");
+		} else {
+			for (k = 0; k < num_args; k++) {
+				if (k) out_str(out, ", ");
+				out_str(out, args[k]);
+			}
+		}
+		if (verify) {
+			int same = round_trip(text[i], addr, name, format, args, num_args,
+				symtbl, relocs[i] != NULL, text_base);
+			if (same != -1) stats->checked++;
+			if (same == 0) {
+				stats->mismatches++;
+				out_str(out, "  # round trip differs");
+			}
+		}
+		out_str(out, "\n");
+	}
+	out_flush(out);
+	free(out);
+	free(view);
+	free(labels);
+	free(relocs);
+	free(text);
+	free_table(symtbl);
+	free_table(reltbl);
+	return err;
+}
@@ -0,0 +1,20 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stdint.h>
+
+#define DISASM_BLOCK 0x10000    /* bytes read and written at a time */
+
+/* Counters of one disassemble() run. */
+typedef struct DisasmStats {
+    uint32_t words;
+    uint32_t unknown;           /* words printed as .word */
+    uint32_t checked;           /* words re-encoded by translate_inst() */
+    uint32_t mismatches;        /* ... to a different word */
+} DisasmStats;
+
+/* Disassembles an output file or raw machine code from INPUT to OUTPUT. */
+int disassemble(FILE* input, FILE* output, int64_t text_base, int verify,
+    DisasmStats* stats);
+
+#endif
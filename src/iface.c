@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "data.h"
+#include "iface.h"
+
+#define FNV_PRIME 0x100000001b3UL
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+/* Maps the whole file NAME read-only. Returns the mapping and stores its size
+   in SIZE, or returns NULL if the file cannot be opened. An empty file maps
+   to a non-NULL pointer that must not be read or unmapped.
+ */
+static void* map_file(const char* name, size_t* size) {
+	static char empty;
+	struct stat st;
+	void* map;
+	int fd = open(name, O_RDONLY);
+	if (fd == -1) return NULL;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return NULL;
+	}
+	*size = (size_t)st.st_size;
+	if (*size == 0) {
+		close(fd);
+		return &empty;
+	}
+	map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); /* The mapping stays valid */
+	return map == MAP_FAILED ? NULL : map;
+}
+
+static void write_entries(FILE* output, SymbolTable* table, uint32_t* strings_len) {
+	IfaceEntry entry;
+	Symbol* cur = table->head;
+	while ((cur = cur->next)) {
+		entry.addr = cur->addr;
+		entry.name = *strings_len;
+		fwrite(&entry, sizeof(entry), 1, output);
+		*strings_len += strlen(cur->name) + 1;
+	}
+}
+
+static void write_names(FILE* output, SymbolTable* table) {
+	Symbol* cur = table->head;
+	while ((cur = cur->next)) fwrite(cur->name, 1, strlen(cur->name) + 1, output);
+}
+
+/*******************************
+ * Interface Functions
+ *******************************/
+
+/* Continues the 64-bit FNV-1a hash HASH, which starts at IFACE_HASH_INIT,
+   over the LEN BYTES.
+ */
+uint64_t hash_bytes(uint64_t hash, const void* bytes, size_t len) {
+	const uint8_t* p = bytes;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/* Continues HASH over the contents of the file NAME, read through a single
+   mapping. Returns 0 on success and -1 if the file cannot be read.
+ */
+int hash_file(uint64_t* hash, const char* name) {
+	size_t size;
+	void* map = map_file(name, &size);
+	if (!map) return -1;
+	if (size) {
+		*hash = hash_bytes(*hash, map, size);
+		munmap(map, size);
+	}
+	return 0;
+}
+
+/* Writes the symbol interface of a module to OUTPUT: the labels of SYMTBL,
+   the .data section DATA, the size of .text it follows and the hashes that
+   tell whether the interface is still current. Together they are what pass
+   one computes, so a later pass two can start from them. Returns 0 on
+   success and -1 if the write fails.
+ */
+int write_iface(FILE* output, SymbolTable* symtbl, DataSection* data,
+	uint64_t source_hash, uint64_t inter_hash) {
+	
+	IfaceHeader header;
+	uint32_t strings_len = 0;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IFACE_MAGIC, 4);
+	header.version = IFACE_VERSION;
+	header.text_size = data->text_size;
+	header.num_symbols = symtbl->len;
+	header.num_words = data->words->len;
+	header.num_labels = data->labels->len;
+	header.data_len = data->len;
+	header.source_hash = source_hash;
+	header.inter_hash = inter_hash;
+	fwrite(&header, sizeof(header), 1, output);
+	write_entries(output, symtbl, &strings_len);
+	write_entries(output, data->words, &strings_len);
+	write_entries(output, data->labels, &strings_len);
+	fwrite(data->bytes, 1, data->len, output);
+	write_names(output, symtbl);
+	write_names(output, data->words);
+	write_names(output, data->labels);
+	header.strings_len = strings_len; /* Known now, patch it in */
+	if (fseek(output, 0, SEEK_SET) != 0) return -1;
+	fwrite(&header, sizeof(header), 1, output);
+	fseek(output, 0, SEEK_END);
+	return ferror(output) ? -1 : 0;
+}
+
+/* Maps the symbol interface file NAME and checks that its sections fit in
+   it. Returns NULL if it cannot be read or is not a valid interface file.
+ */
+Iface* load_iface(const char* name) {
+	Iface* iface;
+	const IfaceHeader* header;
+	uint64_t need;
+	size_t size;
+	void* map = map_file(name, &size);
+	if (!map) return NULL;
+	header = map;
+	if (size < sizeof(IfaceHeader) || memcmp(header->magic, IFACE_MAGIC, 4) != 0
+		|| header->version != IFACE_VERSION) {
+		if (size) munmap(map, size);
+		return NULL;
+	}
+	need = sizeof(IfaceHeader) + ((uint64_t)header->num_symbols + header->num_words
+		+ header->num_labels) * sizeof(IfaceEntry) + header->data_len + header->strings_len;
+	if (need != size || (header->strings_len
+		&& ((const char*)map)[size - 1] != '\0')) {
+		munmap(map, size);
+		return NULL;
+	}
+	iface = malloc(sizeof(Iface));
+	if (!iface) allocation_failed(NULL);
+	iface->map = map;
+	iface->size = size;
+	iface->header = header;
+	iface->entries = (const IfaceEntry*)(header + 1);
+	iface->data = (const uint8_t*)(iface->entries + header->num_symbols + header->num_words
+		+ header->num_labels);
+	iface->strings = (const char*)(iface->data + header->data_len);
+	return iface;
+}
+
+void free_iface(Iface* iface) {
+	munmap(iface->map, iface->size);
+	free(iface);
+}
+
+/* Adds the symbols of IFACE to SYMTBL and its .data section to DATA, as
+   pass one would have. The names are not checked for duplicates again.
+   Returns 0 on success and -1 if a name offset points outside the strings.
+ */
+int read_iface_tables(Iface* iface, SymbolTable* symtbl, DataSection* data) {
+	const IfaceHeader* header = iface->header;
+	uint32_t i, words = header->num_symbols + header->num_words;
+	for (i = 0; i < words + header->num_labels; i++) {
+		const IfaceEntry* entry = iface->entries + i;
+		if (entry->name >= header->strings_len) return -1;
+		if (i < header->num_symbols) {
+			append_sym(symtbl, iface->strings + entry->name, entry->addr); /* Unique when written */
+		} else if (i < words) {
+			append_sym(data->words, iface->strings + entry->name, entry->addr);
+		} else append_sym(data->labels, iface->strings + entry->name, entry->addr);
+	}
+	data->text_size = header->text_size;
+	data->len = 0;
+	if (header->data_len > data->cap) {
+		data->cap = header->data_len;
+		data->bytes = realloc(data->bytes, data->cap);
+		if (!data->bytes) allocation_failed(NULL);
+	}
+	memcpy(data->bytes, iface->data, header->data_len);
+	data->len = header->data_len;
+	return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef IFACE_H
+#define IFACE_H
+
+#include <stdint.h>
+
+#define IFACE_MAGIC "MSYM"
+#define IFACE_VERSION 2
+#define IFACE_HASH_INIT 0xcbf29ce484222325UL  /* FNV-1a offset basis */
+
+/* Header of a symbol interface file, followed by NUM_SYMBOLS + NUM_WORDS +
+   NUM_LABELS IfaceEntry records (the symbol table, then the .word labels
+   and the labels of .data), DATA_LEN bytes of .data and STRINGS_LEN bytes
+   of NUL-terminated names.
+   Fields are in host byte order: the file is a build cache, not an
+   exchange format.
+ */
+typedef struct IfaceHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t text_size;         /* in bytes */
+    uint32_t num_symbols;
+    uint32_t num_words;
+    uint32_t data_len;
+    uint32_t strings_len;
+    uint32_t num_labels;
+    uint64_t source_hash;       /* of the source and the options, see iface.c */
+    uint64_t inter_hash;        /* of the intermediate file */
+} IfaceHeader;
+
+typedef struct IfaceEntry {
+    uint32_t addr;
+    uint32_t name;              /* offset into the strings */
+} IfaceEntry;
+
+/* A symbol interface file mapped into memory. The pointers point into the
+   mapping.
+ */
+typedef struct Iface {
+    void* map;
+    size_t size;
+    const IfaceHeader* header;
+    const IfaceEntry* entries;
+    const uint8_t* data;
+    const char* strings;
+} Iface;
+
+uint64_t hash_bytes(uint64_t hash, const void* bytes, size_t len);
+
+/* Continues HASH over the contents of the file NAME. */
+int hash_file(uint64_t* hash, const char* name);
+
+/* Writes what pass one computed for a module to OUTPUT as its interface. */
+int write_iface(FILE* output, SymbolTable* symtbl, DataSection* data,
+    uint64_t source_hash, uint64_t inter_hash);
+
+/* Maps and checks the symbol interface file NAME, or returns NULL. */
+Iface* load_iface(const char* name);
+
+void free_iface(Iface* iface);
+
+/* Adds the symbols and .data section of IFACE to SYMTBL and DATA. */
+int read_iface_tables(Iface* iface, SymbolTable* symtbl, DataSection* data);
+
+#endif
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate_utils.h"
+#include "ir.h"
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+static char* copy_string(LogCapture* log, const char* str) {
+	char* copy = malloc(strlen(str)+1);
+	if (!copy) allocation_failed(log);
+	strcpy(copy, str);
+	return copy;
+}
+
+/* Returns the bit for register STR, or 0 (and sets *BAD) if it is invalid. */
+static uint32_t reg_bit(const char* str, int* bad) {
+	int reg = translate_reg(str);
+	if (reg == -1) {
+		*bad = 1;
+		return 0;
+	}
+	return (uint32_t)1 << reg;
+}
+
+/*******************************
+ * Instruction List Functions
+ *******************************/
+
+/* Creates a new InstList containing 0 instructions. The passes over it log
+   to LOG, and allocation failures go there too.
+ */
+InstList* create_inst_list(LogCapture* log) {
+	InstList* list = malloc(sizeof(InstList));
+	if (!list) allocation_failed(log);
+	list->cap = 64; /* Grows by doubling in append_inst() */
+	list->len = 0;
+	list->log = log;
+	list->insts = malloc(list->cap * sizeof(Inst));
+	if (!list->insts) {
+		free(list);
+		allocation_failed(log);
+	}
+	return list;
+}
+
+/* Frees the given InstList and all strings it owns. */
+void free_inst_list(InstList* list) {
+	uint32_t i;
+	int j;
+	for (i = 0; i < list->len; i++) {
+		free(list->insts[i].name);
+		for (j = 0; j < list->insts[i].num_args; j++) free(list->insts[i].args[j]);
+	}
+	free(list->insts);
+	free(list);
+}
+
+/* Appends a copy of the instruction NAME ARGS, which comes from source line
+   LINE, to the end of LIST. NUM_ARGS must not exceed INST_MAX_ARGS. If an
+   allocation fails, LIST can still be freed.
+ */
+void append_inst(InstList* list, const char* name, char** args, int num_args,
+	uint32_t line) {
+	Inst* inst;
+	int i;
+	if (list->len == list->cap) { /* Full, double the capacity */
+		Inst* insts = realloc(list->insts, 2 * list->cap * sizeof(Inst));
+		if (!insts) allocation_failed(list->log);
+		list->insts = insts;
+		list->cap *= 2;
+	}
+	inst = &list->insts[list->len];
+	inst->name = copy_string(list->log, name);
+	inst->num_args = 0;
+	inst->line = line;
+	list->len++;
+	for (i = 0; i < num_args; i++) {
+		inst->args[i] = copy_string(list->log, args[i]);
+		inst->num_args = i + 1;
+	}
+}
+
+/* Exchanges the contents of A and B. Passes build their result in a fresh
+   list and swap it in, so the old instructions are freed with the other one.
+ */
+void swap_inst_lists(InstList* a, InstList* b) {
+	InstList tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+/* Writes LIST to OUTPUT in the intermediate file format, one instruction per
+   line, exactly as write_pass_one() would have. Source lines are written as
+   .loc directives, like pass_one() does, wherever the line changes.
+ */
+void write_inst_list(InstList* list, FILE* output) {
+	uint32_t i, line = 0;
+	char buf[16];
+	char* loc_args[1];
+	loc_args[0] = buf;
+	for (i = 0; i < list->len; i++) {
+		if (list->insts[i].line && list->insts[i].line != line) {
+			line = list->insts[i].line;
+			sprintf(buf, "%u", line);
+			write_inst_string(output, ".loc", loc_args, 1);
+		}
+		write_inst_string(output, list->insts[i].name, list->insts[i].args, list->insts[i].num_args);
+	}
+}
+
+/* Fills INFO with the kind and register effects of INST. The operand order
+   is the one translate_inst() expects. Instructions that translate_inst()
+   would reject come out as INST_OTHER, which passes must leave in place.
+ */
+void decode_inst(const Inst* inst, InstInfo* info) {
+	const char* name = inst->name;
+	char* const* args = inst->args;
+	int n = inst->num_args, bad = 0;
+	info->kind = INST_OTHER;
+	info->defs = info->uses = 0;
+	if ((strcmp(name, "addu") == 0 || strcmp(name, "or") == 0 || strcmp(name, "slt") == 0
+		|| strcmp(name, "sltu") == 0) && n == 3) {
+		info->kind = INST_ALU; /* rd, rs, rt */
+		info->defs = reg_bit(args[0], &bad);
+		info->uses = reg_bit(args[1], &bad) | reg_bit(args[2], &bad);
+	} else if ((strcmp(name, "sll") == 0 || strcmp(name, "addiu") == 0
+		|| strcmp(name, "ori") == 0) && n == 3) {
+		info->kind = INST_ALU; /* rd/rt, rs/rt, imm */
+		info->defs = reg_bit(args[0], &bad);
+		info->uses = reg_bit(args[1], &bad);
+	} else if (strcmp(name, "lui") == 0 && n == 2) {
+		info->kind = INST_ALU;
+		info->defs = reg_bit(args[0], &bad);
+	} else if ((strcmp(name, "lb") == 0 || strcmp(name, "lbu") == 0
+		|| strcmp(name, "lw") == 0) && n == 3) {
+		info->kind = INST_LOAD; /* rt, offset, rs */
+		info->defs = reg_bit(args[0], &bad);
+		info->uses = reg_bit(args[2], &bad);
+	} else if ((strcmp(name, "sb") == 0 || strcmp(name, "sw") == 0) && n == 3) {
+		info->kind = INST_STORE;
+		info->uses = reg_bit(args[0], &bad) | reg_bit(args[2], &bad);
+	} else if ((strcmp(name, "beq") == 0 || strcmp(name, "bne") == 0) && n == 3) {
+		info->kind = INST_BRANCH;
+		info->uses = reg_bit(args[0], &bad) | reg_bit(args[1], &bad);
+	} else if (strcmp(name, "jr") == 0 && n == 1) {
+		info->kind = INST_JR;
+		info->uses = reg_bit(args[0], &bad);
+	} else if (strcmp(name, "j") == 0 && n == 1) {
+		info->kind = INST_JUMP;
+	} else if (strcmp(name, "jal") == 0 && n == 1) {
+		info->kind = INST_CALL;
+		info->defs = (uint32_t)1 << 31; /* $ra */
+	}
+	if (bad) {
+		info->kind = INST_OTHER;
+		info->defs = info->uses = 0;
+	}
+	info->defs &= ~(uint32_t)1; /* Writes to $0 are discarded */
+}
+
+/* Returns 1 if A and B are the same instruction, treating different names
+   of the same register (e.g. $at and $1) as equal, and 0 otherwise.
+ */
+int same_inst(const Inst* a, const Inst* b) {
+	int i, ra, rb;
+	if (strcmp(a->name, b->name) != 0 || a->num_args != b->num_args) return 0;
+	for (i = 0; i < a->num_args; i++) {
+		ra = translate_reg(a->args[i]);
+		rb = translate_reg(b->args[i]);
+		if (ra != rb) return 0;
+		if (ra == -1 && strcmp(a->args[i], b->args[i]) != 0) return 0;
+	}
+	return 1;
+}
+
+/* Returns 1 if LIST has a branch whose target is a numeric offset rather
+   than a label. Such offsets count instructions, so passes that move or
+   delete code leave these lists alone.
+ */
+int has_relative_branches(InstList* list) {
+	uint32_t i;
+	for (i = 0; i < list->len; i++) {
+		Inst* inst = &list->insts[i];
+		if ((strcmp(inst->name, "beq") == 0 || strcmp(inst->name, "bne") == 0)
+			&& inst->num_args == 3 && !is_valid_label(inst->args[2])) return 1;
+	}
+	return 0;
+}
+
+/* Returns a newly allocated array of LIST->LEN + 1 flags, where entry I is 1
+   if some label in SYMTBL points at instruction I, i.e. control may enter
+   there from elsewhere. The caller frees it.
+ */
+char* find_leaders(InstList* list, SymbolTable* symtbl) {
+	Symbol* cur = symtbl->head;
+	char* leaders = calloc(list->len + 1, 1);
+	if (!leaders) allocation_failed(list->log);
+	while ((cur = cur->next)) {
+		if (cur->addr / 4 <= list->len) leaders[cur->addr / 4] = 1;
+	}
+	return leaders;
+}
+
+/* Removes every instruction I of LIST with DEAD[I] set, and moves the labels
+   of SYMTBL along. A label on a removed instruction moves to the next one
+   that is kept.
+ */
+void delete_insts(InstList* list, const char* dead, SymbolTable* symtbl) {
+	uint32_t i, j = 0;
+	int k;
+	uint32_t* new_index = malloc((list->len + 1) * sizeof(uint32_t));
+	if (!new_index) allocation_failed(list->log);
+	for (i = 0; i < list->len; i++) {
+		new_index[i] = j;
+		if (dead[i]) {
+			free(list->insts[i].name);
+			for (k = 0; k < list->insts[i].num_args; k++) free(list->insts[i].args[k]);
+		} else {
+			list->insts[j++] = list->insts[i];
+		}
+	}
+	new_index[list->len] = j;
+	remap_symbols(symtbl, new_index, list->len);
+	list->len = j;
+	free(new_index);
+}
+
+/* Moves every symbol of SYMTBL after a pass rewrote the instruction list.
+   NEW_INDEX[I] is the new index of the instruction that used to be at index
+   I, for 0 <= I <= OLD_LEN (the extra entry is the end of the list, which is
+   where a trailing label points). A deleted instruction should map to the
+   new index of the next surviving one.
+ */
+void remap_symbols(SymbolTable* symtbl, const uint32_t* new_index, uint32_t old_len) {
+	Symbol* cur = symtbl->head;
+	while ((cur = cur->next)) {
+		if (cur->addr / 4 <= old_len) cur->addr = 4 * new_index[cur->addr / 4];
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdint.h>
+
+#define INST_MAX_ARGS 3     /* same as MAX_ARGS in assembler.h */
+
+/* In-memory form of the intermediate file: one entry per real instruction,
+   in program order, so that the instruction at index I lives at byte offset
+   4 * I. Labels stay in the symbol table as byte offsets and are moved with
+   remap_symbols() whenever a pass inserts or deletes instructions.
+ */
+typedef struct Inst {
+    char* name;
+    char* args[INST_MAX_ARGS];
+    int num_args;
+    uint32_t line;          /* source line, 0 if unknown */
+} Inst;
+
+/* What an instruction does to control flow and registers, see decode_inst().
+   Register sets are bitmasks over $0..$31, with $0 never in DEFS.
+ */
+#define INST_OTHER  0       /* unknown or invalid, left for pass two */
+#define INST_ALU    1       /* pure register computation */
+#define INST_LOAD   2
+#define INST_STORE  3
+#define INST_BRANCH 4       /* beq, bne */
+#define INST_JUMP   5       /* j */
+#define INST_CALL   6       /* jal */
+#define INST_JR     7
+
+typedef struct InstInfo {
+    int kind;
+    uint32_t defs;
+    uint32_t uses;
+} InstInfo;
+
+typedef struct InstList {
+    Inst* insts;
+    uint32_t len;
+    uint32_t cap;
+    struct LogCapture* log;     /* see create_inst_list() */
+} InstList;
+
+InstList* create_inst_list(struct LogCapture* log);
+
+void free_inst_list(InstList* list);
+
+void append_inst(InstList* list, const char* name, char** args, int num_args,
+    uint32_t line);
+
+void swap_inst_lists(InstList* a, InstList* b);
+
+void write_inst_list(InstList* list, FILE* output);
+
+void decode_inst(const Inst* inst, InstInfo* info);
+
+int same_inst(const Inst* a, const Inst* b);
+
+int has_relative_branches(InstList* list);
+
+char* find_leaders(InstList* list, SymbolTable* symtbl);
+
+void delete_insts(InstList* list, const char* dead, SymbolTable* symtbl);
+
+void remap_symbols(SymbolTable* symtbl, const uint32_t* new_index, uint32_t old_len);
+
+#endif
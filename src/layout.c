@@ -0,0 +1,367 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "translate_utils.h"
+#include "ir.h"
+#include "layout.h"
+
+#define LINE_SIZE 1024
+
+/* A basic block: instructions [START, END) of the list. TERM is the kind of
+   its last instruction if that is a branch, j or jr, and INST_OTHER if the
+   block falls through. TARGET and FALL are block indices of the successors,
+   -1 for none (or an external label) and the number of blocks for the end
+   of the code.
+ */
+typedef struct Block {
+	uint32_t start;
+	uint32_t end;
+	int term;
+	int32_t target;
+	int32_t fall;
+	uint64_t count;
+	uint64_t taken;
+	int32_t next;           /* chain links */
+	int32_t prev;
+	int32_t head;           /* first block of the chain */
+} Block;
+
+typedef struct Edge {
+	int32_t src;
+	int32_t dst;
+	uint64_t weight;
+	int fall;               /* the edge is the original fall-through */
+} Edge;
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+static int compare_edges(const void* a, const void* b) {
+	const Edge* x = a;
+	const Edge* y = b;
+	if (x->weight != y->weight) return x->weight < y->weight ? 1 : -1;
+	if (x->fall != y->fall) return y->fall - x->fall;
+	return x->src - y->src;
+}
+
+/* Returns the block index of the label LABEL, or -1 if it is not defined or
+   marks the end of the code (then the transfer is left alone).
+ */
+static int32_t label_block(const char* label, SymbolTable* symtbl, const int32_t* block_of,
+	uint32_t len) {
+	
+	int64_t addr = get_addr_for_symbol(symtbl, label);
+	return addr == -1 || addr / 4 >= len ? -1 : block_of[addr / 4];
+}
+
+/* Splits LIST into blocks and fills in their successors and counts. Returns
+   the array of blocks and stores their number in NUM_BLOCKS.
+ */
+static Block* find_blocks(InstList* list, SymbolTable* symtbl, Profile* prof,
+	uint32_t* num_blocks, int32_t* block_of) {
+	
+	uint32_t i, n = 0;
+	InstInfo info;
+	char* leaders = find_leaders(list, symtbl);
+	Block* blocks;
+	leaders[0] = 1;
+	for (i = 0; i + 1 < list->len; i++) {
+		decode_inst(&list->insts[i], &info);
+		if (info.kind == INST_BRANCH || info.kind == INST_JUMP || info.kind == INST_JR) leaders[i + 1] = 1;
+	}
+	for (i = 0; i < list->len; i++) n += leaders[i];
+	blocks = malloc((n + 1) * sizeof(Block));
+	if (!blocks) allocation_failed(list->log);
+	for (i = 0, n = 0; i < list->len; i++) { /* Ranges */
+		if (leaders[i]) {
+			if (n) blocks[n - 1].end = i;
+			blocks[n].start = i;
+			n++;
+		}
+		block_of[i] = n - 1;
+	}
+	if (n) blocks[n - 1].end = list->len;
+	block_of[list->len] = n; /* The end of the code */
+	for (i = 0; i < n; i++) { /* Successors */
+		Block* b = &blocks[i];
+		Inst* last = &list->insts[b->end - 1];
+		decode_inst(last, &info);
+		b->term = INST_OTHER;
+		b->target = -1;
+		b->fall = block_of[b->end];
+		b->count = prof->counts[b->start];
+		b->taken = 0;
+		b->next = b->prev = -1;
+		b->head = i;
+		if (info.kind == INST_BRANCH) {
+			b->term = INST_BRANCH;
+			b->target = label_block(last->args[2], symtbl, block_of, list->len);
+			b->count = prof->counts[b->end - 1];
+			b->taken = prof->taken[b->end - 1];
+			if (b->taken > b->count) b->taken = b->count;
+		} else if (info.kind == INST_JUMP) {
+			b->term = INST_JUMP;
+			b->target = label_block(last->args[0], symtbl, block_of, list->len);
+			b->fall = -1;
+		} else if (info.kind == INST_JR) {
+			b->term = INST_JR;
+			b->fall = -1;
+		}
+	}
+	free(leaders);
+	*num_blocks = n;
+	return blocks;
+}
+
+/* Joins blocks into chains along the heaviest edges first, so that the hot
+   successor of each block is placed right after it. A chain only grows at
+   its ends, the entry block stays a chain head, the block that runs off the
+   end of the code stays a chain tail, and the two stay in different chains,
+   since they must be placed first and last.
+ */
+static void build_chains(Block* blocks, uint32_t n) {
+	uint32_t i, num_edges = 0;
+	int32_t falloff = -1;
+	uint32_t* size = malloc((n + 1) * sizeof(uint32_t));
+	Edge* edges = malloc((2 * n + 1) * sizeof(Edge));
+	if (!size || !edges) allocation_failed(NULL); /* Only the command line lays out blocks */
+	for (i = 0; i < n; i++) {
+		Block* b = &blocks[i];
+		size[i] = 1;
+		if (b->fall == (int32_t)n) falloff = i;
+		if (b->target >= 0 && b->target < (int32_t)n) {
+			uint64_t w = b->term == INST_BRANCH ? b->taken : b->count;
+			if (w) {
+				edges[num_edges].src = i;
+				edges[num_edges].dst = b->target;
+				edges[num_edges].weight = w;
+				edges[num_edges++].fall = 0;
+			}
+		}
+		if (b->fall >= 0 && b->fall < (int32_t)n) {
+			edges[num_edges].src = i;
+			edges[num_edges].dst = b->fall;
+			edges[num_edges].weight = b->term == INST_BRANCH ? b->count - b->taken : b->count;
+			edges[num_edges++].fall = 1;
+		}
+	}
+	qsort(edges, num_edges, sizeof(Edge), compare_edges);
+	for (i = 0; i < num_edges; i++) {
+		int32_t src = edges[i].src, dst = edges[i].dst;
+		int32_t a = blocks[src].head, b = blocks[dst].head, k;
+		int has_entry, has_falloff;
+		if (blocks[src].next != -1 || b != dst || a == b || dst == 0 || src == falloff) continue;
+		has_entry = a == 0 || b == 0;
+		has_falloff = falloff != -1 && (blocks[falloff].head == a || blocks[falloff].head == b);
+		if (has_entry && has_falloff && size[a] + size[b] < n) continue;
+		blocks[src].next = dst; /* Append chain B to chain A */
+		blocks[dst].prev = src;
+		for (k = dst; k != -1; k = blocks[k].next) blocks[k].head = a;
+		size[a] += size[b];
+	}
+	free(size);
+	free(edges);
+}
+
+/* Returns the name of a label at the start of block B, adding one to SYMTBL
+   if there is none yet.
+ */
+static const char* block_label(Block* b, SymbolTable* symtbl, char* buf) {
+	Symbol* cur = symtbl->head;
+	uint32_t k = 0;
+	while ((cur = cur->next)) {
+		if (cur->addr == 4 * b->start) return cur->name;
+	}
+	do sprintf(buf, "__layout_%u", k++); while (get_addr_for_symbol(symtbl, buf) != -1);
+	add_to_table(symtbl, buf, 4 * b->start);
+	return buf;
+}
+
+static void append_jump(InstList* out, const char* label, uint32_t line) {
+	char* args[1];
+	args[0] = (char*)label;
+	append_inst(out, "j", args, 1, line);
+}
+
+/* Emits block B of LIST into OUT, with NEXT being the block placed after it
+   (the number of blocks if none), and fixes up its last instruction so that
+   control still reaches the same successors. Adds to TAKEN the number of
+   taken transfers the block makes according to the profile.
+ */
+static void emit_block(InstList* list, InstList* out, Block* blocks, int32_t b_idx,
+	int32_t next, uint32_t* new_index, SymbolTable* symtbl, uint64_t* taken) {
+	
+	Block* b = &blocks[b_idx];
+	Inst* last = &list->insts[b->end - 1];
+	uint32_t i, end = b->end;
+	char buf[32];
+	if (b->term != INST_OTHER) end--; /* Terminator handled below */
+	for (i = b->start; i < end; i++) {
+		Inst* inst = &list->insts[i];
+		new_index[i] = out->len;
+		append_inst(out, inst->name, inst->args, inst->num_args, inst->line);
+	}
+	if (b->term != INST_OTHER) new_index[b->end - 1] = out->len;
+	if (b->term == INST_BRANCH) {
+		if (b->fall == next || b->target == -1 || b->fall == b->target) {
+			append_inst(out, last->name, last->args, 3, last->line);
+			*taken += b->taken;
+			if (b->fall != next) {
+				append_jump(out, block_label(&blocks[b->fall], symtbl, buf), last->line);
+				*taken += b->count - b->taken;
+			}
+		} else if (b->target == next) { /* Invert, the hot side falls through */
+			char* args[3];
+			args[0] = last->args[0];
+			args[1] = last->args[1];
+			args[2] = (char*)block_label(&blocks[b->fall], symtbl, buf);
+			append_inst(out, strcmp(last->name, "beq") == 0 ? "bne" : "beq", args, 3, last->line);
+			*taken += b->count - b->taken;
+		} else {
+			append_inst(out, last->name, last->args, 3, last->line);
+			append_jump(out, block_label(&blocks[b->fall], symtbl, buf), last->line);
+			*taken += b->count;
+		}
+	} else if (b->term == INST_JUMP) {
+		if (b->target != next) {
+			append_inst(out, last->name, last->args, 1, last->line);
+			*taken += b->count;
+		}
+	} else if (b->term == INST_JR) {
+		append_inst(out, last->name, last->args, 1, last->line);
+	} else if (b->fall != next && b->fall >= 0) {
+		append_jump(out, block_label(&blocks[b->fall], symtbl, buf), last->line);
+		*taken += b->count;
+	}
+}
+
+/* Returns the number of taken transfers of LIST in source order according to
+   its blocks and the profile.
+ */
+static uint64_t count_taken(Block* blocks, uint32_t n) {
+	uint32_t i;
+	uint64_t taken = 0;
+	for (i = 0; i < n; i++) {
+		if (blocks[i].term == INST_BRANCH) taken += blocks[i].taken;
+		else if (blocks[i].term == INST_JUMP) taken += blocks[i].count;
+	}
+	return taken;
+}
+
+/*******************************
+ * Profile-Guided Layout
+ *******************************/
+
+/* Reads a branch profile for LIST from INPUT. Each line is
+
+	<label>[+<byte offset>] <executions> [<taken>]
+
+   for the instruction at that offset from a label of SYMTBL, as written by
+   `-prof ... -counts`. Anything after '#' is a comment, and lines naming
+   unknown labels are skipped. Returns NULL if a line is malformed.
+ */
+Profile* read_profile(FILE* input, InstList* list, SymbolTable* symtbl) {
+	char buf[LINE_SIZE];
+	uint32_t line = 0;
+	Profile* prof = malloc(sizeof(Profile));
+	if (!prof) allocation_failed(list->log);
+	prof->counts = calloc(list->len + 1, sizeof(uint64_t));
+	prof->taken = calloc(list->len + 1, sizeof(uint64_t));
+	if (!prof->counts || !prof->taken) allocation_failed(list->log);
+	while (fgets(buf, LINE_SIZE, input)) {
+		char *loc, *count, *taken, *plus, *endptr, *save;
+		unsigned long offset = 0;
+		int64_t addr;
+		line++;
+		buf[strcspn(buf, "#\r\n")] = '\0';
+		loc = strtok_r(buf, " \t", &save);
+		if (!loc) continue;
+		count = strtok_r(NULL, " \t", &save);
+		taken = strtok_r(NULL, " \t", &save);
+		if (!count) {
+			write_to_log("Error - invalid profile at line %u\n", line);
+			free_profile(prof);
+			return NULL;
+		}
+		if ((plus = strchr(loc, '+'))) {
+			*plus = '\0';
+			offset = strtoul(plus + 1, &endptr, 0);
+		}
+		addr = get_addr_for_symbol(symtbl, loc);
+		if (addr == -1 || (addr + offset) / 4 >= list->len) continue;
+		prof->counts[(addr + offset) / 4] = strtoul(count, &endptr, 10);
+		if (taken) prof->taken[(addr + offset) / 4] = strtoul(taken, &endptr, 10);
+	}
+	return prof;
+}
+
+void free_profile(Profile* prof) {
+	free(prof->counts);
+	free(prof->taken);
+	free(prof);
+}
+
+/* Reorders the basic blocks of LIST so that, according to PROF, hot paths
+   fall through instead of taking a branch or jump:
+	1. blocks are chained along their heaviest edges (see build_chains()).
+	2. chains are placed with the entry first, the block that runs off the
+		end of the code last, and the rest in source order.
+	3. each block is fixed up for its new neighbour: a beq/bne whose target
+		now follows is inverted, a j to the next block is dropped, and a j
+		is added where the old fall-through successor moved away.
+   Labels move with their blocks; blocks that need a label for a new branch
+   or jump get a __layout_<n> one in SYMTBL. TAKEN_BEFORE and TAKEN_AFTER
+   receive the number of taken branches and jumps the profile predicts for
+   the old and the new order.
+ */
+void layout_blocks(InstList* list, SymbolTable* symtbl, Profile* prof,
+	uint64_t* taken_before, uint64_t* taken_after) {
+	
+	uint32_t n, i, k = 0;
+	int32_t b, *order, *block_of, falloff_head = -1;
+	uint32_t* new_index;
+	InstList* out;
+	Block* blocks;
+	*taken_before = *taken_after = 0;
+	if (!list->len) return;
+	block_of = malloc((list->len + 1) * sizeof(int32_t));
+	new_index = malloc((list->len + 1) * sizeof(uint32_t));
+	if (!block_of || !new_index) allocation_failed(list->log);
+	blocks = find_blocks(list, symtbl, prof, &n, block_of);
+	order = malloc(n * sizeof(int32_t));
+	if (!order) allocation_failed(list->log);
+	*taken_before = count_taken(blocks, n);
+	build_chains(blocks, n);
+  /* Entry chain first, the chain running off the end last */
+	for (i = 0; i < n; i++) {
+		if (blocks[i].fall == (int32_t)n) falloff_head = blocks[i].head;
+	}
+	for (b = 0; b != -1; b = blocks[b].next) order[k++] = b;
+	for (i = 1; i < n; i++) {
+		if (blocks[i].head != (int32_t)i || (int32_t)i == falloff_head || blocks[i].head == 0) continue;
+		for (b = i; b != -1; b = blocks[b].next) order[k++] = b;
+	}
+	if (falloff_head > 0) {
+		for (b = falloff_head; b != -1; b = blocks[b].next) order[k++] = b;
+	}
+  /* Emit and fix up */
+	out = create_inst_list(list->log);
+	for (i = 0; i < n; i++) {
+		emit_block(list, out, blocks, order[i], i + 1 < n ? order[i + 1] : (int32_t)n,
+			new_index, symtbl, taken_after);
+	}
+	new_index[list->len] = out->len;
+	remap_symbols(symtbl, new_index, list->len);
+	swap_inst_lists(list, out);
+	free_inst_list(out);
+	free(blocks);
+	free(order);
+	free(block_of);
+	free(new_index);
+}
@@ -0,0 +1,21 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdint.h>
+
+/* Branch profile of an instruction list, indexed by instruction. */
+typedef struct Profile {
+    uint64_t* counts;       /* executions */
+    uint64_t* taken;        /* taken transfers */
+} Profile;
+
+/* Reads a branch profile for LIST from INPUT. Returns NULL if malformed. */
+Profile* read_profile(FILE* input, InstList* list, SymbolTable* symtbl);
+
+void free_profile(Profile* prof);
+
+/* Reorders the basic blocks of LIST so that hot paths of PROF fall through. */
+void layout_blocks(InstList* list, SymbolTable* symtbl, Profile* prof,
+    uint64_t* taken_before, uint64_t* taken_after);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "data.h"
+#include "translate.h"
+#include "iface.h"
+#include "memo.h"
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+/* Writes "NAME ARGS..." into KEY. Returns its length with the NUL, or 0 if it
+   does not fit in MEMO_KEY_SIZE.
+ */
+static size_t make_key(char* key, const char* name, char** args, size_t num_args) {
+	size_t len = strlen(name), i, n;
+	if (len >= MEMO_KEY_SIZE) return 0;
+	memcpy(key, name, len);
+	for (i = 0; i < num_args; i++) {
+		n = strlen(args[i]);
+		if (len + 1 + n >= MEMO_KEY_SIZE) return 0;
+		key[len++] = ' ';
+		memcpy(key + len, args[i], n);
+		len += n;
+	}
+	key[len++] = '\0';
+	return len;
+}
+
+/* Returns whether NAME with ARGS encodes to the same word at any address:
+   everything but branches, jumps, and lui and ori of a label.
+ */
+static int is_position_independent(const char* name, char** args, size_t num_args) {
+	const InstEncoding* enc;
+	for (enc = INST_ENCODINGS; enc->name; enc++) {
+		if (strcmp(name, enc->name) == 0) break;
+	}
+	switch (enc->format) {
+		case FMT_RTYPE:
+		case FMT_SHIFT:
+		case FMT_JR:
+		case FMT_ADDIU:
+		case FMT_MEM:    return 1;
+		case FMT_ORI:
+		case FMT_LUI:    return num_args && (isdigit((unsigned char)args[num_args - 1][0])
+		                     || args[num_args - 1][0] == '-'); /* Labels start otherwise */
+		default:         return 0;
+	}
+}
+
+/*******************************
+ * Memo Functions
+ *******************************/
+
+EncodingMemo* create_memo(LogCapture* log) {
+	EncodingMemo* memo = malloc(sizeof(EncodingMemo));
+	if (!memo) allocation_failed(log);
+	memo->slots = calloc(MEMO_SLOTS, sizeof(MemoEntry));
+	if (!memo->slots) {
+		free(memo);
+		allocation_failed(log);
+	}
+	memo->pending = NULL;
+	memo->lookups = 0;
+	memo->hits = 0;
+	return memo;
+}
+
+void free_memo(EncodingMemo* memo) {
+	free(memo->slots);
+	free(memo);
+}
+
+/* Looks up the word NAME with ARGS encodes to. Returns 1 and stores it in WORD
+   on a hit. On a miss, returns 0 and the caller should encode the
+   instruction and pass the word to remember_encoding(). Returns -1, without
+   counting a lookup, if the instruction is not memoizable: it depends on its
+   address or the symbol table, or its operands are too long for a key.
+ */
+int lookup_encoding(EncodingMemo* memo, const char* name, char** args, size_t num_args,
+	uint32_t* word) {
+	
+	char key[MEMO_KEY_SIZE];
+	uint64_t hash;
+	MemoEntry* entry;
+	size_t len = make_key(key, name, args, num_args);
+	memo->pending = NULL;
+	if (!len) return -1;
+	hash = hash_bytes(IFACE_HASH_INIT, key, len);
+	entry = memo->slots + (hash & (MEMO_SLOTS - 1));
+	if (entry->valid && entry->hash == hash && memcmp(entry->key, key, len) == 0) {
+		memo->lookups++;
+		memo->hits++;
+		*word = entry->word;
+		return 1;
+	}
+	if (!is_position_independent(name, args, num_args)) return -1;
+	memo->lookups++;
+	entry->valid = 0; /* Until the word is known */
+	entry->hash = hash;
+	memcpy(entry->key, key, len);
+	memo->pending = entry;
+	return 0;
+}
+
+/* Stores WORD for the instruction of the last lookup_encoding() miss, once it
+   was encoded successfully.
+ */
+void remember_encoding(EncodingMemo* memo, uint32_t word) {
+	if (!memo->pending) return;
+	memo->pending->word = word;
+	memo->pending->valid = 1;
+	memo->pending = NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stdint.h>
+
+#define MEMO_SLOTS 4096         /* entries, a power of two */
+#define MEMO_KEY_SIZE 48        /* longest "name args" key kept, with its NUL */
+
+typedef struct MemoEntry {
+    uint64_t hash;
+    uint32_t word;
+    int valid;                  /* WORD is known */
+    char key[MEMO_KEY_SIZE];
+} MemoEntry;
+
+/* Finished machine words of instructions that encode the same wherever they
+   are, keyed by their name and operands as written. Direct-mapped: a new
+   entry replaces whatever shared its slot, so the memo never grows.
+ */
+typedef struct EncodingMemo {
+    MemoEntry* slots;
+    MemoEntry* pending;         /* slot of the last miss, see remember_encoding() */
+    uint64_t lookups;           /* of memoizable instructions */
+    uint64_t hits;
+} EncodingMemo;
+
+EncodingMemo* create_memo(struct LogCapture* log);
+
+void free_memo(EncodingMemo* memo);
+
+/* Looks up the word NAME with ARGS encodes to. Returns 1 on a hit, 0 on a miss
+   and -1 if it cannot be memoized.
+ */
+int lookup_encoding(EncodingMemo* memo, const char* name, char** args, size_t num_args,
+    uint32_t* word);
+
+/* Stores WORD for the instruction of the last miss. */
+void remember_encoding(EncodingMemo* memo, uint32_t word);
+
+#endif
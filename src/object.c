@@ -0,0 +1,282 @@
+#define _POSIX_C_SOURCE 200809L /* getline() */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "object.h"
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+static void append_word(Object* obj, uint32_t* cap, uint32_t word, LogCapture* log) {
+	if (obj->text_len == *cap) { /* Full, double the capacity */
+		uint32_t* text = realloc(obj->text, 2 * *cap * sizeof(uint32_t));
+		if (!text) allocation_failed(log);
+		obj->text = text;
+		*cap *= 2;
+	}
+	obj->text[obj->text_len++] = word;
+}
+
+/* Appends the hex bytes of a .data line to OBJ. Returns 0 on success and -1
+   on error.
+ */
+static int read_data(char* line, Object* obj, uint32_t* cap, LogCapture* log) {
+	char pair[3];
+	char* endptr;
+	size_t len = strcspn(line, "\r\n");
+	if (!len || len % 2) return -1;
+	pair[2] = '\0';
+	for (; len; len -= 2, line += 2) {
+		if (obj->data_len == *cap) {
+			uint8_t* data = realloc(obj->data, 2 * *cap);
+			if (!data) allocation_failed(log);
+			obj->data = data;
+			*cap *= 2;
+		}
+		pair[0] = line[0];
+		pair[1] = line[1];
+		obj->data[obj->data_len++] = (uint8_t)strtoul(pair, &endptr, 16);
+		if (*endptr) return -1;
+	}
+	return 0;
+}
+
+/* Parses a "<addr>\t<name>" line of a .symbol or .relocation section into
+   TABLE. The names of a .symbol section were unique when it was written, and
+   data labels need not be aligned, so it is appended as it is, to a table
+   that does not check names either. Returns 0 on
+   success and -1 on error.
+ */
+static int read_sym(char* line, SymbolTable* table) {
+	char* endptr;
+	char* name;
+	unsigned long addr = strtoul(line, &endptr, 10);
+	if (endptr == line || *endptr != '\t') return -1;
+	name = endptr + 1;
+	name[strcspn(name, "\r\n")] = '\0';
+	append_sym(table, name, (uint32_t)addr);
+	return 0;
+}
+
+/* Parses a "<addr>\t<line>" line of a .line section into TABLE. Returns 0 on
+   success and -1 on error.
+ */
+static int read_line(char* line, LineTable* table) {
+	char* endptr;
+	char* rest;
+	unsigned long addr = strtoul(line, &endptr, 10);
+	if (endptr == line || *endptr != '\t') return -1;
+	rest = endptr + 1;
+	add_line(table, (uint32_t)addr, (uint32_t)strtoul(rest, &endptr, 10));
+	return endptr == rest ? -1 : 0;
+}
+
+static int compare_name_addr(const void* a, const void* b) {
+	const Symbol* x = *(Symbol* const*)a;
+	const Symbol* y = *(Symbol* const*)b;
+	int c = strcmp(x->name, y->name);
+	return c ? c : (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/* Returns a newly allocated array of the symbols of TABLE sorted by name,
+   for find_by_name(). The symbols stay owned by TABLE.
+ */
+static Symbol** sort_by_name(SymbolTable* table) {
+	Symbol** view = malloc((table->len + 1) * sizeof(Symbol*));
+	Symbol* cur = table->head;
+	uint32_t i = 0;
+	if (!view) allocation_failed(table->log);
+	while ((cur = cur->next)) view[i++] = cur;
+	qsort(view, table->len, sizeof(Symbol*), compare_name_addr);
+	return view;
+}
+
+/* Binary searches VIEW, LEN symbols sorted by sort_by_name(), for NAME.
+   Returns the address of its first symbol, or -1 if there is none.
+ */
+static int64_t find_by_name(Symbol** view, uint32_t len, const char* name) {
+	uint32_t lo = 0, hi = len; /* First symbol not before NAME is view[lo] */
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (strcmp(view[mid]->name, name) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo < len && strcmp(view[lo]->name, name) == 0 ? (int64_t)view[lo]->addr : -1;
+}
+
+/*******************************
+ * Object File Functions
+ *******************************/
+
+/* Writes RELTBL to OUTPUT as the lines of a .relgroup section: the sites of
+   each symbol under its name once, sorted, as "<name>\t<site>,<delta>,..."
+   where each delta is the distance in bytes from the previous site. Groups
+   longer than RELGROUP_LINE characters go on to another line, which starts
+   again from an absolute site.
+ */
+void write_reloc_groups(SymbolTable* reltbl, FILE* output) {
+	Symbol** sites = malloc((reltbl->len + 1) * sizeof(Symbol*));
+	Symbol* cur = reltbl->head;
+	uint32_t i = 0, prev = 0;
+	int len = 0;
+	if (!sites) allocation_failed(reltbl->log);
+	while ((cur = cur->next)) sites[i++] = cur;
+	qsort(sites, reltbl->len, sizeof(Symbol*), compare_name_addr);
+	for (i = 0; i < reltbl->len; i++) {
+		if (len && strcmp(sites[i]->name, sites[i - 1]->name) == 0 && len < RELGROUP_LINE) {
+			len += fprintf(output, ",%u", sites[i]->addr - prev);
+		} else {
+			if (len) fputc('\n', output);
+			len = fprintf(output, "%s\t%u", sites[i]->name, sites[i]->addr);
+		}
+		prev = sites[i]->addr;
+	}
+	if (len) fputc('\n', output);
+	free(sites);
+}
+
+/* Parses a line of a .relgroup section, see write_reloc_groups(), into
+   RELTBL: one relocation per site. LINE is modified. Returns 0 on success
+   and -1 on error.
+ */
+int read_reloc_group(char* line, SymbolTable* reltbl) {
+	char* p = strchr(line, '\t');
+	char* endptr;
+	uint32_t site = 0;
+	int first = 1;
+	if (!p || p == line) return -1;
+	*p++ = '\0';
+	p[strcspn(p, "\r\n")] = '\0';
+	do {
+		unsigned long n = strtoul(p, &endptr, 10);
+		if (endptr == p || (*endptr && *endptr != ',')) return -1;
+		site = first ? (uint32_t)n : site + (uint32_t)n;
+		first = 0;
+		append_sym(reltbl, line, site);
+		p = endptr + 1;
+	} while (*endptr);
+	return 0;
+}
+
+static void release_object(void* obj) {
+	free_object(obj);
+}
+
+static void release_line(void* buf) {
+	free(*(char**)buf);
+}
+
+/* Reads an output file of the assembler from INPUT. Returns a new Object, or
+   NULL (after logging the offending line to LOG) if INPUT is malformed.
+ */
+Object* read_object(FILE* input, LogCapture* log) {
+	char* buf = NULL;
+	size_t buf_size = 0;
+	uint32_t cap = 256, data_cap = 256, line = 0;
+	int section = 0; /* 1: .text, 2: .symbol, 3: .relocation, 4: .line, 5: .data, 6: .relgroup */
+	Object* obj = calloc(1, sizeof(Object));
+	if (!obj) allocation_failed(log);
+	push_cleanup(log, release_object, obj); /* Until it is returned */
+	push_cleanup(log, release_line, &buf); /* Grown by getline() */
+	obj->text = malloc(cap * sizeof(uint32_t));
+	if (!obj->text) allocation_failed(log);
+	obj->data = malloc(data_cap);
+	if (!obj->data) allocation_failed(log);
+	obj->symtbl = create_table(SYMBOLTBL_NON_UNIQUE, log);
+	obj->reltbl = create_table(SYMBOLTBL_NON_UNIQUE, log);
+	obj->lines = create_line_table(log);
+	while (getline(&buf, &buf_size, input) != -1) { /* Names are not limited in length */
+		char* endptr;
+		int err = 0;
+		line++;
+		if (buf[0] == '\n' || buf[0] == '\r' || buf[0] == '\0') continue;
+		if (strncmp(buf, ".text", 5) == 0) section = 1;
+		else if (strncmp(buf, ".symbol", 7) == 0) section = 2;
+		else if (strncmp(buf, ".relocation", 11) == 0) section = 3;
+		else if (strncmp(buf, ".line", 5) == 0) section = 4;
+		else if (strncmp(buf, ".data", 5) == 0) section = 5;
+		else if (strncmp(buf, ".relgroup", 9) == 0) section = 6;
+		else if (section == 1) {
+			uint32_t word = (uint32_t)strtoul(buf, &endptr, 16);
+			if (endptr == buf || (*endptr != '\n' && *endptr != '\r' && *endptr != '\0')) err = -1;
+			else append_word(obj, &cap, word, log);
+		} else if (section == 2) err = read_sym(buf, obj->symtbl);
+		else if (section == 3) err = read_sym(buf, obj->reltbl);
+		else if (section == 4) err = read_line(buf, obj->lines);
+		else if (section == 5) err = read_data(buf, obj, &data_cap, log);
+		else if (section == 6) err = read_reloc_group(buf, obj->reltbl);
+		else err = -1;
+		if (err) {
+			log_to(log, "Error - invalid object file at line %u: %s", line, buf);
+			pop_cleanup(log, &buf);
+			pop_cleanup(log, obj);
+			free(buf);
+			free_object(obj);
+			return NULL;
+		}
+	}
+	if (!feof(input) && !ferror(input)) allocation_failed(log); /* getline() could not grow BUF */
+	pop_cleanup(log, &buf);
+	pop_cleanup(log, obj);
+	free(buf);
+	return obj;
+}
+
+/* Frees OBJ, even if read_object() did not finish it. */
+void free_object(Object* obj) {
+	free(obj->text);
+	free(obj->data);
+	if (obj->symtbl) free_table(obj->symtbl);
+	if (obj->reltbl) free_table(obj->reltbl);
+	if (obj->lines) free_line_table(obj->lines);
+	free(obj);
+}
+
+/* Patches every relocation of OBJ as if .text were loaded at TEXT_BASE, using
+   the symbols of OBJ itself. What to patch follows from the opcode at the
+   site: j/jal get the 26-bit target, lui the upper and ori the lower half of
+   the address. A site in .data (at DATA_BASE() of .text or above) is a .word
+   and gets the whole address. Returns 0 on success and -1 if a symbol is
+   undefined or a site cannot be patched. The symbols are sorted by name
+   once, so that each relocation is a binary search rather than a walk of
+   the list.
+ */
+int link_object(Object* obj, uint32_t text_base) {
+	uint64_t base = DATA_BASE(4 * (uint64_t)obj->text_len);
+	Symbol** by_name = sort_by_name(obj->symtbl);
+	Symbol* cur = obj->reltbl->head;
+	int err = 0;
+	while ((cur = cur->next)) {
+		int64_t addr = find_by_name(by_name, obj->symtbl->len, cur->name);
+		uint32_t target, *word;
+		target = text_base + (uint32_t)addr;
+		if (addr != -1 && cur->addr >= base && cur->addr - base + 4 <= obj->data_len) {
+			uint8_t* p = obj->data + (cur->addr - base);
+			p[0] = target & 0xff; /* Little-endian, like the simulator */
+			p[1] = (target >> 8) & 0xff;
+			p[2] = (target >> 16) & 0xff;
+			p[3] = target >> 24;
+			continue;
+		}
+		if (addr == -1 || cur->addr / 4 >= obj->text_len) {
+			write_to_log("Error: unable to relocate %s at %u\n", cur->name, cur->addr);
+			err = -1;
+			continue;
+		}
+		word = &obj->text[cur->addr / 4];
+		switch (*word >> 26) {
+			case 0x02: case 0x03: *word |= (target >> 2) & 0x3ffffff; break; /* j, jal */
+			case 0x0f: *word |= target >> 16; break; /* lui */
+			case 0x0d: *word |= target & 0xffff; break; /* ori */
+			default:
+				write_to_log("Error: unable to relocate %s at %u\n", cur->name, cur->addr);
+				err = -1;
+		}
+	}
+	free(by_name);
+	return err;
+}
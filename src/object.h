@@ -0,0 +1,36 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdint.h>
+
+#define RELGROUP_LINE 960   /* characters of a .relgroup line before it wraps */
+
+/* An assembled file as written by assemble(): the machine words of .text,
+   the bytes of .data (loaded DATA_BASE() of .text after it), the .symbol
+   and .relocation (or .relgroup) tables and, if it was assembled with -g,
+   the .line table (empty otherwise).
+ */
+typedef struct Object {
+    uint32_t* text;
+    uint32_t text_len;          /* in words */
+    uint8_t* data;
+    uint32_t data_len;          /* in bytes */
+    SymbolTable* symtbl;
+    SymbolTable* reltbl;
+    LineTable* lines;
+} Object;
+
+/* Reads an output file from INPUT. Returns NULL if it is malformed. */
+Object* read_object(FILE* input, struct LogCapture* log);
+
+void free_object(Object* obj);
+
+int link_object(Object* obj, uint32_t text_base);
+
+/* Writes RELTBL to OUTPUT as the lines of a .relgroup section. */
+void write_reloc_groups(SymbolTable* reltbl, FILE* output);
+
+/* Adds the relocations of a .relgroup LINE to RELTBL. LINE is modified. */
+int read_reloc_group(char* line, SymbolTable* reltbl);
+
+#endif
@@ -0,0 +1,849 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "data.h"
+#include "pack.h"
+
+/* A packed object holds the sections of an output file of assemble() in
+   blocks compressed one by one:
+
+     header   "ZOBJ", version, PACK_BLOCK
+     section  'S', kind, length of the name, name        once per section
+     block    'B', method, raw, plain and packed length, packed bytes
+     ...
+     index    'E', the sections, then per block its section, raw length,
+              offset in the section and offset in the file
+     trailer  offset of the index, "ZEND"
+
+   Integers are little-endian. .text is kept as words, .data as bytes and the
+   other sections as their text, a block holding up to PACK_BLOCK bytes of
+   one of them; the lines of .symbol, .relocation and .line, an address and
+   a name each, are not split between blocks. The records can be read front
+   to back as they are written, while the index at the end finds the block
+   of any word without reading the blocks before it.
+ */
+
+#define PACK_VERSION 1
+#define HEADER_SIZE 12
+#define BLOCK_HEADER_SIZE 14
+#define TRAILER_SIZE 12
+#define INDEX_ENTRY_SIZE 24
+
+#define KIND_TEXT 0
+#define KIND_WORDS 1
+#define KIND_BYTES 2
+#define KIND_TABLE 3
+
+#define METHOD_STORED 0
+#define METHOD_LZ 1
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+#define PLAIN_MAX (3 * PACK_BLOCK)  /* split_fields() or split_table() of a block */
+#define LZ_BOUND(len) ((len) + (len) / 255 + 16)
+
+#define LINE_SIZE 1024
+
+typedef struct PackSection {
+	int kind;
+	char* name;
+} PackSection;
+
+typedef struct PackBlock {
+	uint32_t section;
+	uint32_t raw_len;
+	uint64_t offset;            /* of its raw bytes in the section */
+	uint64_t file_offset;       /* of its 'B' */
+} PackBlock;
+
+struct PackIndex {
+	PackSection* sections;
+	uint32_t num_sections;
+	PackBlock* blocks;
+	uint32_t num_blocks;
+};
+
+static void put_u16(uint8_t* buf, uint32_t val) {
+	buf[0] = (uint8_t)val;
+	buf[1] = (uint8_t)(val >> 8);
+}
+
+static void put_u32(uint8_t* buf, uint32_t val) {
+	put_u16(buf, val);
+	put_u16(buf + 2, val >> 16);
+}
+
+static void put_u64(uint8_t* buf, uint64_t val) {
+	put_u32(buf, (uint32_t)val);
+	put_u32(buf + 4, (uint32_t)(val >> 32));
+}
+
+static uint32_t get_u16(const uint8_t* buf) {
+	return (uint32_t)buf[0] | (uint32_t)buf[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t* buf) {
+	return get_u16(buf) | get_u16(buf + 2) << 16;
+}
+
+static uint64_t get_u64(const uint8_t* buf) {
+	return (uint64_t)get_u32(buf) | (uint64_t)get_u32(buf + 4) << 32;
+}
+
+/*******************************
+ * Block codec
+ *******************************/
+
+static uint32_t hash4(const uint8_t* p) {
+	return (get_u32(p) * 2654435761u) >> (32 - PACK_HASH_BITS);
+}
+
+static uint8_t* put_length(uint8_t* out, size_t len) {
+	for (; len >= 255; len -= 255) *out++ = 255;
+	*out++ = (uint8_t)len;
+	return out;
+}
+
+static int get_length(const uint8_t** in, const uint8_t* end, size_t* len) {
+	uint8_t byte;
+	do {
+		if (*in == end) return -1;
+		byte = *(*in)++;
+		*len += byte;
+	} while (byte == 255);
+	return 0;
+}
+
+/* Compresses the LEN bytes of SRC into DST, which must hold LZ_BOUND(LEN)
+   bytes, and returns the compressed length. Each sequence is a token (the
+   number of literals in the high nibble and the match length less MIN_MATCH
+   in the low one, 15 meaning more length bytes follow), the literals and a
+   2-byte offset back to the match; the last has literals only. Matches are
+   found through a hash table of the last position of every 4 bytes.
+ */
+static size_t lz_compress(const uint8_t* src, size_t len, uint8_t* dst) {
+	uint32_t table[1 << PACK_HASH_BITS]; /* position + 1, 0 for none */
+	const uint8_t* end = src + len;
+	const uint8_t* in = src;
+	const uint8_t* anchor = src;
+	uint8_t* out = dst;
+	size_t lits, mlen, offset;
+	memset(table, 0, sizeof(table));
+	while (in + MIN_MATCH <= end) {
+		uint32_t h = hash4(in);
+		const uint8_t* match = table[h] ? src + table[h] - 1 : NULL;
+		table[h] = (uint32_t)(in - src) + 1;
+		if (!match || in - match > MAX_OFFSET || memcmp(match, in, MIN_MATCH) != 0) {
+			in++;
+			continue;
+		}
+		for (mlen = MIN_MATCH; in + mlen < end && match[mlen] == in[mlen]; mlen++);
+		lits = in - anchor;
+		offset = in - match;
+		*out++ = (uint8_t)((lits < 15 ? lits : 15) << 4
+			| (mlen - MIN_MATCH < 15 ? mlen - MIN_MATCH : 15));
+		if (lits >= 15) out = put_length(out, lits - 15);
+		memcpy(out, anchor, lits);
+		out += lits;
+		*out++ = (uint8_t)offset;
+		*out++ = (uint8_t)(offset >> 8);
+		if (mlen - MIN_MATCH >= 15) out = put_length(out, mlen - MIN_MATCH - 15);
+		in += mlen;
+		anchor = in;
+	}
+	lits = end - anchor;
+	*out++ = (uint8_t)((lits < 15 ? lits : 15) << 4);
+	if (lits >= 15) out = put_length(out, lits - 15);
+	memcpy(out, anchor, lits);
+	return out + lits - dst;
+}
+
+/* Decompresses the LEN bytes lz_compress() wrote to SRC into the DST_LEN
+   bytes of DST. Returns 0 on success and -1 if SRC is corrupt or does not
+   decompress to exactly DST_LEN bytes.
+ */
+static int lz_decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len) {
+	const uint8_t* in = src;
+	const uint8_t* end = src + len;
+	uint8_t* out = dst;
+	size_t lits, mlen, offset, i;
+	uint8_t token;
+	while (in < end) {
+		token = *in++;
+		lits = token >> 4;
+		if (lits == 15 && get_length(&in, end, &lits) != 0) return -1;
+		if ((size_t)(end - in) < lits || (size_t)(dst + dst_len - out) < lits) return -1;
+		memcpy(out, in, lits);
+		in += lits;
+		out += lits;
+		if (in == end) break;
+		if (end - in < 2) return -1;
+		offset = get_u16(in);
+		in += 2;
+		mlen = token & 15;
+		if (mlen == 15 && get_length(&in, end, &mlen) != 0) return -1;
+		mlen += MIN_MATCH;
+		if (offset == 0 || offset > (size_t)(out - dst)
+			|| (size_t)(dst + dst_len - out) < mlen) return -1;
+		for (i = 0; i < mlen; i++) out[i] = out[i - offset]; /* May overlap */
+		out += mlen;
+	}
+	return out == dst + dst_len ? 0 : -1;
+}
+
+/* Splits the N words of RAW by instruction format, so that like fields sit
+   together and compress against each other: a byte per word of the opcode
+   (0x40 and the funct for an R-type), then the register bytes (rs, rt, rd
+   and shamt of an R-type, rs and rt of an I-type), the 16-bit immediates
+   and last the J-type targets, each as the zigzag difference from the one
+   before. Writes the 5 * N bytes to DST.
+ */
+static void split_fields(const uint8_t* raw, uint32_t n, uint8_t* dst) {
+	uint32_t i, word, opcode, nr = 0, ni = 0, prev = 0, delta;
+	uint8_t *ops = dst, *regs, *imms, *targets;
+	for (i = 0; i < n; i++) {
+		opcode = raw[4 * i + 3] >> 2;
+		if (opcode == 0) nr++;
+		else if (opcode != 2 && opcode != 3) ni++;
+	}
+	regs = ops + n;
+	imms = regs + 4 * nr + 2 * ni;
+	targets = imms + 2 * ni;
+	for (i = 0; i < n; i++) {
+		word = get_u32(raw + 4 * i);
+		opcode = word >> 26;
+		if (opcode == 0) {
+			*ops++ = (uint8_t)(0x40 | (word & 0x3f));
+			*regs++ = (uint8_t)(word >> 21 & 0x1f);
+			*regs++ = (uint8_t)(word >> 16 & 0x1f);
+			*regs++ = (uint8_t)(word >> 11 & 0x1f);
+			*regs++ = (uint8_t)(word >> 6 & 0x1f);
+		} else if (opcode == 2 || opcode == 3) {
+			*ops++ = (uint8_t)opcode;
+			delta = (word - prev) & 0x03ffffff;
+			prev = word & 0x03ffffff;
+			put_u32(targets, delta & 0x02000000 ? 2 * (0x04000000 - delta) - 1 : 2 * delta);
+			targets += 4;
+		} else {
+			*ops++ = (uint8_t)opcode;
+			*regs++ = (uint8_t)(word >> 21 & 0x1f);
+			*regs++ = (uint8_t)(word >> 16 & 0x1f);
+			put_u16(imms, word);
+			imms += 2;
+		}
+	}
+}
+
+/* Undoes split_fields() of the N words in SRC into RAW. Returns 0 on
+   success and -1 if SRC is corrupt.
+ */
+static int join_fields(const uint8_t* src, uint32_t n, uint8_t* raw) {
+	uint32_t i, word, nr = 0, ni = 0, prev = 0, zigzag;
+	const uint8_t *ops = src, *regs, *imms, *targets;
+	for (i = 0; i < n; i++) {
+		if (ops[i] & 0x80) return -1;
+		if (ops[i] & 0x40) nr++;
+		else if (ops[i] != 2 && ops[i] != 3) ni++;
+	}
+	regs = ops + n;
+	imms = regs + 4 * nr + 2 * ni;
+	targets = imms + 2 * ni;
+	for (i = 0; i < n; i++, ops++) {
+		if (*ops & 0x40) {
+			word = (uint32_t)(*ops & 0x3f) | (uint32_t)(regs[0] & 0x1f) << 21
+				| (uint32_t)(regs[1] & 0x1f) << 16 | (uint32_t)(regs[2] & 0x1f) << 11
+				| (uint32_t)(regs[3] & 0x1f) << 6;
+			regs += 4;
+		} else if (*ops == 2 || *ops == 3) {
+			zigzag = get_u32(targets);
+			targets += 4;
+			prev = (prev + (zigzag & 1 ? 0x04000000 - (zigzag + 1) / 2 : zigzag / 2)) & 0x03ffffff;
+			word = (uint32_t)*ops << 26 | prev;
+		} else {
+			word = (uint32_t)*ops << 26 | (uint32_t)(regs[0] & 0x1f) << 21
+				| (uint32_t)(regs[1] & 0x1f) << 16 | get_u16(imms);
+			regs += 2;
+			imms += 2;
+		}
+		put_u32(raw + 4 * i, word);
+	}
+	return 0;
+}
+
+static uint8_t* put_varint(uint8_t* out, uint64_t val) {
+	for (; val >= 0x80; val >>= 7) *out++ = (uint8_t)(val | 0x80);
+	*out++ = (uint8_t)val;
+	return out;
+}
+
+static int get_varint(const uint8_t** in, const uint8_t* end, uint64_t* val) {
+	int shift;
+	*val = 0;
+	for (shift = 0; shift < 64; shift += 7) {
+		if (*in == end) return -1;
+		*val |= (uint64_t)(**in & 0x7f) << shift;
+		if (!(*(*in)++ & 0x80)) return 0;
+	}
+	return -1;
+}
+
+/* Splits the LEN bytes of RAW, whole lines of "<address>\t<name>", into
+   the number of lines, then each address as the zigzag difference from the
+   one before and then each name as the length it shares with the one before
+   and the rest. Writes them to DST, which must hold 3 * LEN bytes,
+   using SCRATCH of as many bytes, and returns their length.
+ */
+static size_t split_table(const uint8_t* raw, size_t len, uint8_t* dst, uint8_t* scratch) {
+	const uint8_t *end = raw + len, *line, *tab, *name = raw, *nl;
+	uint8_t *addrs, *names = scratch;
+	uint64_t num = 0, addr, prev = 0;
+	size_t name_len = 0, shared;
+	for (line = raw; line < end; line++) num += *line == '\n';
+	addrs = put_varint(dst, num);
+	for (line = raw; line < end; line = nl + 1) {
+		tab = memchr(line, '\t', end - line);
+		nl = memchr(tab, '\n', end - tab);
+		for (addr = 0; line < tab; line++) addr = addr * 10 + (uint64_t)(*line - '0');
+		addrs = put_varint(addrs, addr >= prev ? 2 * (addr - prev) : 2 * (prev - addr) - 1);
+		prev = addr;
+		for (shared = 0; shared < name_len && tab + 1 + shared < nl
+			&& name[shared] == tab[1 + shared]; shared++);
+		names = put_varint(names, shared);
+		names = put_varint(names, (uint64_t)(nl - tab - 1 - shared));
+		memcpy(names, tab + 1 + shared, nl - tab - 1 - shared);
+		names += nl - tab - 1 - shared;
+		name = tab + 1;
+		name_len = nl - tab - 1;
+	}
+	memcpy(addrs, scratch, names - scratch);
+	return addrs + (names - scratch) - dst;
+}
+
+/* Undoes split_table() of the LEN bytes of SRC into the RAW_LEN bytes of
+   RAW. Returns 0 on success and -1 if SRC is corrupt.
+ */
+static int join_table(const uint8_t* src, size_t len, uint8_t* raw, size_t raw_len) {
+	const uint8_t *end = src + len, *addrs = src, *names;
+	uint8_t *out = raw, *raw_end = raw + raw_len, *name = raw;
+	uint8_t digits[10];
+	uint64_t num, i, zigzag, addr = 0, val, shared, rest, name_len = 0;
+	int n;
+	if (get_varint(&addrs, end, &num) != 0) return -1;
+	for (names = addrs, i = 0; i < num; i++) {
+		if (get_varint(&names, end, &val) != 0) return -1;
+	}
+	for (i = 0; i < num; i++) {
+		if (get_varint(&addrs, end, &zigzag) != 0 || get_varint(&names, end, &shared) != 0
+			|| get_varint(&names, end, &rest) != 0 || shared > name_len
+			|| rest > (uint64_t)(end - names)) return -1;
+		addr = zigzag & 1 ? addr - (zigzag + 1) / 2 : addr + zigzag / 2;
+		if (addr > 0xffffffff) return -1;
+		for (n = 0, val = addr; n == 0 || val; val /= 10) digits[n++] = (uint8_t)('0' + val % 10);
+		if ((uint64_t)(raw_end - out) < n + 2 + shared + rest) return -1;
+		while (n) *out++ = digits[--n];
+		*out++ = '\t';
+		memcpy(out, name, shared);
+		memcpy(out + shared, names, rest);
+		name = out;
+		name_len = shared + rest;
+		names += rest;
+		out += name_len;
+		*out++ = '\n';
+	}
+	return out == raw_end && names == end ? 0 : -1;
+}
+
+/*******************************
+ * Index
+ *******************************/
+
+static void add_section(PackIndex* index, int kind, const char* name, size_t len) {
+	PackSection* section;
+	if ((index->num_sections & (index->num_sections - 1)) == 0) { /* 0 or a power of 2 */
+		index->sections = realloc(index->sections,
+			sizeof(PackSection) * (index->num_sections ? 2 * index->num_sections : 4));
+		if (!index->sections) allocation_failed(NULL);
+	}
+	section = index->sections + index->num_sections++;
+	section->kind = kind;
+	section->name = malloc(len + 1);
+	if (!section->name) allocation_failed(NULL);
+	memcpy(section->name, name, len);
+	section->name[len] = '\0';
+}
+
+static void add_block(PackIndex* index, uint32_t raw_len, uint64_t offset,
+	uint64_t file_offset) {
+
+	PackBlock* block;
+	if ((index->num_blocks & (index->num_blocks - 1)) == 0) {
+		index->blocks = realloc(index->blocks,
+			sizeof(PackBlock) * (index->num_blocks ? 2 * index->num_blocks : 4));
+		if (!index->blocks) allocation_failed(NULL);
+	}
+	block = index->blocks + index->num_blocks++;
+	block->section = index->num_sections - 1;
+	block->raw_len = raw_len;
+	block->offset = offset;
+	block->file_offset = file_offset;
+}
+
+static PackIndex* create_pack_index() {
+	PackIndex* index = calloc(1, sizeof(PackIndex));
+	if (!index) allocation_failed(NULL);
+	return index;
+}
+
+void free_pack_index(PackIndex* index) {
+	uint32_t i;
+	if (!index) return;
+	for (i = 0; i < index->num_sections; i++) free(index->sections[i].name);
+	free(index->sections);
+	free(index->blocks);
+	free(index);
+}
+
+/*******************************
+ * Writing
+ *******************************/
+
+typedef struct PackWriter {
+	FILE* output;
+	uint64_t offset;            /* bytes written so far */
+	PackIndex* index;
+	uint8_t raw[PACK_BLOCK];    /* the block being filled */
+	size_t len;
+	uint64_t section_offset;    /* of RAW in the current section */
+	int short_line;             /* a .data line shorter than DATA_LINE_BYTES was read */
+	uint8_t plain[PLAIN_MAX];
+	uint8_t packed[LZ_BOUND(PLAIN_MAX)];
+} PackWriter;
+
+static void emit(PackWriter* w, const void* buf, size_t len) {
+	fwrite(buf, 1, len, w->output);
+	w->offset += len;
+}
+
+/* Compresses the open block of W, if it has any bytes, and writes it out. */
+static void flush_block(PackWriter* w) {
+	uint8_t header[BLOCK_HEADER_SIZE];
+	const uint8_t* plain = w->raw;
+	size_t plain_len = w->len, packed_len;
+	int kind;
+	if (w->len == 0) return;
+	kind = w->index->sections[w->index->num_sections - 1].kind;
+	if (kind == KIND_WORDS) {
+		split_fields(w->raw, (uint32_t)(w->len / 4), w->plain);
+		plain = w->plain;
+		plain_len = w->len / 4 * 5;
+	} else if (kind == KIND_TABLE) {
+		plain_len = split_table(w->raw, w->len, w->plain, w->packed);
+		plain = w->plain;
+	}
+	packed_len = lz_compress(plain, plain_len, w->packed);
+	header[0] = 'B';
+	header[1] = packed_len < plain_len ? METHOD_LZ : METHOD_STORED;
+	if (header[1] == METHOD_STORED) packed_len = plain_len;
+	put_u32(header + 2, (uint32_t)w->len);
+	put_u32(header + 6, (uint32_t)plain_len);
+	put_u32(header + 10, (uint32_t)packed_len);
+	add_block(w->index, (uint32_t)w->len, w->section_offset, w->offset);
+	emit(w, header, sizeof(header));
+	emit(w, header[1] == METHOD_LZ ? w->packed : plain, packed_len);
+	w->section_offset += w->len;
+	w->len = 0;
+}
+
+static void start_section(PackWriter* w, const char* name, size_t len) {
+	uint8_t header[4];
+	int kind = KIND_TEXT;
+	if (len == 5 && strncmp(name, ".text", 5) == 0) kind = KIND_WORDS;
+	else if (len == 5 && strncmp(name, ".data", 5) == 0) kind = KIND_BYTES;
+	else if ((len == 7 && strncmp(name, ".symbol", 7) == 0)
+		|| (len == 11 && strncmp(name, ".relocation", 11) == 0)
+		|| (len == 5 && strncmp(name, ".line", 5) == 0)) kind = KIND_TABLE;
+	flush_block(w);
+	add_section(w->index, kind, name, len);
+	w->section_offset = 0;
+	w->short_line = 0;
+	header[0] = 'S';
+	header[1] = (uint8_t)kind;
+	put_u16(header + 2, (uint32_t)len);
+	emit(w, header, sizeof(header));
+	emit(w, name, len);
+}
+
+static void add_bytes(PackWriter* w, const uint8_t* buf, size_t len) {
+	size_t n;
+	while (len) {
+		n = PACK_BLOCK - w->len < len ? PACK_BLOCK - w->len : len;
+		memcpy(w->raw + w->len, buf, n);
+		w->len += n;
+		buf += n;
+		len -= n;
+		if (w->len == PACK_BLOCK) flush_block(w);
+	}
+}
+
+static int hex_digit(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/* Adds the LEN bytes of LINE to the current section of W: a word of .text,
+   the bytes of a line of .data, an address and a name of a table or any
+   text. Returns 0 on success and -1 if it is not a line assemble() writes
+   to that section.
+ */
+static int add_plain_line(PackWriter* w, const char* line, size_t len) {
+	uint8_t bytes[DATA_LINE_BYTES];
+	uint32_t word = 0;
+	uint64_t addr = 0;
+	size_t i;
+	int hi, lo;
+	switch (w->index->sections[w->index->num_sections - 1].kind) {
+	case KIND_WORDS:
+		if (len != 9 || line[8] != '\n') return -1;
+		for (i = 0; i < 8; i++) {
+			if ((hi = hex_digit(line[i])) < 0) return -1;
+			word = word << 4 | (uint32_t)hi;
+		}
+		put_u32(bytes, word);
+		add_bytes(w, bytes, 4);
+		return 0;
+	case KIND_BYTES:
+		if (w->short_line || len % 2 == 0 || len < 3 || len > 2 * DATA_LINE_BYTES + 1
+			|| line[len - 1] != '\n') return -1;
+		for (i = 0; i < len / 2; i++) {
+			if ((hi = hex_digit(line[2 * i])) < 0 || (lo = hex_digit(line[2 * i + 1])) < 0) {
+				return -1;
+			}
+			bytes[i] = (uint8_t)(hi << 4 | lo);
+		}
+		w->short_line = len / 2 < DATA_LINE_BYTES; /* Only the last line */
+		add_bytes(w, bytes, len / 2);
+		return 0;
+	case KIND_TABLE: /* As "%u\t%s\n" prints them, for split_table() */
+		for (i = 0; i < 10 && line[i] >= '0' && line[i] <= '9'; i++) {
+			addr = addr * 10 + (uint64_t)(line[i] - '0');
+		}
+		if (i == 0 || (line[0] == '0' && i > 1) || addr > 0xffffffff || line[i] != '\t'
+			|| line[len - 1] != '\n' || memchr(line + i + 1, '\t', len - i - 2)) return -1;
+		if (w->len + len > PACK_BLOCK) flush_block(w);
+		add_bytes(w, (const uint8_t*)line, len);
+		return 0;
+	default:
+		add_bytes(w, (const uint8_t*)line, len);
+		return 0;
+	}
+}
+
+/* Writes the index of W and the trailer. */
+static void write_index(PackWriter* w) {
+	PackIndex* index = w->index;
+	uint8_t buf[INDEX_ENTRY_SIZE];
+	uint64_t index_offset = w->offset;
+	size_t len;
+	uint32_t i;
+	buf[0] = 'E';
+	put_u32(buf + 1, index->num_sections);
+	emit(w, buf, 5);
+	for (i = 0; i < index->num_sections; i++) {
+		len = strlen(index->sections[i].name);
+		buf[0] = (uint8_t)index->sections[i].kind;
+		put_u16(buf + 1, (uint32_t)len);
+		emit(w, buf, 3);
+		emit(w, index->sections[i].name, len);
+	}
+	put_u32(buf, index->num_blocks);
+	emit(w, buf, 4);
+	for (i = 0; i < index->num_blocks; i++) {
+		put_u32(buf, index->blocks[i].section);
+		put_u32(buf + 4, index->blocks[i].raw_len);
+		put_u64(buf + 8, index->blocks[i].offset);
+		put_u64(buf + 16, index->blocks[i].file_offset);
+		emit(w, buf, INDEX_ENTRY_SIZE);
+	}
+	put_u64(buf, index_offset);
+	memcpy(buf + 8, "ZEND", 4);
+	emit(w, buf, TRAILER_SIZE);
+}
+
+/* Reads the output file assemble() wrote from INPUT and writes it packed to
+   OUTPUT, one block at a time as it is read. A section starts at a line
+   beginning with '.' that comes first or after a blank line, as in
+   write_object(); unpack_object() gives back the same bytes. Adds to STATS
+   unless it is NULL. Returns 0 on success and -1 if INPUT is not an output
+   file of the assembler.
+ */
+int pack_object(FILE* input, FILE* output, PackStats* stats) {
+	PackWriter* w = malloc(sizeof(PackWriter));
+	char buf[LINE_SIZE];
+	uint8_t header[HEADER_SIZE];
+	size_t len;
+	int line_start = 1, blank = 0, err = 0;
+	if (!w) allocation_failed(NULL);
+	w->output = output;
+	w->offset = 0;
+	w->index = create_pack_index();
+	w->len = 0;
+	memcpy(header, "ZOBJ", 4);
+	put_u32(header + 4, PACK_VERSION);
+	put_u32(header + 8, PACK_BLOCK);
+	emit(w, header, sizeof(header));
+
+	while (!err && fgets(buf, sizeof(buf), input)) {
+		len = strlen(buf);
+		if (stats) stats->plain_bytes += len;
+		if (line_start && buf[0] == '.' && (blank || w->index->num_sections == 0)) {
+			if (buf[len - 1] != '\n' || len > 0xffff) err = -1;
+			else start_section(w, buf, len - 1);
+			blank = 0;
+			continue;
+		}
+		if (w->index->num_sections == 0) {
+			err = -1;
+			break;
+		}
+		if (blank) { /* Not a separator after all */
+			err = add_plain_line(w, "\n", 1);
+			blank = 0;
+		}
+		if (line_start && strcmp(buf, "\n") == 0) blank = 1;
+		else if (!err) err = add_plain_line(w, buf, len);
+		line_start = buf[len - 1] == '\n';
+	}
+	if (w->index->num_sections == 0 || (blank && add_plain_line(w, "\n", 1) != 0)) err = -1;
+	if (!err) {
+		flush_block(w);
+		write_index(w);
+		if (stats) {
+			stats->packed_bytes += w->offset;
+			stats->blocks += w->index->num_blocks;
+		}
+	}
+	free_pack_index(w->index);
+	free(w);
+	return err;
+}
+
+/*******************************
+ * Reading
+ *******************************/
+
+typedef struct PackReader {
+	FILE* input;
+	uint8_t raw[PACK_BLOCK];
+	uint8_t plain[PLAIN_MAX];
+	uint8_t packed[PLAIN_MAX];
+	char text[PACK_BLOCK / 4 * 9]; /* RAW as write_object() writes it */
+} PackReader;
+
+static PackReader* create_reader(FILE* input) {
+	PackReader* r = malloc(sizeof(PackReader));
+	if (!r) allocation_failed(NULL);
+	r->input = input;
+	return r;
+}
+
+static int read_header(FILE* input) {
+	uint8_t header[HEADER_SIZE];
+	if (fread(header, 1, sizeof(header), input) != sizeof(header)) return -1;
+	if (memcmp(header, "ZOBJ", 4) != 0 || get_u32(header + 4) != PACK_VERSION
+		|| get_u32(header + 8) != PACK_BLOCK) return -1;
+	return 0;
+}
+
+/* Returns 1 if INPUT, at its start, is a packed object and 0 otherwise, and
+   goes back to the start.
+ */
+int is_packed(FILE* input) {
+	int packed = read_header(input) == 0;
+	rewind(input);
+	return packed;
+}
+
+/* Reads the block of a KIND section that follows its 'B' in R->input and
+   decompresses it into R->raw. Returns its length, or -1 if it is corrupt.
+ */
+static long read_block(PackReader* r, int kind) {
+	uint8_t header[BLOCK_HEADER_SIZE - 1];
+	uint32_t raw_len, plain_len, packed_len;
+	uint8_t* plain = kind == KIND_WORDS || kind == KIND_TABLE ? r->plain : r->raw;
+	if (fread(header, 1, sizeof(header), r->input) != sizeof(header)) return -1;
+	raw_len = get_u32(header + 1);
+	plain_len = get_u32(header + 5);
+	packed_len = get_u32(header + 9);
+	if (raw_len > PACK_BLOCK || plain_len > PLAIN_MAX || packed_len > plain_len
+		|| (kind == KIND_WORDS && (raw_len % 4 || plain_len != raw_len / 4 * 5))
+		|| (kind != KIND_WORDS && kind != KIND_TABLE && plain_len != raw_len)) return -1;
+	if (header[0] == METHOD_STORED) {
+		if (packed_len != plain_len || fread(plain, 1, plain_len, r->input) != plain_len) {
+			return -1;
+		}
+	} else if (header[0] != METHOD_LZ
+		|| fread(r->packed, 1, packed_len, r->input) != packed_len
+		|| lz_decompress(r->packed, packed_len, plain, plain_len) != 0) {
+		return -1;
+	}
+	if (kind == KIND_WORDS && join_fields(r->plain, raw_len / 4, r->raw) != 0) return -1;
+	if (kind == KIND_TABLE && join_table(r->plain, plain_len, r->raw, raw_len) != 0) return -1;
+	return (long)raw_len;
+}
+
+/* Writes the LEN bytes of R->raw of a KIND section to OUTPUT as
+   write_object() did, with one fwrite(). Returns the number of characters
+   written.
+ */
+static size_t write_block(PackReader* r, int kind, size_t len, FILE* output) {
+	static const char digits[] = "0123456789abcdef";
+	char* text = r->text;
+	uint32_t word;
+	size_t i, j, n;
+	int k;
+	if (kind == KIND_WORDS) {
+		for (i = 0; i < len; i += 4, text += 9) {
+			word = get_u32(r->raw + i);
+			for (k = 7; k >= 0; k--, word >>= 4) text[k] = digits[word & 0xf];
+			text[8] = '\n';
+		}
+	} else if (kind == KIND_BYTES) { /* Blocks end at line ends but for the last */
+		for (i = 0; i < len; i += n) {
+			n = len - i < DATA_LINE_BYTES ? len - i : DATA_LINE_BYTES;
+			for (j = 0; j < n; j++) {
+				*text++ = digits[r->raw[i + j] >> 4];
+				*text++ = digits[r->raw[i + j] & 0xf];
+			}
+			*text++ = '\n';
+		}
+	} else {
+		return fwrite(r->raw, 1, len, output);
+	}
+	return fwrite(r->text, 1, text - r->text, output);
+}
+
+/* Reads the packed object INPUT front to back, without its index, and
+   writes the output file it was packed from to OUTPUT. Adds to STATS unless
+   it is NULL. Returns 0 on success and -1 if INPUT is corrupt.
+ */
+int unpack_object(FILE* input, FILE* output, PackStats* stats) {
+	PackReader* r = create_reader(input);
+	uint8_t header[3];
+	char name[0x10000];
+	uint64_t written = 0;
+	uint32_t sections = 0, blocks = 0;
+	size_t len;
+	long raw_len;
+	int c, kind = KIND_TEXT, err = read_header(input);
+	while (!err && (c = fgetc(input)) != 'E') {
+		if (c == 'S' && fread(header, 1, 3, input) == 3 && header[0] <= KIND_TABLE) {
+			len = get_u16(header + 1);
+			if (fread(name, 1, len, input) != len) {
+				err = -1;
+				break;
+			}
+			kind = header[0];
+			if (sections++) written += fputc('\n', output) != EOF;
+			written += fwrite(name, 1, len, output);
+			written += fputc('\n', output) != EOF;
+		} else if (c == 'B' && sections && (raw_len = read_block(r, kind)) >= 0) {
+			written += write_block(r, kind, (size_t)raw_len, output);
+			blocks++;
+		} else {
+			err = -1;
+		}
+	}
+	if (!err && stats && fseek(input, 0, SEEK_END) == 0) {
+		stats->plain_bytes += written;
+		stats->packed_bytes += (uint64_t)ftell(input);
+		stats->blocks += blocks;
+	}
+	free(r);
+	return err;
+}
+
+/* Reads the index at the end of the packed object INPUT, for
+   read_packed_words(). Returns NULL if INPUT is not a packed object or is
+   corrupt.
+ */
+PackIndex* read_pack_index(FILE* input) {
+	PackIndex* index;
+	uint8_t buf[INDEX_ENTRY_SIZE];
+	char name[0x10000];
+	uint32_t i, num;
+	size_t len;
+	int err = 0;
+	if (fseek(input, 0, SEEK_SET) != 0 || read_header(input) != 0
+		|| fseek(input, -TRAILER_SIZE, SEEK_END) != 0
+		|| fread(buf, 1, TRAILER_SIZE, input) != TRAILER_SIZE || memcmp(buf + 8, "ZEND", 4) != 0
+		|| fseek(input, (long)get_u64(buf), SEEK_SET) != 0
+		|| fread(buf, 1, 5, input) != 5 || buf[0] != 'E') {
+		return NULL;
+	}
+	index = create_pack_index();
+	num = get_u32(buf + 1);
+	for (i = 0; !err && i < num; i++) {
+		if (fread(buf, 1, 3, input) != 3 || buf[0] > KIND_TABLE) {
+			err = -1;
+			break;
+		}
+		len = get_u16(buf + 1);
+		if (fread(name, 1, len, input) != len) err = -1;
+		else add_section(index, buf[0], name, len);
+	}
+	if (!err && fread(buf, 1, 4, input) != 4) err = -1;
+	num = err ? 0 : get_u32(buf);
+	for (i = 0; !err && i < num; i++) {
+		if (fread(buf, 1, INDEX_ENTRY_SIZE, input) != INDEX_ENTRY_SIZE
+			|| get_u32(buf) >= index->num_sections || get_u32(buf + 4) > PACK_BLOCK) {
+			err = -1;
+		} else {
+			add_block(index, get_u32(buf + 4), get_u64(buf + 8), get_u64(buf + 16));
+			index->blocks[i].section = get_u32(buf);
+		}
+	}
+	if (err) {
+		free_pack_index(index);
+		return NULL;
+	}
+	return index;
+}
+
+/* Reads the COUNT words of .text from word FIRST on into WORDS, seeking
+   through INDEX straight to the blocks that hold them and decompressing
+   only those. Returns the number of words read, fewer if .text ends first,
+   or -1 if INPUT is corrupt.
+ */
+int64_t read_packed_words(FILE* input, PackIndex* index, uint64_t first, uint32_t count,
+	uint32_t* words) {
+
+	PackReader* r;
+	PackBlock* block;
+	uint64_t start = first * 4, end = (first + count) * 4, from, to;
+	uint32_t i;
+	int64_t read = 0;
+	long len;
+	for (i = 0; i < index->num_sections && index->sections[i].kind != KIND_WORDS; i++);
+	if (i == index->num_sections) return 0;
+	r = create_reader(input);
+	for (block = index->blocks; block < index->blocks + index->num_blocks; block++) {
+		if (block->section != i || block->offset + block->raw_len <= start) continue;
+		if (block->offset >= end) break;
+		if (fseek(input, (long)block->file_offset, SEEK_SET) != 0
+			|| fgetc(input) != 'B'
+			|| (len = read_block(r, KIND_WORDS)) != (long)block->raw_len) {
+			read = -1;
+			break;
+		}
+		from = start > block->offset ? start : block->offset;
+		to = end < block->offset + len ? end : block->offset + len;
+		for (; from < to; from += 4) words[read++] = get_u32(r->raw + (from - block->offset));
+	}
+	free(r);
+	return read;
+}
@@ -0,0 +1,36 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PACK_BLOCK 65536        /* bytes of one section compressed together */
+#define PACK_HASH_BITS 12       /* log2 of the entries of the match finder */
+
+/* Totals of a pack_object() or unpack_object() run. */
+typedef struct PackStats {
+    uint64_t plain_bytes;       /* of the text output file */
+    uint64_t packed_bytes;
+    uint32_t blocks;
+} PackStats;
+
+typedef struct PackIndex PackIndex;
+
+/* Writes the output file read from INPUT packed to OUTPUT. */
+int pack_object(FILE* input, FILE* output, PackStats* stats);
+
+/* Writes the output file packed in INPUT back to OUTPUT. */
+int unpack_object(FILE* input, FILE* output, PackStats* stats);
+
+int is_packed(FILE* input);
+
+/* Reads the block index at the end of the packed object INPUT. */
+PackIndex* read_pack_index(FILE* input);
+
+void free_pack_index(PackIndex* index);
+
+/* Reads COUNT words of .text from word FIRST on, through INDEX. */
+int64_t read_packed_words(FILE* input, PackIndex* index, uint64_t first, uint32_t count,
+    uint32_t* words);
+
+#endif
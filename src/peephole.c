@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "translate_utils.h"
+#include "ir.h"
+#include "peephole.h"
+
+#define REUSE_WINDOW 16     /* How far back to look for an equal computation */
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+/* Returns 1 if INST changes no register, e.g. the `addu $x, $0, $x` that
+   `move $x, $x` expands to, `addiu $r, $r, 0`, or any write to $0.
+ */
+static int is_noop(const Inst* inst, const InstInfo* info) {
+	int rd, rs, rt;
+	long int imm;
+	if (info->kind != INST_ALU) return 0;
+	if (!info->defs) return 1; /* Writes $0 */
+	if (inst->num_args != 3) return 0;
+	rd = translate_reg(inst->args[0]);
+	rs = translate_reg(inst->args[1]);
+	if (strcmp(inst->name, "addu") == 0 || strcmp(inst->name, "or") == 0) {
+		rt = translate_reg(inst->args[2]);
+		if ((rs == rd && rt == 0) || (rs == 0 && rt == rd)) return 1;
+		return strcmp(inst->name, "or") == 0 && rs == rd && rt == rd;
+	}
+	if (rs != rd) return 0;
+	return translate_num(&imm, inst->args[2], 0, 0) == 0; /* addiu, ori, sll by 0 */
+}
+
+/* Returns the index of the first instruction after I not marked DEAD, or
+   LIST->LEN if there is none.
+ */
+static uint32_t next_live(InstList* list, const char* dead, uint32_t i) {
+	while (++i < list->len && dead[i]);
+	return i;
+}
+
+/* Returns 1 if instruction J recomputes a value that is still in its
+   destination register, because an equal instruction ran before it on
+   every path into J. This is the `slt $at` that back-to-back bge produce.
+ */
+static int is_redundant(InstList* list, const char* dead, const char* leaders,
+	const InstInfo* infos, uint32_t j) {
+	
+	uint32_t k, steps = 0;
+	const InstInfo* info = &infos[j];
+	if (info->kind != INST_ALU || !info->defs || (info->defs & info->uses)) return 0;
+	for (k = j; k > 0 && steps < REUSE_WINDOW; steps++) {
+		if (leaders[k]) return 0; /* Control may enter between */
+		k--;
+		if (dead[k]) continue;
+		if (same_inst(&list->insts[k], &list->insts[j])) return 1;
+		switch (infos[k].kind) {
+			case INST_ALU: case INST_LOAD: case INST_STORE: case INST_BRANCH:
+				if (infos[k].defs & (info->defs | info->uses)) return 0;
+				break;
+			default: return 0; /* Jumps, calls, unknown */
+		}
+	}
+	return 0;
+}
+
+/*******************************
+ * Peephole Optimizer
+ *******************************/
+
+/* Removes instructions from LIST that cannot change the result:
+	1. no-ops (see is_noop()).
+	2. pure computations whose result is overwritten by the very next
+		instruction before being read, which folds back-to-back constant
+		loads of the same register.
+	3. recomputations of a value still held in a register (see
+		is_redundant()).
+   Removing one instruction can expose another, so the rules are applied until
+   nothing changes. Labels in SYMTBL move with the code.
+
+   Returns the number of instructions removed.
+ */
+uint32_t peephole(InstList* list, SymbolTable* symtbl) {
+	uint32_t i, n, removed = 0, before;
+	char* dead = calloc(list->len + 1, 1);
+	InstInfo* infos = malloc((list->len + 1) * sizeof(InstInfo));
+	char* leaders;
+	if (!dead || !infos) {
+		free(dead);
+		free(infos);
+		allocation_failed(list->log);
+	}
+	push_cleanup(list->log, free, dead); /* find_leaders() and delete_insts() allocate too */
+	push_cleanup(list->log, free, infos);
+	leaders = find_leaders(list, symtbl);
+	push_cleanup(list->log, free, leaders);
+	for (i = 0; i < list->len; i++) decode_inst(&list->insts[i], &infos[i]);
+	do {
+		before = removed;
+		for (i = 0; i < list->len; i++) {
+			if (dead[i]) continue;
+			if (is_noop(&list->insts[i], &infos[i])) {
+				dead[i] = 1;
+				removed++;
+				continue;
+			}
+			n = next_live(list, dead, i);
+			if (infos[i].kind == INST_ALU && infos[i].defs && n < list->len
+				&& (infos[n].kind == INST_ALU || infos[n].kind == INST_LOAD)
+				&& infos[n].defs == infos[i].defs && !(infos[n].uses & infos[i].defs)) {
+				dead[i] = 1; /* Overwritten before use */
+				removed++;
+				continue;
+			}
+			if (is_redundant(list, dead, leaders, infos, i)) {
+				dead[i] = 1;
+				removed++;
+			}
+		}
+	} while (removed != before);
+	delete_insts(list, dead, symtbl);
+	pop_cleanup(list->log, leaders);
+	pop_cleanup(list->log, infos);
+	pop_cleanup(list->log, dead);
+	free(dead);
+	free(leaders);
+	free(infos);
+	return removed;
+}
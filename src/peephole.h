@@ -0,0 +1,9 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdint.h>
+
+/* Removes no-op and redundant instructions from LIST. Returns how many. */
+uint32_t peephole(InstList* list, SymbolTable* symtbl);
+
+#endif
@@ -0,0 +1,344 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "preproc.h"
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+/* Frees FILE, even if get_lexed_file() did not finish it. */
+static void free_lexed(LexFile* file) {
+	if (file->size) munmap(file->map, file->size);
+	free(file->path);
+	free(file->lines);
+	free(file->tokens);
+	free(file->store);
+	free(file);
+}
+
+static void release_lexed(void* file) {
+	free_lexed(file);
+}
+
+static void add_token(LexFile* file, uint32_t* cap, char* token, LogCapture* log) {
+	if (file->num_tokens == *cap) {
+		char** tokens = realloc(file->tokens, 2 * *cap * sizeof(char*));
+		if (!tokens) allocation_failed(log);
+		file->tokens = tokens;
+		*cap *= 2;
+	}
+	file->tokens[file->num_tokens++] = token;
+}
+
+static void add_lex_line(LexFile* file, uint32_t* cap, const LexLine* line, LogCapture* log) {
+	if (file->num_lines == *cap) {
+		LexLine* lines = realloc(file->lines, 2 * *cap * sizeof(LexLine));
+		if (!lines) allocation_failed(log);
+		file->lines = lines;
+		*cap *= 2;
+	}
+	file->lines[file->num_lines++] = *line;
+}
+
+/* Splits the SIZE bytes of FILE->map into lines and tokens. A '#' ends the
+   tokens of its line, as skip_comments() does for pass one. Allocation
+   failures go to LOG.
+ */
+static void lex(LexFile* file, size_t size, LogCapture* log) {
+	const char* map = file->map;
+	size_t pos = 0, stored = 0;
+	uint32_t line_cap = 64, token_cap = 256;
+	LexLine line;
+	file->store = malloc(size + 1); /* Tokens and their NULs fit in the file */
+	file->lines = malloc(line_cap * sizeof(LexLine));
+	file->tokens = malloc(token_cap * sizeof(char*));
+	if (!file->store || !file->lines || !file->tokens) allocation_failed(log);
+	file->num_lines = 0;
+	file->num_tokens = 0;
+	line.line = 0;
+	while (pos < size) {
+		const char* nl = memchr(map + pos, '\n', size - pos);
+		size_t end = nl ? (size_t)(nl - map) : size, i = pos;
+		line.line++;
+		line.first = file->num_tokens;
+		line.num_tokens = 0;
+		line.raw = (uint32_t)pos;
+		line.raw_len = (uint32_t)(end - pos);
+		while (i < end && map[i] != '#') {
+			size_t start = i;
+			while (i < end && map[i] != '#' && !strchr(LEX_SEPARATORS, map[i])) i++;
+			if (i == start) {
+				i++; /* A separator */
+				continue;
+			}
+			memcpy(file->store + stored, map + start, i - start);
+			file->store[stored + (i - start)] = '\0';
+			add_token(file, &token_cap, file->store + stored, log);
+			stored += i - start + 1;
+			line.num_tokens++;
+		}
+		if (line.num_tokens) add_lex_line(file, &line_cap, &line, log);
+		pos = end + 1;
+	}
+}
+
+/*******************************
+ * Include Cache Functions
+ *******************************/
+
+IncludeCache* create_include_cache(LogCapture* log) {
+	IncludeCache* cache = malloc(sizeof(IncludeCache));
+	if (!cache) allocation_failed(log);
+	cache->files = NULL;
+	cache->lookups = 0;
+	cache->hits = 0;
+	return cache;
+}
+
+void free_include_cache(IncludeCache* cache) {
+	while (cache->files) {
+		LexFile* next = cache->files->next;
+		free_lexed(cache->files);
+		cache->files = next;
+	}
+	free(cache);
+}
+
+/* Returns the file at PATH lexed into lines of tokens, from CACHE if it was
+   lexed before and has not changed since, or NULL if it cannot be read. A
+   file is mapped and lexed once; the result stays in CACHE, which it joins
+   only once complete, so that CACHE stays whole if an allocation fails and
+   LOG jumps back.
+ */
+LexFile* get_lexed_file(IncludeCache* cache, const char* path, LogCapture* log) {
+	struct stat st;
+	LexFile **link, *file;
+	int fd;
+	cache->lookups++;
+	if (stat(path, &st) != 0) return NULL;
+	for (link = &cache->files; (file = *link); link = &file->next) {
+		if (strcmp(file->path, path) != 0) continue;
+		if (file->size == st.st_size && file->mtime.tv_sec == st.st_mtim.tv_sec
+			&& file->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+			cache->hits++;
+			return file;
+		}
+		*link = file->next; /* Changed, lex it again */
+		free_lexed(file);
+		break;
+	}
+
+	file = calloc(1, sizeof(LexFile));
+	if (!file) allocation_failed(log);
+	push_cleanup(log, release_lexed, file);
+	file->path = malloc(strlen(path) + 1);
+	if (!file->path) allocation_failed(log);
+	strcpy(file->path, path);
+	file->size = st.st_size;
+	file->mtime = st.st_mtim;
+	if (file->size) {
+		fd = open(path, O_RDONLY);
+		file->map = fd == -1 ? MAP_FAILED
+			: mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (fd != -1) close(fd);
+		if (file->map == MAP_FAILED) {
+			file->size = 0;
+			pop_cleanup(log, file);
+			free_lexed(file);
+			return NULL;
+		}
+	}
+	lex(file, file->size, log);
+	pop_cleanup(log, file);
+	file->next = cache->files;
+	cache->files = file;
+	return file;
+}
+
+/* Removes FILE from CACHE and frees it, for when it is known to have
+   changed: the next get_lexed_file() lexes it again, whatever its size and
+   modification time say.
+ */
+void forget_lexed_file(IncludeCache* cache, LexFile* file) {
+	LexFile** link;
+	for (link = &cache->files; *link; link = &(*link)->next) {
+		if (*link == file) {
+			*link = file->next;
+			free_lexed(file);
+			return;
+		}
+	}
+}
+
+/*******************************
+ * Macro Functions
+ *******************************/
+
+static char* copy_string(const char* str, LogCapture* log) {
+	char* copy = malloc(strlen(str) + 1);
+	if (!copy) allocation_failed(log);
+	strcpy(copy, str);
+	return copy;
+}
+
+/* Adds a macro NAME with the NUM_PARAMS PARAMS (names without the '\\') to
+   the front of MACROS, where it hides any earlier one of the same name, and
+   returns it for add_macro_line(). It is added before it is filled in, so
+   that if an allocation fails free_macros() still frees all of it.
+ */
+Macro* define_macro(Macro** macros, const char* name, char* const* params, int num_params,
+	LogCapture* log) {
+	
+	Macro* macro = calloc(1, sizeof(Macro));
+	int i;
+	if (!macro) allocation_failed(log);
+	macro->next = *macros;
+	*macros = macro;
+	macro->name = copy_string(name, log);
+	for (i = 0; i < num_params; i++) {
+		macro->params[i] = malloc(strlen(params[i]) + 2);
+		if (!macro->params[i]) allocation_failed(log);
+		macro->num_params = i + 1;
+		macro->params[i][0] = '\\';
+		strcpy(macro->params[i] + 1, params[i]);
+	}
+	macro->body = malloc(8 * sizeof(MacroLine));
+	if (!macro->body) allocation_failed(log);
+	macro->cap = 8;
+	return macro;
+}
+
+/* Appends a line of NUM_TOKENS TOKENS with text RAW to the body of MACRO. */
+void add_macro_line(Macro* macro, char* const* tokens, uint32_t num_tokens, const char* raw,
+	LogCapture* log) {
+	
+	MacroLine* line;
+	uint32_t i;
+	if (macro->len == macro->cap) {
+		MacroLine* body = realloc(macro->body, 2 * macro->cap * sizeof(MacroLine));
+		if (!body) allocation_failed(log);
+		macro->body = body;
+		macro->cap *= 2;
+	}
+	line = macro->body + macro->len++;
+	line->num_tokens = 0; /* Counted as they are copied, for free_macros() */
+	line->raw = NULL;
+	line->tokens = malloc(num_tokens * sizeof(char*));
+	if (!line->tokens) allocation_failed(log);
+	for (i = 0; i < num_tokens; i++) {
+		line->tokens[i] = copy_string(tokens[i], log);
+		line->num_tokens = i + 1;
+	}
+	line->raw = copy_string(raw, log);
+}
+
+Macro* find_macro(Macro* macros, const char* name) {
+	for (; macros; macros = macros->next) {
+		if (strcmp(macros->name, name) == 0) return macros;
+	}
+	return NULL;
+}
+
+void free_macros(Macro* macros) {
+	while (macros) {
+		Macro* next = macros->next;
+		uint32_t i, j;
+		for (i = 0; i < macros->len; i++) {
+			for (j = 0; j < macros->body[i].num_tokens; j++) free(macros->body[i].tokens[j]);
+			free(macros->body[i].tokens);
+			free(macros->body[i].raw);
+		}
+		for (j = 0; j < (uint32_t)macros->num_params; j++) free(macros->params[j]);
+		free(macros->body);
+		free(macros->name);
+		free(macros);
+		macros = next;
+	}
+}
+
+/* Returns the index of the parameter of MACRO named at the start of STR, or
+   -1 if there is none.
+ */
+static int find_param(const Macro* macro, const char* str) {
+	int i;
+	for (i = 0; i < macro->num_params; i++) {
+		size_t len = strlen(macro->params[i]);
+		char next;
+		if (strncmp(str, macro->params[i], len) != 0) continue;
+		next = str[len];
+		if (next != '_' && !(next >= 'a' && next <= 'z') && !(next >= 'A' && next <= 'Z')
+			&& !(next >= '0' && next <= '9')) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Appends STR to OUT at *LEN, each parameter of MACRO in it replaced by
+   its argument in ARGS, and a NUL. Returns 0 on success and -1 if it does
+   not fit in MACRO_LINE_SIZE bytes.
+ */
+static int substitute(const Macro* macro, const char* str, char* const* args, char* out,
+	size_t* len) {
+	
+	while (*str) {
+		int param = *str == '\\' ? find_param(macro, str) : -1;
+		const char* from = param == -1 ? str : args[param];
+		size_t n = param == -1 ? 1 : strlen(from);
+		if (*len + n + 1 > MACRO_LINE_SIZE) return -1;
+		memcpy(out + *len, from, n);
+		*len += n;
+		str += param == -1 ? 1 : strlen(macro->params[param]);
+	}
+	out[(*len)++] = '\0';
+	return 0;
+}
+
+/* Expands LINE of the body of MACRO called with ARGS, without lexing it
+   again: the parameters are replaced in its tokens, which are copied to
+   STORE and pointed at by TOKENS, and in its text, copied to RAW for data
+   directives. STORE and RAW hold MACRO_LINE_SIZE bytes. Returns 0 on
+   success and -1 if the line gets too long.
+ */
+int expand_macro_line(const Macro* macro, const MacroLine* line, char* const* args,
+	char** tokens, char* store, char* raw) {
+	
+	size_t stored = 0, len = 0;
+	uint32_t i;
+	for (i = 0; i < line->num_tokens; i++) {
+		tokens[i] = store + stored;
+		if (substitute(macro, line->tokens[i], args, store, &stored) != 0) return -1;
+	}
+	return substitute(macro, line->raw, args, raw, &len);
+}
+
+/* Writes to PATH (MACRO_LINE_SIZE bytes) where the file NAME of an
+   .include in the file INCLUDING is: NAME without its quotes, relative to
+   the directory of INCLUDING unless it is absolute or INCLUDING is NULL.
+   Returns 0 on success and -1 if it does not fit.
+ */
+int resolve_include(char* path, const char* including, const char* name) {
+	const char* slash = including ? strrchr(including, '/') : NULL;
+	size_t dir, len = strlen(name);
+	if (len >= 2 && name[0] == '"' && name[len - 1] == '"') {
+		name++;
+		len -= 2;
+	}
+	dir = slash && name[0] != '/' ? (size_t)(slash - including) + 1 : 0;
+	if (!len || dir + len + 1 > MACRO_LINE_SIZE) return -1;
+	memcpy(path, including, dir);
+	memcpy(path + dir, name, len);
+	path[dir + len] = '\0';
+	return 0;
+}
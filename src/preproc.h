@@ -0,0 +1,97 @@
+#ifndef PREPROC_H
+#define PREPROC_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define LEX_SEPARATORS " \f\n\r\t\v,()"    /* between tokens, see pass_one() */
+#define MAX_INCLUDE_DEPTH 16    /* nested .include files and macro calls */
+#define MAX_MACRO_PARAMS 8
+#define MACRO_LINE_SIZE 1024    /* longest expanded line, like BUF_SIZE */
+
+/* A line of a lexed file: its NUM_TOKENS tokens start at FIRST in the
+   file's TOKENS, and its text, comments and all, at RAW in its map.
+ */
+typedef struct LexLine {
+    uint32_t line;              /* 1-based, empty lines included */
+    uint32_t first;
+    uint32_t num_tokens;
+    uint32_t raw;
+    uint32_t raw_len;
+} LexLine;
+
+/* A file split into lines of tokens the way pass one splits its input, from
+   a read-only mapping that stays in place for the raw text. Only lines with
+   tokens are kept.
+ */
+typedef struct LexFile {
+    char* path;
+    off_t size;
+    struct timespec mtime;      /* to the nanosecond, saves within a second differ */
+    char* map;
+    LexLine* lines;
+    uint32_t num_lines;
+    char** tokens;
+    uint32_t num_tokens;
+    char* store;                /* the NUL-terminated tokens */
+    struct LexFile* next;
+} LexFile;
+
+/* Files lexed for .include, kept for the next assembly that includes them
+   as long as their size and modification time stay the same. Not locked:
+   share a cache only between assemblies on one thread.
+ */
+typedef struct IncludeCache {
+    LexFile* files;
+    uint64_t lookups;
+    uint64_t hits;
+} IncludeCache;
+
+/* A line of a macro body: its tokens and its text. */
+typedef struct MacroLine {
+    uint32_t num_tokens;
+    char** tokens;
+    char* raw;
+} MacroLine;
+
+/* A macro defined with .macro: its parameters, written "\name" where they
+   are used, and its body up to .endm.
+ */
+typedef struct Macro {
+    char* name;
+    char* params[MAX_MACRO_PARAMS]; /* with the leading '\' */
+    int num_params;
+    MacroLine* body;
+    uint32_t len;
+    uint32_t cap;
+    struct Macro* next;
+} Macro;
+
+IncludeCache* create_include_cache(struct LogCapture* log);
+
+void free_include_cache(IncludeCache* cache);
+
+/* Returns the file at PATH lexed into lines, lexing it only once. */
+LexFile* get_lexed_file(IncludeCache* cache, const char* path, struct LogCapture* log);
+
+void forget_lexed_file(IncludeCache* cache, LexFile* file);
+
+Macro* define_macro(Macro** macros, const char* name, char* const* params, int num_params,
+    struct LogCapture* log);
+
+void add_macro_line(Macro* macro, char* const* tokens, uint32_t num_tokens, const char* raw,
+    struct LogCapture* log);
+
+Macro* find_macro(Macro* macros, const char* name);
+
+void free_macros(Macro* macros);
+
+/* Expands LINE of MACRO called with ARGS into TOKENS, STORE and RAW. */
+int expand_macro_line(const Macro* macro, const MacroLine* line, char* const* args,
+    char** tokens, char* store, char* raw);
+
+/* Writes to PATH where the file NAME of an .include in INCLUDING is. */
+int resolve_include(char* path, const char* including, const char* name);
+
+#endif
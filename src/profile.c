@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tables.h"
+#include "object.h"
+#include "sim.h"
+#include "profile.h"
+
+#define LINE_SIZE 1024
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+static int is_cond_branch(uint32_t word) {
+	return (word >> 26) == 0x04 || (word >> 26) == 0x05; /* beq, bne */
+}
+
+/* Writes the hottest instructions of SIM, each symbolized as label+offset
+   through a binary search over the symbols of OBJ sorted by address.
+ */
+static void write_hot_spots(FILE* output, Object* obj, Sim* sim) {
+	uint32_t hot[PROFILE_HOT];
+	uint32_t num_hot = 0, i, j;
+	Symbol** view = sort_by_addr(obj->symtbl);
+	for (i = 0; i < obj->text_len; i++) { /* Insertion into the top list */
+		if (!sim->counts[i]) continue;
+		for (j = num_hot; j > 0 && sim->counts[hot[j - 1]] < sim->counts[i]; j--) {
+			if (j < PROFILE_HOT) hot[j] = hot[j - 1];
+		}
+		if (j < PROFILE_HOT) hot[j] = i;
+		if (num_hot < PROFILE_HOT) num_hot++;
+	}
+	fprintf(output, "\nHot spots:\n");
+	for (i = 0; i < num_hot; i++) {
+		uint32_t addr = 4 * hot[i];
+		Symbol* sym = find_symbol_for_addr(view, obj->symtbl->len, addr);
+		fprintf(output, "  0x%08x  %s+%u  line %u  %lu\n", sim->text_base + addr,
+			sym ? sym->name : "<text>", sym ? addr - sym->addr : addr,
+			get_line_for_addr(obj->lines, addr), (unsigned long)sim->counts[hot[i]]);
+	}
+	free(view);
+}
+
+static int is_transfer(uint32_t word) {
+	return is_cond_branch(word) || (word >> 26) == 0x02 || (word & 0xfc00003f) == 0x08; /* j, jr */
+}
+
+/*******************************
+ * Profile Report
+ *******************************/
+
+/* Writes SOURCE, the .s file OBJ was assembled from with -g, to OUTPUT with
+   each line prefixed by how often it ran in the last run_sim() of SIM (with
+   profiling enabled) and, for lines with a conditional branch, how often
+   the branch was taken. A line runs as often as its most frequent
+   instruction. A list of the hottest instructions follows.
+ */
+void write_profile(FILE* output, FILE* source, Object* obj, Sim* sim) {
+	char buf[LINE_SIZE];
+	uint32_t i, line = 0, num_lines = 0;
+	uint64_t *line_counts, *branch_counts, *branch_taken;
+	for (i = 0; i < obj->lines->len; i++) {
+		if (obj->lines->lines[i] > num_lines) num_lines = obj->lines->lines[i];
+	}
+	line_counts = calloc(num_lines + 1, sizeof(uint64_t));
+	branch_counts = calloc(num_lines + 1, sizeof(uint64_t));
+	branch_taken = calloc(num_lines + 1, sizeof(uint64_t));
+	if (!line_counts || !branch_counts || !branch_taken) allocation_failed(NULL);
+  /* Fold instruction counts into lines */
+	for (i = 0; i < obj->text_len; i++) {
+		uint32_t l = get_line_for_addr(obj->lines, 4 * i);
+		if (sim->counts[i] > line_counts[l]) line_counts[l] = sim->counts[i];
+		if (is_cond_branch(obj->text[i])) {
+			branch_counts[l] += sim->counts[i];
+			branch_taken[l] += sim->taken_counts[i];
+		}
+	}
+  /* Annotate the source */
+	fprintf(output, "%6s %12s %7s | %s\n", "Line", "Count", "Taken", "Source");
+	while (fgets(buf, LINE_SIZE, source)) {
+		line++;
+		buf[strcspn(buf, "\r\n")] = '\0';
+		if (line > num_lines || !line_counts[line]) {
+			fprintf(output, "%6u %12s %7s | %s\n", line, "", "", buf);
+		} else if (branch_counts[line]) {
+			fprintf(output, "%6u %12lu %6.1f%% | %s\n", line, (unsigned long)line_counts[line],
+				100.0 * branch_taken[line] / branch_counts[line], buf);
+		} else {
+			fprintf(output, "%6u %12lu %7s | %s\n", line, (unsigned long)line_counts[line], "", buf);
+		}
+	}
+	write_hot_spots(output, obj, sim);
+	free(line_counts);
+	free(branch_counts);
+	free(branch_taken);
+}
+
+/* Writes the branch profile of the last run_sim() of SIM to OUTPUT in the
+   format read by read_profile(): one line per executed instruction that
+   starts a basic block or transfers control, keyed by label+offset so that
+   it still applies when the source is assembled again.
+ */
+void write_counts(FILE* output, Object* obj, Sim* sim) {
+	uint32_t i;
+	Symbol** view = sort_by_addr(obj->symtbl);
+	fprintf(output, "# <label>[+<offset>] <executions> [<taken>]\n");
+	for (i = 0; i < obj->text_len; i++) {
+		uint32_t addr = 4 * i;
+		Symbol* sym = find_symbol_for_addr(view, obj->symtbl->len, addr);
+		if (!sim->counts[i] || !sym) continue;
+		if (is_transfer(obj->text[i])) {
+			fprintf(output, "%s+%u %lu %lu\n", sym->name, addr - sym->addr,
+				(unsigned long)sim->counts[i], (unsigned long)sim->taken_counts[i]);
+		} else if (sym->addr == addr || (i > 0 && is_transfer(obj->text[i - 1]))) {
+			fprintf(output, "%s+%u %lu\n", sym->name, addr - sym->addr,
+				(unsigned long)sim->counts[i]);
+		}
+	}
+	free(view);
+}
@@ -0,0 +1,14 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#define PROFILE_HOT 5       /* instructions listed as hot spots */
+
+/* Writes SOURCE to OUTPUT with the counts of the last run of SIM. */
+void write_profile(FILE* output, FILE* source, Object* obj, Sim* sim);
+
+/* Writes the branch profile of the last run of SIM, for read_profile(). */
+void write_counts(FILE* output, Object* obj, Sim* sim);
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "translate_utils.h"
+#include "ir.h"
+#include "relax.h"
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+/* Returns 1 if INST is a beq/bne to a label that is defined in SYMTBL but
+   lies outside the 16-bit offset range at byte offset ADDR, 0 otherwise.
+   Branches to unknown labels are left alone for pass two to report.
+ */
+int branch_out_of_range(Inst* inst, uint32_t addr, SymbolTable* symtbl) {
+	int64_t label_addr, imm_addr;
+	if (strcmp(inst->name, "beq") != 0 && strcmp(inst->name, "bne") != 0) return 0;
+	if (inst->num_args != 3 || !is_valid_label(inst->args[2])) return 0;
+	label_addr = get_addr_for_symbol(symtbl, inst->args[2]);
+	if (label_addr == -1) return 0;
+	imm_addr = (label_addr - addr - 4) / 4; /* Same as write_branch() */
+	return imm_addr < -32768 || imm_addr > 32767;
+}
+
+/* One relaxation round. Builds the rewritten instructions into OUT and fills
+   NEW_INDEX for remap_symbols(). Returns the number of branches rewritten.
+ */
+static uint32_t relax_round(InstList* list, InstList* out, uint32_t* new_index,
+	SymbolTable* symtbl) {
+	
+	uint32_t i, relaxed = 0;
+	char* sub_args[3];
+	for (i = 0; i < list->len; i++) {
+		Inst* inst = &list->insts[i];
+		new_index[i] = out->len;
+		if (branch_out_of_range(inst, 4 * i, symtbl)) {
+			sub_args[0] = inst->args[0]; /* Inverted branch over the jump */
+			sub_args[1] = inst->args[1];
+			sub_args[2] = "%rel:1";
+			append_inst(out, strcmp(inst->name, "beq") == 0 ? "bne" : "beq", sub_args, 3, inst->line);
+			sub_args[0] = inst->args[2]; /* Jump to the original target */
+			append_inst(out, "j", sub_args, 1, inst->line);
+			relaxed++;
+		} else {
+			append_inst(out, inst->name, inst->args, inst->num_args, inst->line);
+		}
+	}
+	new_index[list->len] = out->len;
+	return relaxed;
+}
+
+static void release_inst_list(void* list) {
+	free_inst_list(list);
+}
+
+/*******************************
+ * Branch Relaxation
+ *******************************/
+
+/* Rewrites every beq/bne in LIST whose target does not fit in the 16-bit
+   offset field into an inverted branch over a j:
+
+	beq $rs, $rt, far      ->     bne $rs, $rt, %rel:1
+	                              j far
+
+   Every rewrite grows the code and may push other branches out of range, so
+   rounds are repeated until no branch changes. Since code only grows, this
+   always converges. Symbols in SYMTBL are moved along with their
+   instructions.
+
+   Returns the total number of branches rewritten.
+ */
+uint32_t relax_branches(InstList* list, SymbolTable* symtbl) {
+	uint32_t total = 0, relaxed;
+	do {
+		InstList* out = create_inst_list(list->log);
+		uint32_t* new_index = malloc((list->len + 1) * sizeof(uint32_t));
+		if (!new_index) {
+			free_inst_list(out);
+			allocation_failed(list->log);
+		}
+		push_cleanup(list->log, release_inst_list, out); /* relax_round() appends to it */
+		push_cleanup(list->log, free, new_index);
+		relaxed = relax_round(list, out, new_index, symtbl);
+		pop_cleanup(list->log, new_index);
+		pop_cleanup(list->log, out);
+		if (relaxed) {
+			remap_symbols(symtbl, new_index, list->len);
+			swap_inst_lists(list, out); /* Old instructions are freed with OUT */
+		}
+		free(new_index);
+		free_inst_list(out);
+		total += relaxed;
+	} while (relaxed);
+	return total;
+}
@@ -0,0 +1,12 @@
+#ifndef RELAX_H
+#define RELAX_H
+
+#include <stdint.h>
+
+/* Returns 1 if INST, at byte offset ADDR, is a branch that needs relaxing. */
+int branch_out_of_range(Inst* inst, uint32_t addr, SymbolTable* symtbl);
+
+/* Rewrites beq/bne whose target is out of range into a branch over a j. */
+uint32_t relax_branches(InstList* list, SymbolTable* symtbl);
+
+#endif
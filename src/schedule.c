@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "translate_utils.h"
+#include "ir.h"
+#include "schedule.h"
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+static int is_terminator(int kind) {
+	return kind == INST_BRANCH || kind == INST_JUMP || kind == INST_JR || kind == INST_CALL;
+}
+
+/* Returns the latency of the dependence of B on A, which comes before it,
+   or 0 if they may be swapped. Registers are tracked exactly, so the $at
+   that li, la and bge expand through orders its users like any register.
+   Memory is not: stores stay in order with every load and store.
+ */
+static int dependence(const InstInfo* a, const InstInfo* b) {
+	if (a->defs & b->uses) return a->kind == INST_LOAD ? 2 : 1; /* RAW */
+	if ((a->uses & b->defs) || (a->defs & b->defs)) return 1;   /* WAR, WAW */
+	if ((a->kind == INST_STORE && (b->kind == INST_LOAD || b->kind == INST_STORE))
+		|| (a->kind == INST_LOAD && b->kind == INST_STORE)) return 1;
+	if (is_terminator(b->kind)) return 1; /* Stays last */
+	return 0;
+}
+
+/* Reorders the N instructions of LIST starting at START, whose dependences
+   form a DAG, by list scheduling: each step places the ready instruction
+   that does not read the result of a load placed right before it, and among
+   those the one with the longest latency path to the end of the region.
+   Ties keep the source order. PREV_LOAD is the set of registers loaded by
+   the instruction before the region. The new order is only kept if it
+   stalls less than the old one.
+ */
+static void schedule_region(InstList* list, uint32_t start, uint32_t n, uint32_t prev_load) {
+	InstInfo info[SCHED_WINDOW];
+	char dep[SCHED_WINDOW][SCHED_WINDOW];
+	uint32_t height[SCHED_WINDOW], preds[SCHED_WINDOW];
+	char placed[SCHED_WINDOW];
+	Inst order[SCHED_WINDOW];
+	uint32_t i, j, k, old_stalls = 0, new_stalls = 0, loaded = prev_load;
+	for (i = 0; i < n; i++) {
+		decode_inst(&list->insts[start + i], &info[i]);
+		placed[i] = 0;
+		preds[i] = 0;
+		old_stalls += (loaded & info[i].uses) != 0;
+		loaded = info[i].kind == INST_LOAD ? info[i].defs : 0;
+	}
+	for (i = n; i-- > 0;) { /* Edges and path lengths, from the end */
+		height[i] = 1;
+		for (j = i + 1; j < n; j++) {
+			dep[i][j] = (char)dependence(&info[i], &info[j]);
+			if (dep[i][j]) {
+				preds[j]++;
+				if (dep[i][j] + height[j] > height[i]) height[i] = dep[i][j] + height[j];
+			}
+		}
+	}
+	for (k = 0; k < n; k++) {
+		uint32_t best = n;
+		int best_stalls = 0;
+		for (i = 0; i < n; i++) {
+			int stalls;
+			if (placed[i] || preds[i]) continue;
+			stalls = (prev_load & info[i].uses) != 0;
+			if (best == n || stalls < best_stalls
+				|| (stalls == best_stalls && height[i] > height[best])) {
+				best = i;
+				best_stalls = stalls;
+			}
+		}
+		placed[best] = 1;
+		new_stalls += best_stalls;
+		order[k] = list->insts[start + best];
+		for (j = best + 1; j < n; j++) {
+			if (dep[best][j]) preds[j]--;
+		}
+		prev_load = info[best].kind == INST_LOAD ? info[best].defs : 0;
+	}
+	if (new_stalls < old_stalls) memcpy(&list->insts[start], order, n * sizeof(Inst));
+}
+
+/* Returns the registers loaded by the instruction before index I of LIST. */
+static uint32_t loaded_before(InstList* list, uint32_t i) {
+	InstInfo info;
+	if (i == 0) return 0;
+	decode_inst(&list->insts[i - 1], &info);
+	return info.kind == INST_LOAD ? info.defs : 0;
+}
+
+/*******************************
+ * Load Scheduling
+ *******************************/
+
+/* Returns the number of loads in LIST directly followed by an instruction
+   that reads the loaded register, each of which stalls the pipeline for a
+   cycle when it runs.
+ */
+uint32_t count_load_stalls(InstList* list) {
+	uint32_t i, stalls = 0;
+	InstInfo info, next;
+	for (i = 0; i + 1 < list->len; i++) {
+		decode_inst(&list->insts[i], &info);
+		if (info.kind != INST_LOAD) continue;
+		decode_inst(&list->insts[i + 1], &next);
+		if (info.defs & next.uses) stalls++;
+	}
+	return stalls;
+}
+
+/* Moves independent instructions of LIST into the shadow of loads whose
+   result is used right away. Each basic block is split into regions of at
+   most SCHED_WINDOW instructions, ended by a branch, jump or call (which
+   stays last) or by an instruction decode_inst() does not know (which is
+   left in place). Regions are scheduled by schedule_region(). Since no
+   region contains a label after its first instruction and the length of
+   the list does not change, SYMTBL stays valid as it is.
+ */
+void schedule_loads(InstList* list, SymbolTable* symtbl) {
+	uint32_t i, start = 0;
+	InstInfo info;
+	char* leaders = find_leaders(list, symtbl);
+	for (i = 0; i <= list->len; i++) {
+		int kind = INST_OTHER;
+		if (i < list->len) {
+			decode_inst(&list->insts[i], &info);
+			kind = info.kind;
+		}
+		if (i > start && (leaders[i] || kind == INST_OTHER || i - start == SCHED_WINDOW)) {
+			schedule_region(list, start, i - start, loaded_before(list, start));
+			start = i;
+		}
+		if (kind == INST_OTHER) {
+			start = i + 1;
+		} else if (is_terminator(kind)) {
+			schedule_region(list, start, i + 1 - start, loaded_before(list, start));
+			start = i + 1;
+		}
+	}
+	free(leaders);
+}
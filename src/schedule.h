@@ -0,0 +1,14 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+
+#define SCHED_WINDOW 64     /* Most instructions scheduled as one region */
+
+/* Returns the number of loads in LIST whose result is used right away. */
+uint32_t count_load_stalls(InstList* list);
+
+/* Moves independent instructions of LIST into the shadow of such loads. */
+void schedule_loads(InstList* list, SymbolTable* symtbl);
+
+#endif
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "object.h"
+#include "sim.h"
+
+#define ADDR_SPACE ((uint64_t)1 << 32)
+
+/* Micro-op kinds. Every instruction translate_inst() encodes has one, which
+   covers all pseudoinstruction expansions of write_pass_one() too.
+ */
+#define OP_ADDU   0
+#define OP_OR     1
+#define OP_SLT    2
+#define OP_SLTU   3
+#define OP_SLL    4
+#define OP_JR     5
+#define OP_ADDIU  6
+#define OP_ORI    7
+#define OP_LUI    8
+#define OP_LB     9
+#define OP_LBU    10
+#define OP_LW     11
+#define OP_SB     12
+#define OP_SW     13
+#define OP_BEQ    14
+#define OP_BNE    15
+#define OP_J      16
+#define OP_JAL    17
+#define OP_HALT   18        /* end of .text */
+#define OP_BAD    19        /* illegal instruction or target */
+#define NUM_OPS   20
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+/* Returns where the SIZE bytes at address EA are held, or NULL if no single
+   segment holds them all. The offset into a segment is taken modulo 2^32,
+   so addresses below its base are far past its end.
+ */
+static uint8_t* locate(Sim* sim, uint32_t ea, uint32_t size) {
+	int i;
+	for (i = 0; i < NUM_SEGS; i++) {
+		const Segment* seg = &sim->segs[i];
+		uint32_t off = ea - seg->base;
+		if ((uint64_t)off + size <= seg->size) return seg->bytes + off;
+	}
+	return NULL;
+}
+
+/* Allocates SEG, SIZE zeroed bytes from BASE. */
+static void init_segment(Segment* seg, uint32_t base, uint32_t size) {
+	seg->base = base;
+	seg->size = size;
+	seg->bytes = calloc(size ? size : 1, 1);
+	if (!seg->bytes) allocation_failed(NULL);
+}
+
+/* Maps the target address ADDR to an index into the micro-ops, or to the
+   OP_BAD entry if it is outside .text or not word-aligned.
+ */
+static int32_t target_index(Sim* sim, uint32_t addr) {
+	uint32_t off = addr - sim->text_base;
+	if (off % 4 || off / 4 > sim->text_len) return (int32_t)sim->text_len + 1;
+	return (int32_t)(off / 4);
+}
+
+/* Decodes WORD, the instruction at index I, into U. */
+static void decode_word(Sim* sim, uint32_t i, uint32_t word, Uop* u) {
+	uint32_t opcode = word >> 26, funct = word & 0x3f;
+	uint32_t next_pc = sim->text_base + 4 * (i + 1);
+	u->rs = (word >> 21) & 0x1f;
+	u->rt = (word >> 16) & 0x1f;
+	u->rd = (word >> 11) & 0x1f;
+	u->imm = (int16_t)(word & 0xffff);
+	u->stall = 0;
+	switch (opcode) {
+		case 0x00:
+			switch (funct) {
+				case 0x21: u->op = OP_ADDU; break;
+				case 0x25: u->op = OP_OR; break;
+				case 0x2a: u->op = OP_SLT; break;
+				case 0x2b: u->op = OP_SLTU; break;
+				case 0x00: u->op = OP_SLL; u->imm = (word >> 6) & 0x1f; break;
+				case 0x08: u->op = OP_JR; break;
+				default: u->op = OP_BAD;
+			}
+			break;
+		case 0x09: u->op = OP_ADDIU; u->rd = u->rt; break;
+		case 0x0d: u->op = OP_ORI; u->rd = u->rt; u->imm = word & 0xffff; break;
+		case 0x0f: u->op = OP_LUI; u->rd = u->rt; u->imm = (int32_t)(word << 16); break;
+		case 0x20: u->op = OP_LB; u->rd = u->rt; break;
+		case 0x24: u->op = OP_LBU; u->rd = u->rt; break;
+		case 0x23: u->op = OP_LW; u->rd = u->rt; break;
+		case 0x28: u->op = OP_SB; break;
+		case 0x2b: u->op = OP_SW; break;
+		case 0x04: u->op = OP_BEQ; u->imm = target_index(sim, next_pc + 4 * u->imm); break;
+		case 0x05: u->op = OP_BNE; u->imm = target_index(sim, next_pc + 4 * u->imm); break;
+		case 0x02: case 0x03:
+			u->op = opcode == 0x02 ? OP_J : OP_JAL;
+			u->imm = target_index(sim, (next_pc & 0xf0000000) | ((word & 0x3ffffff) << 2));
+			break;
+		default: u->op = OP_BAD;
+	}
+	if (u->rd == 0) u->rd = 32; /* Writes to $0 land in the scratch slot */
+}
+
+/* Returns 1 if the micro-op U reads register REG. */
+static int reads_reg(const Uop* u, uint8_t reg) {
+	switch (u->op) {
+		case OP_ADDU: case OP_OR: case OP_SLT: case OP_SLTU:
+		case OP_SB: case OP_SW: case OP_BEQ: case OP_BNE:
+			return u->rs == reg || u->rt == reg;
+		case OP_SLL:
+			return u->rt == reg;
+		case OP_JR: case OP_ADDIU: case OP_ORI: case OP_LB: case OP_LBU: case OP_LW:
+			return u->rs == reg;
+		default:
+			return 0;
+	}
+}
+
+/* Decodes all of .text once. Two extra entries follow the program: OP_HALT,
+   reached by running off the end, and OP_BAD, which every invalid target
+   index points at. A load stalls if the next instruction, which is always
+   the one after it, reads its result, so that is decided here too.
+ */
+static void predecode(Sim* sim, const uint32_t* text) {
+	uint32_t i;
+	for (i = 0; i < sim->text_len; i++) decode_word(sim, i, text[i], &sim->uops[i]);
+	memset(&sim->uops[sim->text_len], 0, 2 * sizeof(Uop));
+	sim->uops[sim->text_len].op = OP_HALT;
+	sim->uops[sim->text_len + 1].op = OP_BAD;
+	for (i = 0; i + 1 < sim->text_len; i++) {
+		Uop* u = &sim->uops[i];
+		if ((u->op == OP_LB || u->op == OP_LBU || u->op == OP_LW) && u->rd != 32) {
+			u->stall = (uint8_t)reads_reg(&sim->uops[i + 1], u->rd);
+		}
+	}
+}
+
+/*******************************
+ * Simulator Functions
+ *******************************/
+
+/* Creates a simulator for the linked object OBJ with .text loaded at
+   TEXT_BASE and .data at DATA_BASE() of .text after it, each a segment of
+   its own, and MEM_SIZE bytes of memory from address 0 for the stack and
+   whatever else the program stores. .text and .data take precedence where
+   they overlap it. $sp starts at the top of that memory and $ra at 0, so
+   that returning from the entry point ends the run. Returns NULL, after
+   logging why, if .text or .data would wrap past the end of the address
+   space.
+ */
+Sim* create_sim(Object* obj, uint32_t text_base, uint32_t mem_size) {
+	uint64_t text_size = 4 * (uint64_t)obj->text_len;
+	uint64_t data_base = text_base + DATA_BASE(text_size);
+	uint32_t i;
+	Sim* sim;
+	if (text_base + text_size > ADDR_SPACE
+		|| (obj->data_len && data_base + obj->data_len > ADDR_SPACE)) {
+		write_to_log("Error: program does not fit in memory at 0x%08x\n", text_base);
+		return NULL;
+	}
+	sim = malloc(sizeof(Sim));
+	if (!sim) allocation_failed(NULL);
+	sim->text_len = obj->text_len;
+	sim->text_base = text_base;
+	init_segment(&sim->segs[SEG_TEXT], text_base, (uint32_t)text_size);
+	init_segment(&sim->segs[SEG_DATA], (uint32_t)data_base, obj->data_len);
+	init_segment(&sim->segs[SEG_MEM], 0, mem_size);
+	sim->uops = malloc((obj->text_len + 2) * sizeof(Uop));
+	if (!sim->uops) allocation_failed(NULL);
+	for (i = 0; i < obj->text_len; i++) { /* Copy .text into memory */
+		uint8_t* p = sim->segs[SEG_TEXT].bytes + 4 * i;
+		p[0] = obj->text[i] & 0xff;
+		p[1] = (obj->text[i] >> 8) & 0xff;
+		p[2] = (obj->text[i] >> 16) & 0xff;
+		p[3] = obj->text[i] >> 24;
+	}
+	memcpy(sim->segs[SEG_DATA].bytes, obj->data, obj->data_len); /* And .data */
+	predecode(sim, obj->text);
+	sim->counts = sim->taken_counts = NULL;
+	memset(sim->regs, 0, sizeof(sim->regs));
+	sim->regs[29] = mem_size; /* $sp */
+	return sim;
+}
+
+/* Makes run_sim() count, for every instruction index I, how often it ran in
+   COUNTS[I] and how often it transferred control in TAKEN_COUNTS[I].
+ */
+void enable_profile(Sim* sim) {
+	sim->counts = calloc(sim->text_len + 2, sizeof(uint64_t));
+	sim->taken_counts = calloc(sim->text_len + 2, sizeof(uint64_t));
+	if (!sim->counts || !sim->taken_counts) allocation_failed(NULL);
+}
+
+void free_sim(Sim* sim) {
+	int i;
+	free(sim->counts);
+	free(sim->taken_counts);
+	free(sim->uops);
+	for (i = 0; i < NUM_SEGS; i++) free(sim->segs[i].bytes);
+	free(sim);
+}
+
+/* Memory access helpers. EA is the effective address, a fault (NULL) if no
+   segment holds it or, for words, it is not aligned.
+ */
+#define LOAD_WORD(p) ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) \
+	| ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+#define WORD_AT(ea) ((ea) % 4 ? NULL : locate(sim, ea, 4))
+#define BYTE_AT(ea) locate(sim, ea, 1)
+
+/* Dispatch. With GCC each handler jumps straight to the next one through a
+   table of label addresses (threaded code); otherwise a switch is used. The
+   handlers are the same either way, see sim_loop.h.
+ */
+#if defined(__GNUC__) && !defined(SIM_NO_THREADING)
+#define SIM_THREADED
+#define HANDLER(op) L_##op:
+#else
+#define HANDLER(op) case op:
+#endif
+
+#ifdef SIM_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+#define SIM_RUN run_fast
+#include "sim_loop.h"
+#undef SIM_RUN
+
+#define SIM_RUN run_profiled
+#define SIM_PROFILE
+#include "sim_loop.h"
+#undef SIM_PROFILE
+#undef SIM_RUN
+
+#ifdef SIM_THREADED
+#pragma GCC diagnostic pop
+#endif
+
+/* Runs SIM from the first instruction until it exits, faults or has run
+   MAX_INSTS instructions (0 for no limit), and fills STATS. Registers and
+   memory are left as the program left them. After enable_profile(), the
+   per-instruction counters are updated too, at some cost in speed.
+
+   Cycles follow a simple in-order pipeline: one per instruction, plus one
+   for each load whose result the next instruction reads and one for each
+   taken branch, jump or jr.
+ */
+void run_sim(Sim* sim, uint64_t max_insts, SimStats* stats) {
+	if (sim->counts) run_profiled(sim, max_insts, stats);
+	else run_fast(sim, max_insts, stats);
+}
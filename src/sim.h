@@ -0,0 +1,62 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+#define SIM_MEM_SIZE 0x01000000  /* default size of the memory from 0 */
+
+#define SIM_EXIT  0         /* jr to the initial $ra, or ran off the end */
+#define SIM_FAULT 1         /* bad instruction, target or memory access */
+#define SIM_LIMIT 2         /* instruction limit reached */
+
+/* A micro-op: one pre-decoded instruction of .text. */
+typedef struct Uop {
+    uint8_t op;
+    uint8_t rd;             /* destination, 32 (a scratch slot) instead of $0 */
+    uint8_t rs;
+    uint8_t rt;
+    uint8_t stall;          /* a load whose result the next instruction reads */
+    int32_t imm;            /* extended immediate, shift amount or target index */
+} Uop;
+
+/* SIZE bytes of simulated memory from address BASE, little-endian. */
+typedef struct Segment {
+    uint32_t base;
+    uint32_t size;
+    uint8_t* bytes;
+} Segment;
+
+#define SEG_TEXT  0
+#define SEG_DATA  1
+#define SEG_MEM   2
+#define NUM_SEGS  3
+
+typedef struct Sim {
+    Uop* uops;              /* text_len + 2 entries, see predecode() */
+    uint32_t text_len;
+    uint32_t text_base;
+    Segment segs[NUM_SEGS]; /* .text, .data and the memory from 0 */
+    uint32_t regs[33];
+    uint64_t* counts;       /* per instruction, see enable_profile() */
+    uint64_t* taken_counts;
+} Sim;
+
+typedef struct SimStats {
+    int status;             /* SIM_EXIT, SIM_FAULT or SIM_LIMIT */
+    uint32_t pc;            /* address of the last instruction run */
+    uint64_t insts;
+    uint64_t cycles;
+    uint64_t load_stalls;
+    uint64_t taken;         /* taken branches, jumps and jr */
+} SimStats;
+
+Sim* create_sim(Object* obj, uint32_t text_base, uint32_t mem_size);
+
+void enable_profile(Sim* sim);
+
+void free_sim(Sim* sim);
+
+/* Runs SIM until it exits, faults or has run MAX_INSTS instructions. */
+void run_sim(Sim* sim, uint64_t max_insts, SimStats* stats);
+
+#endif
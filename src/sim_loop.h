@@ -0,0 +1,137 @@
+/* The interpreter loop of sim.c. It is included once for each variant of
+   run_sim(): SIM_RUN names the function, and defining SIM_PROFILE makes it
+   count executions and taken transfers per instruction.
+ */
+
+#ifdef SIM_PROFILE
+#define COUNT() counts[u - uops]++
+#define COUNT_TAKEN() taken_counts[u - uops]++
+#else
+#define COUNT()
+#define COUNT_TAKEN()
+#endif
+
+#ifdef SIM_THREADED
+#define DISPATCH() do { COUNT(); goto *handlers[u->op]; } while (0)
+#else
+#define DISPATCH() do { COUNT(); goto dispatch; } while (0)
+#endif
+
+#define NEXT() do { u++; n++; if (n >= limit) { goto limit_hit; } DISPATCH(); } while (0)
+#define JUMP_TO(index) do { COUNT_TAKEN(); u = uops + (index); n++; taken++; \
+	if (n >= limit) { goto limit_hit; } DISPATCH(); } while (0)
+
+static void SIM_RUN(Sim* sim, uint64_t max_insts, SimStats* stats) {
+	Uop* const uops = sim->uops;
+	uint32_t* const r = sim->regs;
+	const uint64_t limit = max_insts ? max_insts : (uint64_t)-1;
+	uint64_t n = 0, stalls = 0, taken = 0;
+	uint32_t ea;
+	uint8_t* p;
+	Uop* u = uops;
+#ifdef SIM_PROFILE
+	uint64_t* const counts = sim->counts;
+	uint64_t* const taken_counts = sim->taken_counts;
+#endif
+#ifdef SIM_THREADED
+	static void* const handlers[NUM_OPS] = {
+		&&L_OP_ADDU, &&L_OP_OR, &&L_OP_SLT, &&L_OP_SLTU, &&L_OP_SLL, &&L_OP_JR,
+		&&L_OP_ADDIU, &&L_OP_ORI, &&L_OP_LUI, &&L_OP_LB, &&L_OP_LBU, &&L_OP_LW,
+		&&L_OP_SB, &&L_OP_SW, &&L_OP_BEQ, &&L_OP_BNE, &&L_OP_J, &&L_OP_JAL,
+		&&L_OP_HALT, &&L_OP_BAD
+	};
+#endif
+
+	stats->status = SIM_EXIT;
+	if (limit == 0) goto limit_hit;
+	DISPATCH();
+#ifndef SIM_THREADED
+dispatch:
+	switch (u->op) {
+#endif
+	HANDLER(OP_ADDU)  r[u->rd] = r[u->rs] + r[u->rt]; NEXT();
+	HANDLER(OP_OR)    r[u->rd] = r[u->rs] | r[u->rt]; NEXT();
+	HANDLER(OP_SLT)   r[u->rd] = (int32_t)r[u->rs] < (int32_t)r[u->rt]; NEXT();
+	HANDLER(OP_SLTU)  r[u->rd] = r[u->rs] < r[u->rt]; NEXT();
+	HANDLER(OP_SLL)   r[u->rd] = r[u->rt] << u->imm; NEXT();
+	HANDLER(OP_ADDIU) r[u->rd] = r[u->rs] + (uint32_t)u->imm; NEXT();
+	HANDLER(OP_ORI)   r[u->rd] = r[u->rs] | (uint32_t)u->imm; NEXT();
+	HANDLER(OP_LUI)   r[u->rd] = (uint32_t)u->imm; NEXT();
+	HANDLER(OP_LB)
+		ea = r[u->rs] + (uint32_t)u->imm;
+		if (!(p = BYTE_AT(ea))) goto fault;
+		r[u->rd] = (uint32_t)(int32_t)(int8_t)*p;
+		stalls += u->stall;
+		NEXT();
+	HANDLER(OP_LBU)
+		ea = r[u->rs] + (uint32_t)u->imm;
+		if (!(p = BYTE_AT(ea))) goto fault;
+		r[u->rd] = *p;
+		stalls += u->stall;
+		NEXT();
+	HANDLER(OP_LW)
+		ea = r[u->rs] + (uint32_t)u->imm;
+		if (!(p = WORD_AT(ea))) goto fault;
+		r[u->rd] = LOAD_WORD(p);
+		stalls += u->stall;
+		NEXT();
+	HANDLER(OP_SB)
+		ea = r[u->rs] + (uint32_t)u->imm;
+		if (!(p = BYTE_AT(ea))) goto fault;
+		*p = r[u->rt] & 0xff;
+		NEXT();
+	HANDLER(OP_SW)
+		ea = r[u->rs] + (uint32_t)u->imm;
+		if (!(p = WORD_AT(ea))) goto fault;
+		p[0] = r[u->rt] & 0xff;
+		p[1] = (r[u->rt] >> 8) & 0xff;
+		p[2] = (r[u->rt] >> 16) & 0xff;
+		p[3] = r[u->rt] >> 24;
+		NEXT();
+	HANDLER(OP_BEQ)
+		if (r[u->rs] == r[u->rt]) JUMP_TO(u->imm);
+		NEXT();
+	HANDLER(OP_BNE)
+		if (r[u->rs] != r[u->rt]) JUMP_TO(u->imm);
+		NEXT();
+	HANDLER(OP_J)
+		JUMP_TO(u->imm);
+	HANDLER(OP_JAL)
+		r[31] = sim->text_base + 4 * (uint32_t)(u - uops + 1);
+		JUMP_TO(u->imm);
+	HANDLER(OP_JR)
+		if (r[u->rs] == 0) { /* Returned from the entry point */
+			n++;
+			taken++;
+			goto done;
+		}
+		JUMP_TO(target_index(sim, r[u->rs]));
+	HANDLER(OP_HALT)
+		goto done;
+	HANDLER(OP_BAD)
+		goto fault;
+#ifndef SIM_THREADED
+	}
+#endif
+
+fault:
+	stats->status = SIM_FAULT;
+	goto done;
+limit_hit:
+	stats->status = SIM_LIMIT;
+done:
+	if (u >= uops + sim->text_len) u = uops + sim->text_len; /* Past the end */
+	stats->pc = sim->text_base + 4 * (uint32_t)(u - uops);
+	stats->insts = n;
+	stats->load_stalls = stalls;
+	stats->taken = taken;
+	stats->cycles = n + stalls + taken;
+	sim->regs[32] = 0;
+}
+
+
+#undef COUNT
+#undef COUNT_TAKEN
+#undef DISPATCH
+#undef NEXT
+#undef JUMP_TO
@@ -0,0 +1,244 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tables.h"
+#include "utils.h"
+#include "data.h"
+#include "iface.h"
+#include "spill.h"
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+static void spill_failed() {
+	write_to_log("Error: unable to spill symbols to disk\n");
+	allocation_failed(NULL);
+}
+
+static FILE* open_spill_file() {
+	FILE* file = tmpfile();
+	if (!file) spill_failed();
+	return file;
+}
+
+static uint64_t hash_name(const char* name) {
+	return hash_bytes(IFACE_HASH_INIT, name, strlen(name));
+}
+
+static int compare_index(const void* a, const void* b) {
+	uint64_t x = ((const SpillIndex*)a)->hash, y = ((const SpillIndex*)b)->hash;
+	return (x > y) - (x < y);
+}
+
+static void read_at(FILE* file, void* buf, size_t len, uint64_t offset) {
+	if (pread(fileno(file), buf, len, (off_t)offset) != (ssize_t)len) spill_failed();
+}
+
+/* Reads up to SPILL_MERGE_BUF records of RUN from *POS into BUF. */
+static size_t fill(SpillRun* run, SpillIndex* buf, uint64_t* pos) {
+	size_t n = run->count - *pos < SPILL_MERGE_BUF ? run->count - *pos : SPILL_MERGE_BUF;
+	if (n) read_at(run->file, buf, n * sizeof(SpillIndex), *pos * sizeof(SpillIndex));
+	*pos += n;
+	return n;
+}
+
+/* Merges the last two runs of SPILL into one, reading both in blocks. */
+static void merge_last_runs(Spill* spill) {
+	SpillRun* a = spill->runs + spill->num_runs - 2;
+	SpillRun* b = a + 1;
+	SpillIndex *abuf, *bbuf;
+	uint64_t apos = 0, bpos = 0;
+	size_t alen, blen, i = 0, j = 0;
+	FILE* out = open_spill_file();
+	abuf = malloc(2 * SPILL_MERGE_BUF * sizeof(SpillIndex));
+	if (!abuf) allocation_failed(NULL);
+	bbuf = abuf + SPILL_MERGE_BUF;
+	alen = fill(a, abuf, &apos);
+	blen = fill(b, bbuf, &bpos);
+	while (alen || blen) {
+		if (blen == 0 || (alen && abuf[i].hash <= bbuf[j].hash)) {
+			fwrite(abuf + i++, sizeof(SpillIndex), 1, out);
+			if (i == alen) {
+				alen = fill(a, abuf, &apos);
+				i = 0;
+			}
+		} else {
+			fwrite(bbuf + j++, sizeof(SpillIndex), 1, out);
+			if (j == blen) {
+				blen = fill(b, bbuf, &bpos);
+				j = 0;
+			}
+		}
+	}
+	if (fflush(out) != 0) spill_failed();
+	free(abuf);
+	fclose(a->file);
+	fclose(b->file);
+	a->file = out;
+	a->count += b->count;
+	spill->num_runs--;
+}
+
+/* Finds the live log record of NAME, whose hash is HASH, in RUN. Returns its
+   offset in the log and stores the record in REC, or returns -1.
+ */
+static int64_t find_in_run(Spill* spill, SpillRun* run, const char* name, uint64_t hash,
+	SpillRecord* rec) {
+	
+	char buf[SPILL_NAME_MAX];
+	SpillIndex entry;
+	uint64_t lo = 0, hi = run->count; /* First entry with a hash >= HASH is lo */
+	size_t len = strlen(name);
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		read_at(run->file, &entry, sizeof(entry), mid * sizeof(entry));
+		if (entry.hash < hash) lo = mid + 1;
+		else hi = mid;
+	}
+	for (; lo < run->count; lo++) { /* Names that share the hash */
+		read_at(run->file, &entry, sizeof(entry), lo * sizeof(entry));
+		if (entry.hash != hash) break;
+		read_at(spill->log, rec, sizeof(SpillRecord), entry.offset);
+		if (!rec->live || rec->len != (len < SPILL_NAME_MAX ? len : SPILL_NAME_MAX)) continue;
+		read_at(spill->log, buf, rec->len, entry.offset + sizeof(SpillRecord));
+		if (memcmp(buf, name, rec->len) == 0) return (int64_t)entry.offset;
+	}
+	return -1;
+}
+
+/* Finds the live log record of NAME in any run, newest first. */
+static int64_t find_record(Spill* spill, const char* name, uint64_t hash, SpillRecord* rec) {
+	int i;
+	int64_t offset;
+	for (i = spill->num_runs - 1; i >= 0; i--) {
+		offset = find_in_run(spill, spill->runs + i, name, hash, rec);
+		if (offset != -1) return offset;
+	}
+	return -1;
+}
+
+/*******************************
+ * Spill Functions
+ *******************************/
+
+Spill* create_spill() {
+	Spill* spill = malloc(sizeof(Spill));
+	if (!spill) allocation_failed(NULL);
+	spill->cache = calloc(SPILL_CACHE_SLOTS, sizeof(SpillCacheEntry));
+	if (!spill->cache) allocation_failed(NULL);
+	spill->log = open_spill_file();
+	spill->log_len = 0;
+	spill->num_runs = 0;
+	spill->lookups = 0;
+	spill->cache_hits = 0;
+	return spill;
+}
+
+void free_spill(Spill* spill) {
+	int i;
+	for (i = 0; i < spill->num_runs; i++) fclose(spill->runs[i].file);
+	fclose(spill->log);
+	free(spill->cache);
+	free(spill);
+}
+
+/* Moves the COUNT symbols of the list starting at FIRST to disk: appends
+   them to the log and adds a run indexing them, merging it with the runs
+   before it while those are at most twice as large. The caller frees the
+   list. Names longer than a log record allows are cut.
+ */
+void spill_symbols(Spill* spill, Symbol* first, uint32_t count) {
+	SpillIndex* index = malloc((count + 1) * sizeof(SpillIndex));
+	SpillRecord rec;
+	SpillRun* run;
+	Symbol* cur;
+	uint32_t i;
+	if (!index) allocation_failed(NULL);
+	fseek(spill->log, 0, SEEK_END);
+	for (i = 0, cur = first; cur && i < count; i++, cur = cur->next) {
+		size_t len = strlen(cur->name);
+		rec.addr = cur->addr;
+		rec.len = len < SPILL_NAME_MAX ? len : SPILL_NAME_MAX;
+		rec.live = 1;
+		index[i].hash = hash_name(cur->name);
+		index[i].offset = spill->log_len;
+		fwrite(&rec, sizeof(rec), 1, spill->log);
+		fwrite(cur->name, 1, rec.len, spill->log);
+		spill->log_len += sizeof(rec) + rec.len;
+	}
+	if (fflush(spill->log) != 0) spill_failed();
+	qsort(index, i, sizeof(SpillIndex), compare_index);
+
+	if (spill->num_runs == SPILL_MAX_RUNS) spill_failed();
+	run = spill->runs + spill->num_runs++;
+	run->file = open_spill_file();
+	run->count = i;
+	fwrite(index, sizeof(SpillIndex), i, run->file);
+	if (fflush(run->file) != 0) spill_failed();
+	free(index);
+	while (spill->num_runs >= 2 && spill->runs[spill->num_runs - 2].count
+		<= 2 * spill->runs[spill->num_runs - 1].count) {
+		merge_last_runs(spill);
+	}
+	memset(spill->cache, 0, SPILL_CACHE_SLOTS * sizeof(SpillCacheEntry)); /* May know absent names */
+}
+
+/* Returns the address of the symbol NAME on disk, or -1 if there is none.
+   Short names are answered from the cache when they were looked up before.
+ */
+int64_t spill_lookup(Spill* spill, const char* name) {
+	SpillRecord rec;
+	uint64_t hash = hash_name(name);
+	SpillCacheEntry* entry = spill->cache + (hash & (SPILL_CACHE_SLOTS - 1));
+	int64_t addr;
+	spill->lookups++;
+	if (entry->name[0] && entry->hash == hash && strcmp(entry->name, name) == 0) {
+		spill->cache_hits++;
+		return entry->addr;
+	}
+	addr = find_record(spill, name, hash, &rec) == -1 ? -1 : (int64_t)rec.addr;
+	if (strlen(name) < SPILL_CACHE_NAME) {
+		entry->hash = hash;
+		entry->addr = addr;
+		strcpy(entry->name, name);
+	}
+	return addr;
+}
+
+/* Removes every symbol named NAME from disk by marking its log records.
+   Returns 0 if one was removed and -1 if there was none.
+ */
+int spill_remove(Spill* spill, const char* name) {
+	SpillRecord rec;
+	uint64_t hash = hash_name(name);
+	int64_t offset;
+	int found = -1;
+	while ((offset = find_record(spill, name, hash, &rec)) != -1) {
+		rec.live = 0;
+		if (pwrite(fileno(spill->log), &rec, sizeof(rec), (off_t)offset) != sizeof(rec)) {
+			spill_failed();
+		}
+		found = 0;
+	}
+	spill->cache[hash & (SPILL_CACHE_SLOTS - 1)].name[0] = '\0';
+	return found;
+}
+
+/* Writes the live symbols on disk to OUTPUT with write_sym(), in the order
+   they were added.
+ */
+void write_spill(Spill* spill, FILE* output) {
+	char name[SPILL_NAME_MAX + 1];
+	SpillRecord rec;
+	rewind(spill->log);
+	while (fread(&rec, sizeof(rec), 1, spill->log) == 1) {
+		if (fread(name, 1, rec.len, spill->log) != rec.len) spill_failed();
+		name[rec.len] = '\0';
+		if (rec.live) write_sym(output, rec.addr, name);
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stdint.h>
+
+#define SPILL_MAX_RUNS 64       /* sorted runs, more than tiered merging needs */
+#define SPILL_CACHE_SLOTS 1024  /* lookups remembered, a power of two */
+#define SPILL_CACHE_NAME 32     /* longest name cached, with its NUL */
+#define SPILL_MERGE_BUF 4096    /* index records read at once while merging */
+#define SPILL_NAME_MAX 0xffff   /* longest name kept, longer ones are cut */
+
+/* Record of a symbol in the log: its address, then LEN bytes of name. */
+typedef struct SpillRecord {
+    uint32_t addr;
+    uint16_t len;
+    uint16_t live;              /* 0 once removed */
+} SpillRecord;
+
+/* Entry of a sorted run: where in the log the symbol with this name hash is. */
+typedef struct SpillIndex {
+    uint64_t hash;
+    uint64_t offset;
+} SpillIndex;
+
+typedef struct SpillRun {
+    FILE* file;
+    uint64_t count;
+} SpillRun;
+
+typedef struct SpillCacheEntry {
+    uint64_t hash;
+    int64_t addr;               /* -1 for a name known to be absent */
+    char name[SPILL_CACHE_NAME]; /* empty if the slot is unused */
+} SpillCacheEntry;
+
+/* The part of a SymbolTable moved to disk: every symbol in insertion order
+   in a log file, indexed by runs sorted by name hash. A run is added per
+   spill and runs of similar size are merged, so there are few of them.
+   Lookups go through a small direct-mapped cache. Memory use does not depend
+   on the number of symbols.
+ */
+typedef struct Spill {
+    FILE* log;
+    uint64_t log_len;
+    SpillRun runs[SPILL_MAX_RUNS];
+    int num_runs;
+    SpillCacheEntry* cache;
+    uint64_t lookups;
+    uint64_t cache_hits;
+} Spill;
+
+Spill* create_spill();
+
+void free_spill(Spill* spill);
+
+/* Moves the COUNT symbols of the list starting at FIRST to disk. */
+void spill_symbols(Spill* spill, Symbol* first, uint32_t count);
+
+/* Returns the address of the symbol NAME on disk, or -1 if there is none. */
+int64_t spill_lookup(Spill* spill, const char* name);
+
+/* Removes every symbol named NAME from disk. Returns -1 if there was none. */
+int spill_remove(Spill* spill, const char* name);
+
+/* Writes the symbols on disk to OUTPUT, in the order they were added. */
+void write_spill(Spill* spill, FILE* output);
+
+#endif
@@ -1,138 +1,336 @@
-
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-
-#include "utils.h"
-#include "tables.h"
-
-const int SYMBOLTBL_NON_UNIQUE = 0;
-const int SYMBOLTBL_UNIQUE_NAME = 1;
-
-/*******************************
- * Helper Functions
- *******************************/
-
-void allocation_failed() {
-	write_to_log("Error: allocation failed\n");
-	exit(1);
-}
-
-void addr_alignment_incorrect() {
-	write_to_log("Error: address is not a multiple of 4.\n");
-}
-
-void name_already_exists(const char* name) {
-	write_to_log("Error: name '%s' already exists in table.\n", name);
-}
-
-void write_sym(FILE* output, uint32_t addr, const char* name) {
-	fprintf(output, "%u\t%s\n", addr, name);
-}
-
-/*******************************
- * Symbol Table Functions
- *******************************/
-
-/* Creates a new SymbolTable containg 0 elements and returns a pointer to that
-   table. Multiple SymbolTables may exist at the same time. 
-   If memory allocation fails, you should call allocation_failed(). 
-   Mode will be either SYMBOLTBL_NON_UNIQUE or SYMBOLTBL_UNIQUE_NAME. You will need
-   to store this value for use during add_to_table().
- */
-SymbolTable* create_table(int mode) {
-	SymbolTable* tbl = malloc(sizeof(SymbolTable)); /* Alloc for table */
-	Symbol* head = malloc(sizeof(Symbol)); /* Alloc for header */
-	if (!tbl) allocation_failed();
-	if (!head) allocation_failed();
-	head->name = NULL; /* Initialize header */
-	head->addr = 0;
-	head->next = NULL;
-	tbl->head = head; /* Initialize table */
-	tbl->tail = head;
-	tbl->len = 0;
-	tbl->mode = mode; /* Assign mode */
-	return tbl;
-}
-
-/* Frees the given SymbolTable and all associated memory. */
-void free_table(SymbolTable* table) {
-	Symbol* del;
-	while (table->head->next) { /* Loop for every non-header node */
-		del = table->head->next;
-		table->head->next = del->next;
-		free(del->name); /* Delete the node */
-		free(del);
-	}
-	free(table->head); /* Free header and table */
-	free(table);
-}
-
-/* Adds a new symbol and its address to the SymbolTable pointed to by TABLE. 
-   1. ADDR is given as the byte offset from the first instruction. 
-   2. The SymbolTable must be able to resize itself as more elements are added. 
-
-   3. Note that NAME may point to a temporary array, so it is not safe to simply
-   store the NAME pointer. You must store a copy of the given string.
-
-   4. If ADDR is not word-aligned, you should call addr_alignment_incorrect() 
-   and return -1. 
-
-   5. If the table's mode is SYMTBL_UNIQUE_NAME and NAME already exists 
-   in the table, you should call name_already_exists() and return -1. 
-
-   6.If memory allocation fails, you should call allocation_failed(). 
-
-   Otherwise, you should store the symbol name and address and return 0.
- */
-int add_to_table(SymbolTable* table, const char* name, uint32_t addr) {
-  /* Check addr word alignment */
-	if (addr % 4) {
-		addr_alignment_incorrect();
-		return -1;
-	}
-  /* Adding */
-	if (table->mode == SYMBOLTBL_NON_UNIQUE) append_sym(table, name, addr); /* Non-unique mode, directly append to tail */
-	else { /* Unique mode */
-		Symbol* cur = table->head;
-		while ((cur = cur->next)) {
-			if (strcmp(cur->name, name) == 0) { /* If already exist, fail */
-				name_already_exists(name);
-				return -1;
-			}
-		}
-		append_sym(table, name, addr); /* Else append to tail */
-	}
-	return 0;
-}
-
-/* Auxiliary function for appending a node to table tail */
-void append_sym(SymbolTable* table, const char* name, uint32_t addr) {
-	Symbol* sym = malloc(sizeof(Symbol)); /* Alloc for this node */
-	if (!sym) allocation_failed();
-	sym->name = malloc(strlen(name)+1); /* Copy name */
-	if (!sym->name) allocation_failed();
-	strcpy(sym->name, name);
-	sym->addr = addr; /* Initialize the node */
-	sym->next = NULL;
-	table->tail->next = sym; /* Append the node to tail */
-	table->tail = sym;
-	table->len++;
-}
-
-/* Returns the address (byte offset) of the given symbol. If a symbol with name
-   NAME is not present in TABLE, return -1.
- */
-int64_t get_addr_for_symbol(SymbolTable* table, const char* name) {   
-	Symbol* cur = table->head;
-	while ((cur = cur->next)) if (strcmp(cur->name, name) == 0) return cur->addr; /* Loop through the list to search */
-	return -1; /* Not found */
-}
-
-/* Writes the SymbolTable TABLE to OUTPUT. You should use write_sym() to
-   perform the write. Do not print any additional whitespace or characters.
- */
-void write_table(SymbolTable* table, FILE* output) {
-	Symbol* cur = table->head;
-	while ((cur = cur->next)) write_sym(output, cur->addr, cur->name); /* Loop through the list to write */
-}
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "spill.h"
+
+const int SYMBOLTBL_NON_UNIQUE = 0;
+const int SYMBOLTBL_UNIQUE_NAME = 1;
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+/* Logs the failure to LOG and, after freeing what was registered with it
+   (see push_cleanup()), jumps back to the library caller through its
+   ON_FAILURE. Exits if LOG is NULL.
+ */
+void allocation_failed(LogCapture* log) {
+	log_to(log, "Error: allocation failed\n");
+	if (!log) exit(1);
+	run_cleanups(log);
+	longjmp(log->on_failure, 1); /* Back to the library caller */
+}
+
+void addr_alignment_incorrect(LogCapture* log) {
+	log_to(log, "Error: address is not a multiple of 4.\n");
+}
+
+void name_already_exists(LogCapture* log, const char* name) {
+	if (is_log_structured(log)) return; /* The caller knows the line */
+	log_to(log, "Error: name '%s' already exists in table.\n", name);
+}
+
+void write_sym(FILE* output, uint32_t addr, const char* name) {
+	fprintf(output, "%u\t%s\n", addr, name);
+}
+
+/*******************************
+ * Symbol Table Functions
+ *******************************/
+
+/* Creates a new SymbolTable containg 0 elements and returns a pointer to that
+   table. Multiple SymbolTables may exist at the same time. 
+   If memory allocation fails, you should call allocation_failed(). 
+   Mode will be either SYMBOLTBL_NON_UNIQUE or SYMBOLTBL_UNIQUE_NAME. You will need
+   to store this value for use during add_to_table(). Errors, allocation
+   failures included, go to LOG.
+ */
+SymbolTable* create_table(int mode, LogCapture* log) {
+	SymbolTable* tbl = malloc(sizeof(SymbolTable)); /* Alloc for table */
+	Symbol* head = malloc(sizeof(Symbol)); /* Alloc for header */
+	if (!tbl || !head) { /* Free whichever was allocated */
+		free(tbl);
+		free(head);
+		allocation_failed(log);
+	}
+	head->name = NULL; /* Initialize header */
+	head->addr = 0;
+	head->next = NULL;
+	tbl->head = head; /* Initialize table */
+	tbl->tail = head;
+	tbl->len = 0;
+	tbl->mode = mode; /* Assign mode */
+	tbl->bytes = 0;
+	tbl->budget = 0;
+	tbl->spill = NULL;
+	tbl->spilled = 0;
+	tbl->log = log;
+	return tbl;
+}
+
+/* Frees every node of TABLE, leaving it empty. */
+static void free_nodes(SymbolTable* table) {
+	Symbol* del;
+	while (table->head->next) { /* Loop for every non-header node */
+		del = table->head->next;
+		table->head->next = del->next;
+		free(del->name); /* Delete the node */
+		free(del);
+	}
+	table->tail = table->head;
+	table->len = 0;
+	table->bytes = 0;
+}
+
+/* Frees the given SymbolTable and all associated memory. */
+void free_table(SymbolTable* table) {
+	free_nodes(table);
+	if (table->spill) free_spill(table->spill);
+	free(table->head); /* Free header and table */
+	free(table);
+}
+
+/* Bounds the memory the symbols of TABLE take to about BUDGET bytes: past it,
+   they are moved to disk. The list then holds only the latest symbols, and
+   only the functions of this file see all of them.
+ */
+void set_table_budget(SymbolTable* table, size_t budget) {
+	table->budget = budget;
+}
+
+/* Adds a new symbol and its address to the SymbolTable pointed to by TABLE. 
+   1. ADDR is given as the byte offset from the first instruction. 
+   2. The SymbolTable must be able to resize itself as more elements are added. 
+
+   3. Note that NAME may point to a temporary array, so it is not safe to simply
+   store the NAME pointer. You must store a copy of the given string.
+
+   4. If ADDR is not word-aligned, you should call addr_alignment_incorrect() 
+   and return -1. 
+
+   5. If the table's mode is SYMTBL_UNIQUE_NAME and NAME already exists 
+   in the table, you should call name_already_exists() and return -1. 
+
+   6.If memory allocation fails, you should call allocation_failed(). 
+
+   Otherwise, you should store the symbol name and address and return 0.
+ */
+int add_to_table(SymbolTable* table, const char* name, uint32_t addr) {
+  /* Check addr word alignment */
+	if (addr % 4) {
+		addr_alignment_incorrect(table->log);
+		return -1;
+	}
+  /* Adding */
+	if (table->mode == SYMBOLTBL_NON_UNIQUE) append_sym(table, name, addr); /* Non-unique mode, directly append to tail */
+	else { /* Unique mode */
+		Symbol* cur = table->head;
+		while ((cur = cur->next)) {
+			if (strcmp(cur->name, name) == 0) { /* If already exist, fail */
+				name_already_exists(table->log, name);
+				return -1;
+			}
+		}
+		if (table->spill && spill_lookup(table->spill, name) != -1) {
+			name_already_exists(table->log, name);
+			return -1;
+		}
+		append_sym(table, name, addr); /* Else append to tail */
+	}
+	return 0;
+}
+
+/* Auxiliary function for appending a node to table tail */
+void append_sym(SymbolTable* table, const char* name, uint32_t addr) {
+	Symbol* sym = malloc(sizeof(Symbol)); /* Alloc for this node */
+	if (!sym) allocation_failed(table->log);
+	sym->name = malloc(strlen(name)+1); /* Copy name */
+	if (!sym->name) {
+		free(sym);
+		allocation_failed(table->log);
+	}
+	strcpy(sym->name, name);
+	sym->addr = addr; /* Initialize the node */
+	sym->next = NULL;
+	table->tail->next = sym; /* Append the node to tail */
+	table->tail = sym;
+	table->len++;
+	table->bytes += sizeof(Symbol) + strlen(name) + 1;
+	if (table->budget && table->bytes > table->budget) { /* Over budget, move it all to disk */
+		if (!table->spill) table->spill = create_spill();
+		spill_symbols(table->spill, table->head->next, table->len);
+		table->spilled += table->len;
+		free_nodes(table);
+	}
+}
+
+/* Removes every symbol named NAME from TABLE. Returns 0 if one was removed
+   and -1 if NAME is not present.
+ */
+int remove_from_table(SymbolTable* table, const char* name) {
+	Symbol* prev = table->head;
+	Symbol* cur;
+	Symbol* removed = NULL;
+	size_t len = strlen(name);
+	int found = -1;
+	while ((cur = prev->next)) {
+		if (strcmp(cur->name, name) == 0) { /* Unlink, NAME may be its name */
+			prev->next = cur->next;
+			if (table->tail == cur) table->tail = prev;
+			cur->next = removed;
+			removed = cur;
+			table->len--;
+			table->bytes -= sizeof(Symbol) + len + 1;
+			found = 0;
+		} else prev = cur;
+	}
+	if (table->spill && spill_remove(table->spill, name) == 0) found = 0;
+	while ((cur = removed)) { /* Free the nodes once NAME is no longer used */
+		removed = cur->next;
+		free(cur->name);
+		free(cur);
+	}
+	return found;
+}
+
+/* Returns the address (byte offset) of the given symbol. If a symbol with name
+   NAME is not present in TABLE, return -1.
+ */
+int64_t get_addr_for_symbol(SymbolTable* table, const char* name) {   
+	Symbol* cur = table->head;
+	while ((cur = cur->next)) if (strcmp(cur->name, name) == 0) return cur->addr; /* Loop through the list to search */
+	if (table->spill) return spill_lookup(table->spill, name);
+	return -1; /* Not found */
+}
+
+/* Writes the SymbolTable TABLE to OUTPUT. You should use write_sym() to
+   perform the write. Do not print any additional whitespace or characters.
+ */
+void write_table(SymbolTable* table, FILE* output) {
+	Symbol* cur = table->head;
+	if (table->spill) write_spill(table->spill, output); /* Added before the list */
+	while ((cur = cur->next)) write_sym(output, cur->addr, cur->name); /* Loop through the list to write */
+}
+
+/* A symbol and its position in the table, which orders equal addresses. */
+typedef struct SortEntry {
+	Symbol* sym;
+	uint32_t index;
+} SortEntry;
+
+static int compare_addr(const void* a, const void* b) {
+	const SortEntry* x = a;
+	const SortEntry* y = b;
+	if (x->sym->addr != y->sym->addr) return x->sym->addr > y->sym->addr ? 1 : -1;
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+/* Returns a newly allocated array of the TABLE->LEN symbols of TABLE sorted by
+   address, for find_symbol_for_addr(). Symbols at the same address keep
+   their order in TABLE. The symbols stay owned by TABLE; the caller frees
+   only the array.
+ */
+Symbol** sort_by_addr(SymbolTable* table) {
+	uint32_t i = 0;
+	Symbol* cur = table->head;
+	Symbol** view = malloc((table->len + 1) * sizeof(Symbol*));
+	SortEntry* entries = malloc((table->len + 1) * sizeof(SortEntry));
+	if (!view || !entries) {
+		free(view);
+		free(entries);
+		allocation_failed(table->log);
+	}
+	while ((cur = cur->next)) {
+		entries[i].sym = cur;
+		entries[i].index = i;
+		i++;
+	}
+	qsort(entries, table->len, sizeof(SortEntry), compare_addr);
+	for (i = 0; i < table->len; i++) view[i] = entries[i].sym;
+	free(entries);
+	return view;
+}
+
+/* Binary searches VIEW, LEN symbols sorted by sort_by_addr(), for the symbol
+   ADDR belongs to: the last one at or before ADDR. Returns NULL if ADDR comes
+   before every symbol.
+ */
+Symbol* find_symbol_for_addr(Symbol** view, uint32_t len, uint32_t addr) {
+	uint32_t lo = 0, hi = len; /* Answer is view[lo - 1] */
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (view[mid]->addr <= addr) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo ? view[lo - 1] : NULL;
+}
+
+/*******************************
+ * Line Table Functions
+ *******************************/
+
+LineTable* create_line_table(LogCapture* log) {
+	LineTable* table = malloc(sizeof(LineTable));
+	if (!table) allocation_failed(log);
+	table->cap = 64;
+	table->len = 0;
+	table->log = log;
+	table->addrs = malloc(table->cap * sizeof(uint32_t));
+	table->lines = malloc(table->cap * sizeof(uint32_t));
+	if (!table->addrs || !table->lines) {
+		free_line_table(table);
+		allocation_failed(log);
+	}
+	return table;
+}
+
+void free_line_table(LineTable* table) {
+	free(table->addrs);
+	free(table->lines);
+	free(table);
+}
+
+/* Records that the instruction at byte offset ADDR comes from source line
+   LINE. Offsets must be added in increasing order. Nothing is stored if LINE
+   is the line of the previous entry.
+ */
+void add_line(LineTable* table, uint32_t addr, uint32_t line) {
+	if (table->len && table->lines[table->len - 1] == line) return;
+	if (table->len == table->cap) { /* Full, double the capacity */
+		uint32_t* addrs = realloc(table->addrs, 2 * table->cap * sizeof(uint32_t));
+		uint32_t* lines;
+		if (!addrs) allocation_failed(table->log);
+		table->addrs = addrs;
+		lines = realloc(table->lines, 2 * table->cap * sizeof(uint32_t));
+		if (!lines) allocation_failed(table->log);
+		table->lines = lines;
+		table->cap *= 2;
+	}
+	table->addrs[table->len] = addr;
+	table->lines[table->len++] = line;
+}
+
+/* Returns the source line of the instruction at byte offset ADDR, or 0 if it
+   is not covered by TABLE.
+ */
+uint32_t get_line_for_addr(LineTable* table, uint32_t addr) {
+	uint32_t lo = 0, hi = table->len; /* Answer is entry lo - 1 */
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (table->addrs[mid] <= addr) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo ? table->lines[lo - 1] : 0;
+}
+
+/* Writes TABLE to OUTPUT, one "<addr>\t<line>" entry per line like
+   write_sym().
+ */
+void write_line_table(LineTable* table, FILE* output) {
+	uint32_t i;
+	for (i = 0; i < table->len; i++) fprintf(output, "%u\t%u\n", table->addrs[i], table->lines[i]);
+}
@@ -1,54 +1,102 @@
-#ifndef TABLES_H
-#define TABLES_H
-
-#include <stdint.h>
-
-extern const int SYMBOLTBL_NON_UNIQUE;      /* allows duplicate names in table */
-extern const int SYMBOLTBL_UNIQUE_NAME;     /* duplicate names not allowed */
-
-/* Complete the following definition of SymbolTable and implement the following
-   functions. You are free to declare additional structs or functions, but you
-   must build this data structure yourself. 
- */
-
-/* SOLUTION CODE BELOW */
-typedef struct Symbol {
-    char *name;
-    uint32_t addr;
-    struct Symbol* next;
-} Symbol;
-
-typedef struct SymbolTable {
-    Symbol* head;
-    Symbol* tail;
-    uint32_t len;
-    int mode;
-} SymbolTable;
-
-/* Helper functions: */
-
-void allocation_failed();
-
-void addr_alignment_incorrect();
-
-void name_already_exists(const char* name);
-
-void write_sym(FILE* output, uint32_t addr, const char* name);
-
-/* IMPLEMENT ME - see documentation in tables.c */
-SymbolTable* create_table();
-
-/* IMPLEMENT ME - see documentation in tables.c */
-void free_table(SymbolTable* table);
-
-/* IMPLEMENT ME - see documentation in tables.c */
-int add_to_table(SymbolTable* table, const char* name, uint32_t addr);
-void append_sym(SymbolTable* table, const char* name, uint32_t addr);
-
-/* IMPLEMENT ME - see documentation in tables.c */
-int64_t get_addr_for_symbol(SymbolTable* table, const char* name);
-
-/* IMPLEMENT ME - see documentation in tables.c */
-void write_table(SymbolTable* table, FILE* output);
-
-#endif
+#ifndef TABLES_H
+#define TABLES_H
+
+#include <stdint.h>
+
+struct LogCapture;
+
+extern const int SYMBOLTBL_NON_UNIQUE;      /* allows duplicate names in table */
+extern const int SYMBOLTBL_UNIQUE_NAME;     /* duplicate names not allowed */
+
+/* .data starts at the first DATA_ALIGN boundary at or after the end of the
+   TEXT_SIZE bytes of .text, so that alignment within .data holds in memory
+   too. Computed in 64 bits, a .text near 4 GB would wrap.
+ */
+#define DATA_ALIGN 0x00010000
+#define DATA_BASE(text_size) \
+    (((uint64_t)(text_size) + DATA_ALIGN - 1) & ~(uint64_t)(DATA_ALIGN - 1))
+
+/* Complete the following definition of SymbolTable and implement the following
+   functions. You are free to declare additional structs or functions, but you
+   must build this data structure yourself. 
+ */
+
+/* SOLUTION CODE BELOW */
+typedef struct Symbol {
+    char *name;
+    uint32_t addr;
+    struct Symbol* next;
+} Symbol;
+
+/* LEN counts the symbols in the list. Once the list takes more than BUDGET
+   bytes (if not 0), it is moved to SPILL on disk, see spill.c; SPILLED
+   counts those. LOG is where its errors go, see utils.h.
+ */
+typedef struct SymbolTable {
+    Symbol* head;
+    Symbol* tail;
+    uint32_t len;
+    int mode;
+    size_t bytes;
+    size_t budget;
+    struct Spill* spill;
+    uint64_t spilled;
+    struct LogCapture* log;
+} SymbolTable;
+
+/* Maps .text byte offsets to source lines. An entry covers every offset from
+   its own up to the next entry, so only changes of line are stored.
+ */
+typedef struct LineTable {
+    uint32_t* addrs;
+    uint32_t* lines;
+    uint32_t len;
+    uint32_t cap;
+    struct LogCapture* log;
+} LineTable;
+
+/* Helper functions: */
+
+void allocation_failed(struct LogCapture* log);
+
+void addr_alignment_incorrect(struct LogCapture* log);
+
+void name_already_exists(struct LogCapture* log, const char* name);
+
+void write_sym(FILE* output, uint32_t addr, const char* name);
+
+/* IMPLEMENT ME - see documentation in tables.c */
+SymbolTable* create_table(int mode, struct LogCapture* log);
+
+/* IMPLEMENT ME - see documentation in tables.c */
+void free_table(SymbolTable* table);
+
+/* IMPLEMENT ME - see documentation in tables.c */
+int add_to_table(SymbolTable* table, const char* name, uint32_t addr);
+void append_sym(SymbolTable* table, const char* name, uint32_t addr);
+
+int remove_from_table(SymbolTable* table, const char* name);
+
+void set_table_budget(SymbolTable* table, size_t budget);
+
+/* IMPLEMENT ME - see documentation in tables.c */
+int64_t get_addr_for_symbol(SymbolTable* table, const char* name);
+
+/* IMPLEMENT ME - see documentation in tables.c */
+void write_table(SymbolTable* table, FILE* output);
+
+Symbol** sort_by_addr(SymbolTable* table);
+
+Symbol* find_symbol_for_addr(Symbol** view, uint32_t len, uint32_t addr);
+
+LineTable* create_line_table(struct LogCapture* log);
+
+void free_line_table(LineTable* table);
+
+void add_line(LineTable* table, uint32_t addr, uint32_t line);
+
+uint32_t get_line_for_addr(LineTable* table, uint32_t addr);
+
+void write_line_table(LineTable* table, FILE* output);
+
+#endif
@@ -1,332 +1,489 @@
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-
-#include "tables.h"
-#include "translate_utils.h"
-#include "translate.h"
-
-/* Writes instructions during the assembler's first pass to OUTPUT. The case
-   for general instructions has already been completed, but you need to write
-   code to translate the li, bge and move pseudoinstructions. Your pseudoinstruction 
-   expansions should not have any side effects.
-
-   NAME is the name of the instruction, ARGS is an array of the arguments, and
-   NUM_ARGS specifies the number of items in ARGS.
-
-   Error checking for regular instructions are done in pass two. However, for
-   pseudoinstructions, you must make sure that ARGS contains the correct number
-   of arguments. You do NOT need to check whether the registers / label are 
-   valid, since that will be checked in part two.
-
-   Also for li:
-	- make sure that the number is representable by 32 bits. (Hint: the number 
-		can be both signed or unsigned).
-	- if the immediate can fit in the imm field of an addiu instruction, then
-		expand li into a single addiu instruction. Otherwise, expand it into 
-		a lui-ori pair.
-
-   And for bge and move:
-	- your expansion should use the fewest number of instructions possible.
-
-   MARS has slightly different translation rules for li, and it allows numbers
-   larger than the largest 32 bit number to be loaded with li. You should follow
-   the above rules if MARS behaves differently.
-
-   Use fprintf() to write. If writing multiple instructions, make sure that 
-   each instruction is on a different line.
-
-   Returns the number of instructions written (so 0 if there were any errors).
- */
-unsigned write_pass_one(FILE* output, const char* name, char** args, int num_args) {
-  /* DECLARATIONS */
-	char* sub_args[3];
-	char buf[100];
-	if (!output || !name || !args) return 0; /* Basic error checking */
-  /* Expand pseudo `li` */
-	if (strcmp(name, "li") == 0) {
-		long int imm; /* The immdiate */
-		int err; /* return state of translate */
-		if (num_args != 2) return 0; /* Basic error checking */
-	  /* Translate */
-		err = translate_num(&imm, args[1], 4294967295, -2147483648); /* Notice the range */
-		if (err == -1) return 0; /* Translate fails */
-	  /* If in range of 16-bits, expand to `addiu` */
-		if ((-32768 <= imm) && (imm <= 32767)) {
-			sub_args[0] = args[0]; /* Assign sub_args */
-			sub_args[1] = "$0";
-			sub_args[2] = args[1];
-			write_inst_string(output, "addiu", sub_args, 3); /* Write */
-			return 1; /* One line written */
-	  /* Else in range of 32-bits, expand to `lui` and `ori` */
-		} else {
-			sprintf(buf, "%u", (uint16_t)(imm>>16)); /* Upper 16-bits to `lui` */
-			sub_args[0] = "$at"; /* Assign sub_args */
-			sub_args[1] = buf;
-			write_inst_string(output, "lui", sub_args, 2); /* Write */
-			sprintf(buf, "%ld", (imm & 0xffff)); /* Lower 16-bits to `ori` */
-			sub_args[0] = args[0]; /* Assign sub_args */
-			sub_args[1] = "$at";
-			sub_args[2] = buf;
-			write_inst_string(output, "ori", sub_args, 3); /* Write */
-			return 2; /* Two lines written */
-		}
-  /* Expand pseudo `bge` */
-	} else if (strcmp(name, "bge") == 0) {
-		if (num_args != 3) return 0; /* Basic error checking */
-		sub_args[0] = "$at"; /* Assign sub_args */
-		sub_args[1] = args[0];
-		sub_args[2] = args[1];
-		write_inst_string(output, "slt", sub_args, 3); /* Write */
-		sub_args[0] = "$at"; /* Assign sub_args */
-		sub_args[1] = "$0";
-		sub_args[2] = args[2];
-		write_inst_string(output, "beq", sub_args, 3); /* Write */
-		return 2; /* Two lines written */
-  /* Expand pseudo `move` */
-	} else if (strcmp(name, "move") == 0 ) {
-		if (num_args != 2) return 0; /* Basic error checking */
-		sub_args[0] = args[0]; /* Assign sub_args */
-		sub_args[1] = "$0";
-		sub_args[2] = args[1];
-		write_inst_string(output, "addu", sub_args, 3); /* Write */
-		return 1; /* One line written */
-  /* Non-pseudo instructions, directly write */
-	} else {
-		write_inst_string(output, name, args, num_args);
-		return 1; /* One line written */
-	}
-}
-
-/* Writes the instruction in hexadecimal format to OUTPUT during pass #2.
-   
-   NAME is the name of the instruction, ARGS is an array of the arguments, and
-   NUM_ARGS specifies the number of items in ARGS. 
-
-   The symbol table (SYMTBL) is given for any symbols that need to be resolved
-   at this step. If a symbol should be relocated, it should be added to the
-   relocation table (RELTBL), and the fields for that symbol should be set to
-   all zeros. 
-
-   You must perform error checking on all instructions and make sure that their
-   arguments are valid. If an instruction is invalid, you should not write 
-   anything to OUTPUT but simply return -1. MARS may be a useful resource for
-   this step.
-
-   Note the use of helper functions. Consider writing your own! If the function
-   definition comes afterwards, you must declare it first (see translate.h).
-
-   Returns 0 on success and -1 on error. 
- */
-int translate_inst(FILE* output, const char* name, char** args, size_t num_args, uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl) {
-	if (strcmp(name, "addu") == 0)       return write_rtype (0x21, output, args, num_args); /* `addiu` */
-	else if (strcmp(name, "or") == 0)    return write_rtype (0x25, output, args, num_args); /* `or` */
-	else if (strcmp(name, "sll") == 0)   return write_shift (0x00, output, args, num_args); /* `sll` */
-	else if (strcmp(name, "slt") == 0)   return write_rtype (0x2a, output, args, num_args); /* `slt` */
-	else if (strcmp(name, "sltu") == 0)  return write_rtype (0x2b, output, args, num_args); /* `sltu` */
-	else if (strcmp(name, "jr") == 0)    return write_jr    (0x08, output, args, num_args); /* `jr` */
-	else if (strcmp(name, "addiu") == 0) return write_addiu (0x09, output, args, num_args); /* `addiu` */
-	else if (strcmp(name, "ori") == 0)   return write_ori   (0x0d, output, args, num_args); /* `ori` */
-	else if (strcmp(name, "lui") == 0)   return write_lui   (0x0f, output, args, num_args); /* `lui` */
-	else if (strcmp(name, "lb") == 0)    return write_mem   (0x20, output, args, num_args); /* `lb` */
-	else if (strcmp(name, "lbu") == 0)   return write_mem   (0x24, output, args, num_args); /* `lbu` */
-	else if (strcmp(name, "lw") == 0)    return write_mem   (0x23, output, args, num_args); /* `lw` */
-	else if (strcmp(name, "sb") == 0)    return write_mem   (0x28, output, args, num_args); /* `sb` */
-	else if (strcmp(name, "sw") == 0)    return write_mem   (0x2b, output, args, num_args); /* `sw` */
-	else if (strcmp(name, "beq") == 0)   return write_branch(0x04, output, args, num_args, addr, symtbl); /* `beq` */
-	else if (strcmp(name, "bne") == 0)   return write_branch(0x05, output, args, num_args, addr, symtbl); /* `bne` */
-	else if (strcmp(name, "j") == 0)     return write_jump  (0x02, output, args, num_args, addr, reltbl); /* `j` */
-	else if (strcmp(name, "jal") == 0)   return write_jump  (0x03, output, args, num_args, addr, reltbl); /* `jal` */
-	else                                 return -1; /* Error */
-}
-
-/* A helper function for writing most R-type instructions. You should use
-   translate_reg() to parse registers and write_inst_hex() to write to 
-   OUTPUT. Both are defined in translate_utils.h.
-
-   This function is INCOMPLETE. Complete the implementation below. You will
-   find bitwise operations to be the cleanest way to complete this function.
- */
-int write_rtype(uint8_t funct, FILE* output, char** args, size_t num_args) {
-  /* DECLARATIONS */
-	int rd, rs, rt;
-	uint32_t instruction;
-	if (num_args != 3) return -1; /* Basic error checking */ 
-  /* Assign registers and immdiates */
-	rd = translate_reg(args[0]);
-	rs = translate_reg(args[1]);
-	rt = translate_reg(args[2]);
-  /* Error checking for assignments */
-	if (rd == -1 || rs == -1 || rt == -1) return -1;
-  /* Generate instruction */
-	instruction = 0 | (rs<<21) | (rt<<16) | (rd<<11) | funct;
-	write_inst_hex(output, instruction);
-	return 0;
-}
-
-/* A helper function for writing shift instructions. You should use 
-   translate_num() to parse numerical arguments. translate_num() is defined
-   in translate_utils.h.
-
-   This function is INCOMPLETE. Complete the implementation below. You will
-   find bitwise operations to be the cleanest way to complete this function.
- */
-int write_shift(uint8_t funct, FILE* output, char** args, size_t num_args) {
-  /* DECLARATIONS */
-	int rd, rt, err;
-	long int shamt;
-	uint32_t instruction;
-	if (num_args != 3) return -1; /* Basic error checking */
-  /* Assign registers and immdiates */
-	rd = translate_reg(args[0]);
-	rt = translate_reg(args[1]);
-	err = translate_num(&shamt, args[2], 31, 0);
-  /* Error checking for assignments */
-	if (rd == -1 || rt == -1 || err == -1) return -1;
-  /* Generate instruction */
-	instruction = 0 | (rt<<16) | (rd<<11) | (shamt<<6) | funct;
-	write_inst_hex(output, instruction);
-	return 0;
-}
-
-
-int write_jr(uint8_t funct, FILE* output, char** args, size_t num_args) {
-  /* DECLARATIONS */
-	int rs; 
-	uint32_t instruction;
-	if (num_args != 1) return -1; /* Basic error checking */
-  /* Assign registers and immdiates */
-	rs = translate_reg(args[0]);
-  /* Error checking for assignments */
-	if (rs == -1) return -1;
-  /* Generate instruction */
-	instruction = 0 | (rs<<21) | funct;
-	write_inst_hex(output, instruction);
-	return 0;
-}
-
-int write_addiu(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-  /* DECLARATIONS */
-	int rt, rs, err;
-	long int imm;
-	uint32_t instruction;
-	if (num_args != 3) return -1; /* Basic error checking */
-  /* Assign registers and immdiates */
-	rt = translate_reg(args[0]);
-	rs = translate_reg(args[1]);
-	err = translate_num(&imm, args[2], 32767, -32768);
-  /* Error checking for assignments */
-	if (rt == -1 || rs == -1 || err == -1) return -1;
-  /* Generate instruction */
-	instruction = 0 | (opcode<<26) | (rs<<21) | (rt<<16) | (imm & 0xffff);
-	write_inst_hex(output, instruction);
-	return 0;
-}
-
-int write_ori(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-  /* DECLARATIONS */
-	int rt, rs, err;
-	long int imm;
-	uint32_t instruction;
-	if (num_args != 3) return -1; /* Basic error checking */
-  /* Assign registers and immdiates */
-	rt = translate_reg(args[0]);
-	rs = translate_reg(args[1]);
-	err = translate_num(&imm, args[2], 65535, 0);
-  /* Error checking for assignments */
-	if (rt == -1 || rs == -1 || err == -1) return -1;
-  /* Generate instruction */
-	instruction = 0 | (opcode<<26) | (rs<<21) | (rt<<16) | (imm & 0xffff);
-	write_inst_hex(output, instruction);
-	return 0;
-}
-
-int write_lui(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-  /* DECLARATIONS */
-	int rt, err;
-	long int imm;
-	uint32_t instruction;
-	if (num_args != 2) return -1; /* Basic error checking */
-  /* Assign registers and immdiates */
-	rt = translate_reg(args[0]);
-	err = translate_num(&imm, args[1], 65535, 0);
-  /* Error checking for assignments */
-	if (rt == -1 || err == -1) return -1;
-  /* Generate instruction */
-	instruction = 0 | (opcode<<26) | (rt<<16) | (imm & 0xffff);
-	write_inst_hex(output, instruction);
-	return 0;
-}
-
-
-int write_mem(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-  /* DECLARATIONS */
-	int rt, err, rs;
-	long int offset;
-	uint32_t instruction;
-	if (num_args != 3) return -1; /* Basic error checking */
-  /* Assign registers and immdiates */
-	rt = translate_reg(args[0]);
-	err = translate_num(&offset, args[1], 32767, -32768);
-	rs = translate_reg(args[2]);
-  /* Error checking for assignments */
-	if (rt == -1 || rs == -1 || err == -1) return -1;
-  /* Generate instruction */
-	instruction = 0 | (opcode<<26) | (rs<<21) | (rt<<16) | (offset & 0xffff);
-	write_inst_hex(output, instruction);
-	return 0;
-}
-
-/* Hint: the way for branch to calculate relative address. e.g. bne
-	 bne $rs $rt label
-   assume the byte_offset(addr) of label is L, 
-   current instruction byte_offset(addr) is A
-   the relative address I  for label satisfy:
-	 L = (A + 4) + I * 4
-   so the relative addres is 
-	 I = (L - A - 4) / 4;  */
-int write_branch(uint8_t opcode, FILE* output, char** args, size_t num_args, 
-		 uint32_t addr, SymbolTable* symtbl) {
-  /* DECLARATIONS */
-	int rs, rt;
-	char* label;
-	uint32_t instruction;
-	int64_t label_addr, imm_addr; /* Addresses */
-	if (num_args != 3) return -1; /* Basic error checking */
-  /* Assign registers and labels */
-	rs = translate_reg(args[0]);
-	rt = translate_reg(args[1]);
-	label = args[2];
-  /* Get label address and handle errors */
-	if (rt == -1 || rs == -1 || !is_valid_label(label)) return -1;
-	label_addr = get_addr_for_symbol(symtbl, label);
-	if (label_addr == -1) return -1;
-	imm_addr = (label_addr - addr - 4) / 4; /* Translate to relative addr I */
-	if (!((-32768 <= -imm_addr) && (imm_addr <= 32767))) return -1; /* Treat large relative address as error */
-  /* Generate instruction */
-	instruction = 0 | (opcode<<26) | (rs<<21) | (rt<<16) | (imm_addr & 0xffff);
-	write_inst_hex(output, instruction);
-	return 0;
-}
-
-/* Hint: the relocation table should record
-   1. the current instruction byte_offset(addr)
-   2. the unsolved LABEL in the jump instruction  */
-int write_jump(uint8_t opcode, FILE* output, char** args, size_t num_args, 
-		   uint32_t addr, SymbolTable* reltbl) {
-  /* DECLARATIONS */
-	int err;
-	char* label;
-	uint32_t instruction;
-	if (num_args != 1) return -1; /* Basic error checking */
-  /* Assign labels */
-	label = args[0];
-  /* Add to reltbl and handle error */
-	if (!is_valid_label(label)) return -1;
-	err = add_to_table(reltbl, label, addr);
-	if (err == -1) return -1;
-  /* Generate instruction */
-	instruction = 0 | (opcode<<26);
-	write_inst_hex(output, instruction);
-	return 0;
-}
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tables.h"
+#include "translate_utils.h"
+#include "translate.h"
+
+#define MAX_LABEL 1024      /* characters of an `la` label, a whole line at most */
+
+/* Writes instructions during the assembler's first pass to OUTPUT. The case
+   for general instructions has already been completed, but you need to write
+   code to translate the li, la, bge and move pseudoinstructions. Your
+   pseudoinstruction expansions should not have any side effects.
+
+   NAME is the name of the instruction, ARGS is an array of the arguments, and
+   NUM_ARGS specifies the number of items in ARGS.
+
+   Error checking for regular instructions are done in pass two. However, for
+   pseudoinstructions, you must make sure that ARGS contains the correct number
+   of arguments. You do NOT need to check whether the registers / label are 
+   valid, since that will be checked in part two.
+
+   Also for li:
+	- make sure that the number is representable by 32 bits. (Hint: the number 
+		can be both signed or unsigned).
+	- use the shortest sequence for the value, writing only the destination
+		register:
+			fits a signed 16-bit imm     ->  addiu $rd, $0, imm
+			fits an unsigned 16-bit imm  ->  ori $rd, $0, imm
+			lower 16 bits are zero       ->  lui $rd, upper
+			anything else                ->  lui $rd, upper
+			                                 ori $rd, $rd, lower
+
+   And for la:
+	- always expand into a lui-ori pair naming the label as %hi:label and
+		%lo:label, so that its size is known before the label is. Pass two
+		resolves or relocates both, and only takes a label in this form.
+
+   And for bge and move:
+	- your expansion should use the fewest number of instructions possible.
+
+   MARS has slightly different translation rules for li, and it allows numbers
+   larger than the largest 32 bit number to be loaded with li. You should follow
+   the above rules if MARS behaves differently.
+
+   Use fprintf() to write. If writing multiple instructions, make sure that 
+   each instruction is on a different line.
+
+   Operands starting with OPERAND_MARK are reserved for the assembler's own
+   expansions, so an instruction that uses one is an error.
+
+   Returns the number of instructions written (so 0 if there were any errors).
+ */
+unsigned write_pass_one(FILE* output, const char* name, char** args, int num_args) {
+  /* DECLARATIONS */
+	char* sub_args[3];
+	char buf[100];
+	int i;
+	if (!output || !name || !args) return 0; /* Basic error checking */
+	for (i = 0; i < num_args; i++) {
+		if (args[i][0] == OPERAND_MARK) return 0; /* Internal operand */
+	}
+  /* Expand pseudo `li` */
+	if (strcmp(name, "li") == 0) {
+		long int imm; /* The immdiate */
+		uint32_t value; /* Its 32-bit pattern */
+		int err; /* return state of translate */
+		if (num_args != 2) return 0; /* Basic error checking */
+	  /* Translate */
+		err = translate_num(&imm, args[1], 4294967295, -2147483648); /* Notice the range */
+		if (err == -1) return 0; /* Translate fails */
+		value = (uint32_t)imm;
+	  /* If in range of signed 16-bits, expand to `addiu` */
+		if ((-32768 <= imm) && (imm <= 32767)) {
+			sub_args[0] = args[0]; /* Assign sub_args */
+			sub_args[1] = "$0";
+			sub_args[2] = args[1];
+			write_inst_string(output, "addiu", sub_args, 3); /* Write */
+			return 1; /* One line written */
+		}
+	  /* If in range of unsigned 16-bits, expand to `ori` */
+		if (value <= 0xffff) {
+			sprintf(buf, "%u", (unsigned)value);
+			sub_args[0] = args[0]; /* Assign sub_args */
+			sub_args[1] = "$0";
+			sub_args[2] = buf;
+			write_inst_string(output, "ori", sub_args, 3); /* Write */
+			return 1; /* One line written */
+		}
+	  /* Else upper 16-bits to `lui`, and lower 16-bits to `ori` if non-zero */
+		sprintf(buf, "%u", (unsigned)(value>>16));
+		sub_args[0] = args[0]; /* Assign sub_args */
+		sub_args[1] = buf;
+		write_inst_string(output, "lui", sub_args, 2); /* Write */
+		if (!(value & 0xffff)) return 1; /* One line written */
+		sprintf(buf, "%u", (unsigned)(value & 0xffff));
+		sub_args[0] = args[0]; /* Assign sub_args */
+		sub_args[1] = args[0];
+		sub_args[2] = buf;
+		write_inst_string(output, "ori", sub_args, 3); /* Write */
+		return 2; /* Two lines written */
+  /* Expand pseudo `la` */
+	} else if (strcmp(name, "la") == 0) {
+		char half[MAX_LABEL + 5];
+		if (num_args != 2 || strlen(args[1]) > MAX_LABEL) return 0; /* Basic error checking */
+		sprintf(half, "%%hi:%s", args[1]);
+		sub_args[0] = args[0]; /* Assign sub_args */
+		sub_args[1] = half;
+		write_inst_string(output, "lui", sub_args, 2); /* Write */
+		sprintf(half, "%%lo:%s", args[1]);
+		sub_args[0] = args[0]; /* Assign sub_args */
+		sub_args[1] = args[0];
+		sub_args[2] = half;
+		write_inst_string(output, "ori", sub_args, 3); /* Write */
+		return 2; /* Two lines written */
+  /* Expand pseudo `bge` */
+	} else if (strcmp(name, "bge") == 0) {
+		if (num_args != 3) return 0; /* Basic error checking */
+		sub_args[0] = "$at"; /* Assign sub_args */
+		sub_args[1] = args[0];
+		sub_args[2] = args[1];
+		write_inst_string(output, "slt", sub_args, 3); /* Write */
+		sub_args[0] = "$at"; /* Assign sub_args */
+		sub_args[1] = "$0";
+		sub_args[2] = args[2];
+		write_inst_string(output, "beq", sub_args, 3); /* Write */
+		return 2; /* Two lines written */
+  /* Expand pseudo `move` */
+	} else if (strcmp(name, "move") == 0 ) {
+		if (num_args != 2) return 0; /* Basic error checking */
+		sub_args[0] = args[0]; /* Assign sub_args */
+		sub_args[1] = "$0";
+		sub_args[2] = args[1];
+		write_inst_string(output, "addu", sub_args, 3); /* Write */
+		return 1; /* One line written */
+  /* Non-pseudo instructions, directly write */
+	} else {
+		write_inst_string(output, name, args, num_args);
+		return 1; /* One line written */
+	}
+}
+
+/* Writes assembler directives during the assembler's first pass to OUTPUT.
+   Directives take no space in .text and are passed through to the later
+   stages unchanged. The only one supported is:
+
+	.globl label     - LABEL is exported, so it is kept by -dce even if
+	                   nothing in this file reaches it
+
+   Returns 0 on success and -1 if the directive is unknown or malformed.
+ */
+int write_directive(FILE* output, const char* name, char** args, int num_args) {
+	if (!output || !name || !args) return -1; /* Basic error checking */
+	if (strcmp(name, ".globl") == 0) {
+		if (num_args != 1 || !is_valid_label(args[0])) return -1;
+		write_inst_string(output, name, args, num_args);
+		return 0;
+	}
+	return -1; /* Unknown directive */
+}
+
+/* Every instruction translate_inst() encodes: its name, the helper that
+   writes it and the opcode, or the funct for opcode 0. The disassembler
+   decodes with the same table.
+ */
+const InstEncoding INST_ENCODINGS[] = {
+	{"addu",  FMT_RTYPE,  0x21},
+	{"or",    FMT_RTYPE,  0x25},
+	{"sll",   FMT_SHIFT,  0x00},
+	{"slt",   FMT_RTYPE,  0x2a},
+	{"sltu",  FMT_RTYPE,  0x2b},
+	{"jr",    FMT_JR,     0x08},
+	{"addiu", FMT_ADDIU,  0x09},
+	{"ori",   FMT_ORI,    0x0d},
+	{"lui",   FMT_LUI,    0x0f},
+	{"lb",    FMT_MEM,    0x20},
+	{"lbu",   FMT_MEM,    0x24},
+	{"lw",    FMT_MEM,    0x23},
+	{"sb",    FMT_MEM,    0x28},
+	{"sw",    FMT_MEM,    0x2b},
+	{"beq",   FMT_BRANCH, 0x04},
+	{"bne",   FMT_BRANCH, 0x05},
+	{"j",     FMT_JUMP,   0x02},
+	{"jal",   FMT_JUMP,   0x03},
+	{NULL,    FMT_NONE,   0x00}
+};
+
+/* Resolves LABEL, used by the instruction at byte offset ADDR, to an absolute
+   address in TARGET. If TEXT_BASE is not -1 and LABEL is defined in SYMTBL,
+   TARGET is TEXT_BASE plus its offset. Otherwise LABEL is added to RELTBL at
+   ADDR and TARGET is 0, leaving the field for the linker, which tells what to
+   patch from the opcode of the instruction at ADDR.
+
+   Returns 1 if the label was resolved, 0 if it was relocated and -1 on error.
+ */
+static int resolve_label(uint32_t* target, const char* label, uint32_t addr,
+	SymbolTable* symtbl, SymbolTable* reltbl, int64_t text_base) {
+	
+	int64_t label_addr;
+	if (!is_valid_label(label)) return -1;
+	label_addr = (text_base == -1) ? -1 : get_addr_for_symbol(symtbl, label);
+	if (label_addr != -1) {
+		*target = (uint32_t)(text_base + label_addr);
+		return 1;
+	}
+	if (add_to_table(reltbl, label, addr) == -1) return -1;
+	*target = 0;
+	return 0;
+}
+
+/* Writes the instruction in hexadecimal format to OUTPUT during pass #2.
+   
+   NAME is the name of the instruction, ARGS is an array of the arguments, and
+   NUM_ARGS specifies the number of items in ARGS. 
+
+   The symbol table (SYMTBL) is given for any symbols that need to be resolved
+   at this step. If a symbol should be relocated, it should be added to the
+   relocation table (RELTBL), and the fields for that symbol should be set to
+   all zeros. 
+
+   You must perform error checking on all instructions and make sure that their
+   arguments are valid. If an instruction is invalid, you should not write 
+   anything to OUTPUT but simply return -1. MARS may be a useful resource for
+   this step.
+
+   Note the use of helper functions. Consider writing your own! If the function
+   definition comes afterwards, you must declare it first (see translate.h).
+
+   TEXT_BASE is the address the first instruction will be loaded at, or -1 if
+   it is unknown. It is used to resolve local targets of jumps and of the
+   lui-ori pair that la expands to.
+
+   WORD receives the encoded instruction, which is also what gets written.
+
+   Returns 0 on success and -1 on error. 
+ */
+int translate_inst(FILE* output, const char* name, char** args, size_t num_args, uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl,
+	int64_t text_base, uint32_t* word) {
+	const InstEncoding* enc;
+	int err;
+	for (enc = INST_ENCODINGS; enc->name; enc++) {
+		if (strcmp(name, enc->name) == 0) break;
+	}
+	switch (enc->format) {
+		case FMT_RTYPE:  err = write_rtype (enc->code, word, args, num_args); break;
+		case FMT_SHIFT:  err = write_shift (enc->code, word, args, num_args); break;
+		case FMT_JR:     err = write_jr    (enc->code, word, args, num_args); break;
+		case FMT_ADDIU:  err = write_addiu (enc->code, word, args, num_args); break;
+		case FMT_ORI:    err = write_ori   (enc->code, word, args, num_args, addr, symtbl, reltbl, text_base); break;
+		case FMT_LUI:    err = write_lui   (enc->code, word, args, num_args, addr, symtbl, reltbl, text_base); break;
+		case FMT_MEM:    err = write_mem   (enc->code, word, args, num_args); break;
+		case FMT_BRANCH: err = write_branch(enc->code, word, args, num_args, addr, symtbl); break;
+		case FMT_JUMP:   err = write_jump  (enc->code, word, args, num_args, addr, symtbl, reltbl, text_base); break;
+		default:         return -1; /* Error */
+	}
+	if (err == 0) write_inst_hex(output, *word);
+	return err;
+}
+
+/* A helper function for writing most R-type instructions. You should use
+   translate_reg() to parse registers and store the instruction in WORD, for
+   translate_inst() to write. translate_reg() is defined in translate_utils.h.
+
+   This function is INCOMPLETE. Complete the implementation below. You will
+   find bitwise operations to be the cleanest way to complete this function.
+ */
+int write_rtype(uint8_t funct, uint32_t* word, char** args, size_t num_args) {
+  /* DECLARATIONS */
+	int rd, rs, rt;
+	uint32_t instruction;
+	if (num_args != 3) return -1; /* Basic error checking */ 
+  /* Assign registers and immdiates */
+	rd = translate_reg(args[0]);
+	rs = translate_reg(args[1]);
+	rt = translate_reg(args[2]);
+  /* Error checking for assignments */
+	if (rd == -1 || rs == -1 || rt == -1) return -1;
+  /* Generate instruction */
+	instruction = 0 | (rs<<21) | (rt<<16) | (rd<<11) | funct;
+	*word = instruction;
+	return 0;
+}
+
+/* A helper function for writing shift instructions. You should use 
+   translate_num() to parse numerical arguments. translate_num() is defined
+   in translate_utils.h.
+
+   This function is INCOMPLETE. Complete the implementation below. You will
+   find bitwise operations to be the cleanest way to complete this function.
+ */
+int write_shift(uint8_t funct, uint32_t* word, char** args, size_t num_args) {
+  /* DECLARATIONS */
+	int rd, rt, err;
+	long int shamt;
+	uint32_t instruction;
+	if (num_args != 3) return -1; /* Basic error checking */
+  /* Assign registers and immdiates */
+	rd = translate_reg(args[0]);
+	rt = translate_reg(args[1]);
+	err = translate_num(&shamt, args[2], 31, 0);
+  /* Error checking for assignments */
+	if (rd == -1 || rt == -1 || err == -1) return -1;
+  /* Generate instruction */
+	instruction = 0 | (rt<<16) | (rd<<11) | (shamt<<6) | funct;
+	*word = instruction;
+	return 0;
+}
+
+
+int write_jr(uint8_t funct, uint32_t* word, char** args, size_t num_args) {
+  /* DECLARATIONS */
+	int rs; 
+	uint32_t instruction;
+	if (num_args != 1) return -1; /* Basic error checking */
+  /* Assign registers and immdiates */
+	rs = translate_reg(args[0]);
+  /* Error checking for assignments */
+	if (rs == -1) return -1;
+  /* Generate instruction */
+	instruction = 0 | (rs<<21) | funct;
+	*word = instruction;
+	return 0;
+}
+
+int write_addiu(uint8_t opcode, uint32_t* word, char** args, size_t num_args) {
+  /* DECLARATIONS */
+	int rt, rs, err;
+	long int imm;
+	uint32_t instruction;
+	if (num_args != 3) return -1; /* Basic error checking */
+  /* Assign registers and immdiates */
+	rt = translate_reg(args[0]);
+	rs = translate_reg(args[1]);
+	err = translate_num(&imm, args[2], 32767, -32768);
+  /* Error checking for assignments */
+	if (rt == -1 || rs == -1 || err == -1) return -1;
+  /* Generate instruction */
+	instruction = 0 | (opcode<<26) | (rs<<21) | (rt<<16) | (imm & 0xffff);
+	*word = instruction;
+	return 0;
+}
+
+/* Translates the immediate of a lui or ori into IMM. It is either a number
+   in [0, 65535] or, for the pair that la expands to, a label written as
+   %hi:label (LOWER is 0, for lui) or %lo:label (LOWER is 1, for ori). The
+   label is resolved with resolve_label() and LOWER selects which half of its
+   address to use. Returns 0 on success and -1 on error.
+ */
+static int translate_imm_or_label(long int* imm, const char* str, int lower,
+	uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl, int64_t text_base) {
+	
+	const char* label;
+	uint32_t target;
+	if (translate_num(imm, str, 65535, 0) == 0) return 0;
+	if (!(label = strip_operand(str, lower ? "%lo" : "%hi"))) return -1; /* Not from la */
+	if (resolve_label(&target, label, addr, symtbl, reltbl, text_base) == -1) return -1;
+	*imm = lower ? (target & 0xffff) : (target >> 16);
+	return 0;
+}
+
+int write_ori(uint8_t opcode, uint32_t* word, char** args, size_t num_args,
+	uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl, int64_t text_base) {
+  /* DECLARATIONS */
+	int rt, rs, err;
+	long int imm;
+	uint32_t instruction;
+	if (num_args != 3) return -1; /* Basic error checking */
+  /* Assign registers and immdiates */
+	rt = translate_reg(args[0]);
+	rs = translate_reg(args[1]);
+	if (rt == -1 || rs == -1) return -1;
+	err = translate_imm_or_label(&imm, args[2], 1, addr, symtbl, reltbl, text_base);
+  /* Error checking for assignments */
+	if (err == -1) return -1;
+  /* Generate instruction */
+	instruction = 0 | (opcode<<26) | (rs<<21) | (rt<<16) | (imm & 0xffff);
+	*word = instruction;
+	return 0;
+}
+
+int write_lui(uint8_t opcode, uint32_t* word, char** args, size_t num_args,
+	uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl, int64_t text_base) {
+  /* DECLARATIONS */
+	int rt, err;
+	long int imm;
+	uint32_t instruction;
+	if (num_args != 2) return -1; /* Basic error checking */
+  /* Assign registers and immdiates */
+	rt = translate_reg(args[0]);
+	if (rt == -1) return -1;
+	err = translate_imm_or_label(&imm, args[1], 0, addr, symtbl, reltbl, text_base);
+  /* Error checking for assignments */
+	if (err == -1) return -1;
+  /* Generate instruction */
+	instruction = 0 | (opcode<<26) | (rt<<16) | (imm & 0xffff);
+	*word = instruction;
+	return 0;
+}
+
+
+int write_mem(uint8_t opcode, uint32_t* word, char** args, size_t num_args) {
+  /* DECLARATIONS */
+	int rt, err, rs;
+	long int offset;
+	uint32_t instruction;
+	if (num_args != 3) return -1; /* Basic error checking */
+  /* Assign registers and immdiates */
+	rt = translate_reg(args[0]);
+	err = translate_num(&offset, args[1], 32767, -32768);
+	rs = translate_reg(args[2]);
+  /* Error checking for assignments */
+	if (rt == -1 || rs == -1 || err == -1) return -1;
+  /* Generate instruction */
+	instruction = 0 | (opcode<<26) | (rs<<21) | (rt<<16) | (offset & 0xffff);
+	*word = instruction;
+	return 0;
+}
+
+/* Hint: the way for branch to calculate relative address. e.g. bne
+	 bne $rs $rt label
+   assume the byte_offset(addr) of label is L, 
+   current instruction byte_offset(addr) is A
+   the relative address I  for label satisfy:
+	 L = (A + 4) + I * 4
+   so the relative addres is 
+	 I = (L - A - 4) / 4;
+
+   relax_branches() gives the short branch over its jump the relative
+   address I directly, as the operand %rel:I. */
+int write_branch(uint8_t opcode, uint32_t* word, char** args, size_t num_args, 
+		 uint32_t addr, SymbolTable* symtbl) {
+  /* DECLARATIONS */
+	int rs, rt;
+	char* label;
+	const char* offset;
+	uint32_t instruction;
+	long int imm;
+	int64_t label_addr, imm_addr; /* Addresses */
+	if (num_args != 3) return -1; /* Basic error checking */
+  /* Assign registers and labels */
+	rs = translate_reg(args[0]);
+	rt = translate_reg(args[1]);
+	label = args[2];
+	if (rt == -1 || rs == -1) return -1;
+  /* Get label address and handle errors */
+	if ((offset = strip_operand(label, "%rel"))) {
+		if (translate_num(&imm, offset, 32767, -32768) == -1) return -1;
+		imm_addr = imm; /* Relative address given directly */
+	} else {
+		if (!is_valid_label(label)) return -1;
+		label_addr = get_addr_for_symbol(symtbl, label);
+		if (label_addr == -1) return -1;
+		imm_addr = (label_addr - addr - 4) / 4; /* Translate to relative addr I */
+		if (!((-32768 <= imm_addr) && (imm_addr <= 32767))) return -1; /* Treat large relative address as error */
+	}
+  /* Generate instruction */
+	instruction = 0 | (opcode<<26) | (rs<<21) | (rt<<16) | (imm_addr & 0xffff);
+	*word = instruction;
+	return 0;
+}
+
+/* Hint: the relocation table should record
+   1. the current instruction byte_offset(addr)
+   2. the unsolved LABEL in the jump instruction
+
+   Labels are looked up with resolve_label(), so with a known TEXT_BASE a
+   locally defined target is encoded directly and nothing is relocated. The
+   target must lie in the same 256 MB region as the instruction following the
+   jump, i.e. share its upper 4 bits. */
+int write_jump(uint8_t opcode, uint32_t* word, char** args, size_t num_args, 
+		   uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl, int64_t text_base) {
+  /* DECLARATIONS */
+	int err;
+	uint32_t instruction;
+	uint32_t target, next_pc; /* Absolute addresses */
+	if (num_args != 1) return -1; /* Basic error checking */
+  /* Resolve or relocate the label */
+	err = resolve_label(&target, args[0], addr, symtbl, reltbl, text_base);
+	if (err == -1) return -1;
+	if (err == 1) {
+		next_pc = (uint32_t)(text_base + addr + 4);
+		if ((target & 0xf0000000) != (next_pc & 0xf0000000)) return -1; /* Out of 256 MB region */
+	}
+  /* Generate instruction */
+	instruction = 0 | (opcode<<26) | ((target>>2) & 0x3ffffff);
+	*word = instruction;
+	return 0;
+}
@@ -1,36 +1,63 @@
-#ifndef TRANSLATE_H
-#define TRANSLATE_H
-
-#include <stdint.h>
-
-/* IMPLEMENT ME - see documentation in translate.c */
-unsigned write_pass_one(FILE* output, const char* name, char** args, int num_args);
-
-/* IMPLEMENT ME - see documentation in translate.c */
-int translate_inst(FILE* output, const char* name, char** args, size_t num_args, 
-    uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl);
-
-/* Declaring helper functions: */
-
-int write_rtype(uint8_t funct, FILE* output, char** args, size_t num_args);
-
-int write_shift(uint8_t funct, FILE* output, char** args, size_t num_args);
-
-/* you may want to IMPLEMENT ME */ 
-int write_jr(uint8_t funct, FILE* output, char** args, size_t num_args);
-
-int write_addiu(uint8_t opcode, FILE* output, char** args, size_t num_args);
-
-int write_ori(uint8_t opcode, FILE* output, char** args, size_t num_args);
-
-int write_lui(uint8_t opcode, FILE* output, char** args, size_t num_args);
-
-int write_mem(uint8_t opcode, FILE* output, char** args, size_t num_args);
-
-int write_branch(uint8_t opcode, FILE* output, char** args, size_t num_args, 
-    uint32_t addr, SymbolTable* symtbl);
-
-int write_jump(uint8_t opcode, FILE* output, char** args, size_t num_args, 
-    uint32_t addr, SymbolTable* reltbl);
-
-#endif
+#ifndef TRANSLATE_H
+#define TRANSLATE_H
+
+#include <stdint.h>
+
+/* Instruction formats, one per write_*() helper below. */
+#define FMT_NONE   0
+#define FMT_RTYPE  1        /* rd, rs, rt */
+#define FMT_SHIFT  2        /* rd, rt, shamt */
+#define FMT_JR     3        /* rs */
+#define FMT_ADDIU  4        /* rt, rs, signed imm */
+#define FMT_ORI    5        /* rt, rs, unsigned imm or label */
+#define FMT_LUI    6        /* rt, unsigned imm or label */
+#define FMT_MEM    7        /* rt, offset, rs */
+#define FMT_BRANCH 8        /* rs, rt, label or offset */
+#define FMT_JUMP   9        /* label */
+
+typedef struct InstEncoding {
+    const char* name;
+    int format;
+    uint8_t code;           /* opcode, or funct if the format is R-type */
+} InstEncoding;
+
+/* Ends with an entry whose NAME is NULL, see translate.c */
+extern const InstEncoding INST_ENCODINGS[];
+
+/* IMPLEMENT ME - see documentation in translate.c */
+unsigned write_pass_one(FILE* output, const char* name, char** args, int num_args);
+
+/* Passes the directive NAME through to OUTPUT during pass one. */
+int write_directive(FILE* output, const char* name, char** args, int num_args);
+
+/* IMPLEMENT ME - see documentation in translate.c */
+int translate_inst(FILE* output, const char* name, char** args, size_t num_args, 
+    uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl, int64_t text_base,
+    uint32_t* word);
+
+/* Declaring helper functions: */
+
+int write_rtype(uint8_t funct, uint32_t* word, char** args, size_t num_args);
+
+int write_shift(uint8_t funct, uint32_t* word, char** args, size_t num_args);
+
+/* you may want to IMPLEMENT ME */ 
+int write_jr(uint8_t funct, uint32_t* word, char** args, size_t num_args);
+
+int write_addiu(uint8_t opcode, uint32_t* word, char** args, size_t num_args);
+
+int write_ori(uint8_t opcode, uint32_t* word, char** args, size_t num_args,
+    uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl, int64_t text_base);
+
+int write_lui(uint8_t opcode, uint32_t* word, char** args, size_t num_args,
+    uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl, int64_t text_base);
+
+int write_mem(uint8_t opcode, uint32_t* word, char** args, size_t num_args);
+
+int write_branch(uint8_t opcode, uint32_t* word, char** args, size_t num_args, 
+    uint32_t addr, SymbolTable* symtbl);
+
+int write_jump(uint8_t opcode, uint32_t* word, char** args, size_t num_args, 
+    uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl, int64_t text_base);
+
+#endif
@@ -1,12 +1,55 @@
-
-/*******************************
- * Do Not Modify Code Below
- *******************************/
-
-int is_log_file_set();
-
-void set_log_file(const char* filename);
-
-void write_to_log(char* fmt, ...);
-
-void log_inst(const char* name, char** args, int num_args);
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <setjmp.h>
+
+#define MAX_CLEANUPS 8          /* registered at once, see push_cleanup() */
+
+typedef struct Cleanup {
+    void (*free_fn)(void*);
+    void* ptr;
+} Cleanup;
+
+/* Diagnostics of one assembly, collected in memory instead of going to the
+   log file or stderr, and what its allocation failures unwind. It is handed
+   explicitly to whatever logs or allocates for the assembly, mostly through
+   the tables and lists it works on; NULL stands for the command line, which
+   logs with write_to_log() and exits when an allocation fails.
+ */
+typedef struct LogCapture {
+    FILE* stream;           /* where log_to() and write_diagnostic() print */
+    jmp_buf on_failure;     /* where allocation_failed() returns to */
+    const char* file_name;  /* input named in diagnostics, or NULL */
+    Cleanup cleanups[MAX_CLEANUPS];
+    int num_cleanups;
+} LogCapture;
+
+void log_to(LogCapture* capture, char* fmt, ...);
+
+int is_log_structured(LogCapture* capture);
+
+void write_diagnostic(LogCapture* capture, const char* file, uint32_t line, const char* what,
+    const char* name, char** args, int num_args);
+
+void push_cleanup(LogCapture* capture, void (*free_fn)(void*), void* ptr);
+
+void pop_cleanup(LogCapture* capture, void* ptr);
+
+void run_cleanups(LogCapture* capture);
+
+
+/*******************************
+ * Do Not Modify Code Below
+ *******************************/
+
+int is_log_file_set();
+
+void set_log_file(const char* filename);
+
+void write_to_log(char* fmt, ...);
+
+void log_inst(const char* name, char** args, int num_args);
+
+#endif
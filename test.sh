@@ -24,6 +24,198 @@ echo
 echo "+-> Assembling combined..."
 ./assembler input/combined.s out/my/combined.int out/my/combined.out
 echo
+echo "+-> Assembling constants..."
+./assembler input/constants.s out/my/constants.int out/my/constants.out
+echo
+echo "+-> Assembling jumps..."
+./assembler input/jumps.s out/my/jumps.int out/my/jumps.out -base 0x00400000
+echo
+echo "+-> Assembling relax..."
+dir=$(mktemp -d)
+awk 'BEGIN {
+	print "start:\tbeq $a0, $0, far\t\t# Forward, relaxed"
+	for (i = 0; i < 32768; i++) print "\taddu $0, $0, $0"
+	print "far:\tbne $a0, $a1, start\t\t# Backward, relaxed"
+	print "\tbeq $a0, $a1, far\t\t# In range, kept"
+	print "\tjr $ra"
+}' > $dir/relax.s
+./assembler $dir/relax.s $dir/relax.int $dir/relax.out > /dev/null
+grep -v "^addu" $dir/relax.int > log/my/relax.txt
+grep -vx "00000021" $dir/relax.out >> log/my/relax.txt
+rm -r $dir
+echo
+echo "+-> Assembling peephole..."
+./assembler input/peephole.s out/my/peephole.int out/my/peephole.out -O
+echo
+echo "+-> Assembling dce..."
+./assembler input/dce.s out/my/dce.int out/my/dce.out -dce -entry main
+echo
+echo "+-> Assembling schedule..."
+./assembler input/schedule.s out/my/schedule.int out/my/schedule.out -sched
+./assembler -sim out/my/schedule.out | grep -v "^Speed" > log/my/schedule.txt
+echo
+echo "+-> Assembling data..."
+./assembler input/data.s out/my/data.int out/my/data.out -dce
+./assembler -sim out/my/data.out | grep -v "^Speed" > log/my/data.txt
+echo
+echo "+-> Assembling big_text..."
+dir=$(mktemp -d)
+awk 'BEGIN {
+	print "start:\tla $t0, value\t\t# .data past 8 MB of .text"
+	print "\tlw $v0, 0($t0)"
+	print "\tj done"
+	for (i = 0; i < 2200000; i++) print "\taddu $0, $0, $0"
+	print "done:\tjr $ra"
+	print "\t.data"
+	print "value:\t.word 42"
+}' > $dir/big_text.s
+./assembler $dir/big_text.s $dir/big_text.int $dir/big_text.out -base 0x00400000 > /dev/null
+sed -n '/^\.data/,$p' $dir/big_text.out > log/my/big_text.txt
+./assembler -sim $dir/big_text.out | grep -v "^Speed" | sed "s|$dir/||" >> log/my/big_text.txt
+rm -r $dir
+echo
+echo "+-> Linking long_names..."
+dir=$(mktemp -d)
+awk 'BEGIN {
+	for (i = 0; i < 990; i++) name = name "l"
+	for (i = 0; i < 3; i++) print "\tjal " name i
+	print "\tj done"
+	for (i = 0; i < 3; i++) print name i ":\taddiu $v0, $v0, " i + 1 "\n\tjr $ra"
+	print "done:"
+}' > $dir/long_names.s
+./assembler $dir/long_names.s $dir/long_names.int $dir/long_names.out -crel > /dev/null
+./assembler -sim $dir/long_names.out -max 20 | grep -v "^Speed" | sed "s|$dir/||" > log/my/long_names.txt
+rm -r $dir
+echo
+echo "+-> Assembling data through a symbol interface..."
+./assembler -p1 input/data.s out/my/data_sym.int -dce -sym out/my/data.sym
+./assembler -p2 out/my/data_sym.int out/my/data_sym.out -sym out/my/data.sym
+./assembler input/data.s out/my/data_sym.int out/my/data_sym.out -dce -sym out/my/data.sym > log/my/iface.txt
+./assembler -p2 out/my/simple.int out/my/stale.out -sym out/my/data.sym -log log/my/iface_stale.txt
+rm out/my/data.sym out/my/stale.out
+echo
+echo "+-> Assembling jumps and labels with symbols spilled to disk..."
+./assembler input/jumps.s out/my/jumps_mem.int out/my/jumps_mem.out -base 0x00400000 -mem 64
+./assembler input/labels.s out/my/labels_mem.int out/my/labels_mem.out -mem 64
+dir=$(mktemp -d)
+awk 'BEGIN {
+	print "start:\tbeq $t0, $0, far\t# Past 32768 instructions, relaxed only without -mem"
+	for (i = 0; i < 40000; i++) print "\taddu $0, $0, $0"
+	print "far:\tjr $ra"
+}' > $dir/far.s
+./assembler $dir/far.s $dir/far.int $dir/far.out -mem 4096 -log log/my/big_mem.txt > /dev/null
+[ -e $dir/far.out ] && echo "Wrote far.out" >> log/my/big_mem.txt
+awk 'BEGIN { n = 20000; for (i = 0; i < n; i++) { # Same as bench-memory
+	printf "f%d: addiu $sp, $sp, -8\nsw $ra, 4($sp)\n", i
+	printf "beq $t0, $0, f%d\njal f%d\n", i + 1 < n ? i + 1 : i, (i * 7919) % n
+	printf "lw $ra, 4($sp)\njr $ra\n" } }' > $dir/big_mem.s
+./assembler $dir/big_mem.s $dir/big.int $dir/big.out > /dev/null
+./assembler $dir/big_mem.s $dir/big_mem.int $dir/big_mem.out -mem 65536 -stats \
+	| grep "^Stats" | grep -v "peak" >> log/my/big_mem.txt
+cmp $dir/big.out $dir/big_mem.out >> log/my/big_mem.txt && echo "Same output with -mem" >> log/my/big_mem.txt
+rm -r $dir
+echo
+echo "+-> Assembling sim..."
+./assembler input/sim.s out/my/sim.int out/my/sim.out
+echo
+echo "+-> Simulating sim..."
+./assembler -sim out/my/sim.out | grep -v "^Speed" > log/my/sim.txt
+./assembler -sim out/my/simple.out -max 2 2>&1 | grep -v "^Speed" > log/my/sim_max.txt
+./assembler -sim out/my/simple.out -base 0xFFFFFFF0 -log log/my/sim_wrap.txt > /dev/null
+./assembler -sim out/my/data.out -base 0xFFC00000 | grep -v "^Speed" >> log/my/sim_wrap.txt
+echo
+echo "+-> Profiling sim..."
+./assembler input/sim.s out/my/sim_g.int out/my/sim_g.out -g
+./assembler -prof out/my/sim_g.out input/sim.s -counts log/my/sim.counts > log/my/prof.txt
+echo
+echo "+-> Laying out sim..."
+./assembler input/sim.s out/my/sim_layout.int out/my/sim_layout.out -layout log/my/sim.counts
+./assembler -sim out/my/sim_layout.out | grep -v "^Speed" > log/my/sim_layout.txt
+./assembler input/layout.s out/my/layout_g.int out/my/layout_g.out -g
+./assembler -prof out/my/layout_g.out input/layout.s -counts log/my/layout.counts > /dev/null
+./assembler input/layout.s out/my/layout.int out/my/layout.out -layout log/my/layout.counts
+./assembler -sim out/my/layout.out | grep -v "^Speed" > log/my/layout.txt
+echo
+echo "+-> Disassembling combined and jumps..."
+./assembler -d out/my/combined.out -verify > log/my/disasm.txt
+./assembler -d out/my/jumps.out -base 0x00400000 -verify >> log/my/disasm.txt
+dir=$(mktemp -d)
+printf '24020001\n03e00008\n' > $dir/hex.txt
+./assembler -d $dir/hex.txt -verify >> log/my/disasm.txt
+rm -r $dir
+echo
+echo "+-> Assembling simple again on each save with -watch..."
+dir=$(mktemp -d)
+printf '\t.include "watch_inc.s"\n' | cat - input/simple.s > $dir/watch.s
+printf '\taddu $0, $0, $0\n' > $dir/watch_inc.s
+./assembler $dir/watch.s $dir/watch.int $dir/watch.out -watch -stats > $dir/log 2>&1 &
+pid=$!
+wait_for() { # Until the log has $1 lines starting with $2
+	for i in $(seq 100); do
+		[ "$(grep -c "^$2" $dir/log)" -ge $1 ] && return
+		sleep 0.05
+	done
+}
+wait_for 1 Watching
+touch $dir/watch.s
+wait_for 1 Rebuilt
+rm $dir/watch.out
+mkdir $dir/watch.out # Cannot be opened for writing
+touch $dir/watch.s
+wait_for 2 Rebuilt
+rmdir $dir/watch.out
+touch $dir/watch.s
+wait_for 3 Rebuilt
+printf '#addu $0, $0, $0\n' > $dir/watch_inc.s # Same size, likely the same second
+wait_for 4 Rebuilt
+kill $pid
+wait $pid 2> /dev/null
+sed -e "s|$dir/||g" -e 's/ in [0-9.]* ms/ in ms/' -e '/peak resident/d' $dir/log > log/my/watch.txt
+cmp $dir/watch.out out/my/simple.out >> log/my/watch.txt
+rm -r $dir
+echo
+echo "+-> Assembling and disassembling combined with grouped relocations..."
+./assembler input/combined.s out/my/combined_crel.int out/my/combined_crel.out -crel
+./assembler -d out/my/combined_crel.out -verify > log/my/disasm_crel.txt
+echo
+echo "+-> Assembling include and include_errors..."
+./assembler input/include.s out/my/include.int out/my/include.out
+./assembler -sim out/my/include.out | grep -v "^Speed" > log/my/include.txt
+./assembler -p1 input/include_errors.s out/my/include_errors.int -log log/my/include_errors.txt
+./assembler -check input/include_errors.s >> log/my/include_errors.txt
+rm out/my/include_errors.int
+echo
+echo "+-> Packing combined and sim..."
+./assembler input/combined.s out/my/combined_z.int out/my/combined_z.outz -z
+./assembler -unpack out/my/combined_z.outz out/my/combined_z.out
+./assembler -unpack out/my/combined_z.outz log/my/pack_words.txt -words 2 5
+./assembler -d out/my/combined_z.outz -verify > log/my/pack.txt
+./assembler input/sim.s out/my/sim_z.int out/my/sim_z.outz -g -z
+./assembler -sim out/my/sim_z.outz | grep -v "^Speed" >> log/my/pack.txt
+./assembler -prof out/my/sim_z.outz input/sim.s >> log/my/pack.txt
+rm out/my/combined_z.int out/my/sim_z.int
+dir=$(mktemp -d)
+awk 'BEGIN { for (i = 0; i < 20000; i++) printf "addiu $t%d, $t%d, %d\n", i % 8, (i / 8) % 8, i }' > $dir/big.s
+./assembler $dir/big.s $dir/big.int $dir/big.out > /dev/null
+./assembler $dir/big.s $dir/big.int $dir/big.outz -z > /dev/null
+./assembler -unpack $dir/big.outz $dir/big_z.out
+./assembler -unpack $dir/big.outz $dir/words.txt -words 16380 8
+cmp $dir/big.out $dir/big_z.out > log/my/pack_big.txt
+sed -n '16382,16389p' $dir/big.out | cmp - $dir/words.txt >> log/my/pack_big.txt
+cat $dir/words.txt >> log/my/pack_big.txt
+rm -r $dir
+echo
+echo "+-> Assembling simple, imm and labels as a batch..."
+dir=$(mktemp -d)
+ls input/simple.s input/imm.s input/labels.s > $dir/list
+for io in uring rw stdio; do
+	./assembler -batch $dir/list $dir -io $io | sed 's/ in .* ms with [^:]*//'
+	for f in simple imm labels; do
+		cmp $dir/$f.int out/my/$f.int && cmp $dir/$f.out out/my/$f.out
+	done
+done > log/my/batch.txt
+rm -r $dir
+echo
 echo "+-> Assembling p1_errors..."
 ./assembler -p1 input/p1_errors.s out/my/p1_errors.int -log log/my/p1_errors.txt
 echo
@@ -31,6 +223,14 @@ echo "+-> Assembling p2_errors..."
 ./assembler input/p2_errors.s out/my/p2_errors.int out/my/p2_errors.out -log log/my/p2_errors.txt
 rm out/my/p1_errors.int out/my/p2_errors.int out/my/p2_errors.out
 echo
+echo "+-> Checking p1_errors, p2_errors and data..."
+./assembler -check input/p1_errors.s > log/my/check.txt
+./assembler -check input/p2_errors.s >> log/my/check.txt
+./assembler -check input/data.s >> log/my/check.txt
+echo
+echo "+-> Checking operand_errors..."
+./assembler -check input/operand_errors.s > log/my/operand_errors.txt
+echo
 echo ">-< Diff .int and .out files ^-^"
 diff out/my out/ref
 echo